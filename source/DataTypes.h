@@ -11,9 +11,13 @@ namespace dae
 		Vector3 tangent{};
 	};
 
-	struct VertexExt final : public Vertex
+	//Vertex in 20 bytes instead of 44, see VertexQuantization
+	struct QuantizedVertex
 	{
-		Vector3 viewDirection{};
+		uint16_t position[4]{};		//xyz unorm inside the bounds of the mesh, w unused
+		int16_t normal[2]{};		//octahedral snorm
+		int16_t tangent[2]{};		//octahedral snorm
+		uint16_t uv[2]{};			//half floats
 	};
 
 	struct VertexOut final
@@ -25,6 +29,171 @@ namespace dae
 		Vector3 viewDirection{};
 	};
 
+	//Change of the uv coordinates from one pixel to the next, selects the mip level when sampling
+	struct UVDerivatives
+	{
+		Vector2 ddx{};
+		Vector2 ddy{};
+	};
+
+	enum class LightType
+	{
+		Directional,
+		Point,
+		Spot
+	};
+
+	//Point and spot lights fall off with the inverse square distance and reach zero at their range
+	struct Light
+	{
+		LightType type{ LightType::Point };
+		Vector3 position{};
+		//Direction the light travels in, used by directional and spot lights
+		Vector3 direction{ 0.f, 0.f, 1.f };
+		ColorRGB color{ 1.f, 1.f, 1.f };
+		float intensity{ 1.f };
+		float range{ 10.f };
+		//Cosine of the half angles of the spot cone, full intensity inside the inner angle and none outside the outer angle
+		float cosInnerAngle{ 1.f };
+		float cosOuterAngle{ 1.f };
+		//Only directional lights cast shadows in the software rasterizer
+		bool castsShadows{ false };
+	};
+
+	//Depth buffer that the depth rasterizer renders into, 1 is the far plane
+	struct DepthTarget
+	{
+		float* pDepth{ nullptr };
+		int width{};
+		int height{};
+	};
+
+	//Depth of the shadow casters as seen by a directional light
+	struct ShadowMap
+	{
+		DepthTarget target{};
+		Matrix viewProjection{};
+		uint32_t lightIdx{};
+		//Fragments are moved this far along their normal before the lookup to avoid shadow acne, about a texel in world units
+		float normalOffset{};
+		float depthBias{};
+	};
+
+	//Fragments of one triangle that are shaded together, stored as a structure of arrays so effects can shade several lanes at once.
+	//Bit i of the mask is set when lane i holds a fragment, the content of the other lanes is undefined
+	struct FragmentBatch
+	{
+		static constexpr uint32_t Size{ 8 };
+
+		uint32_t mask{};
+
+		//Perspective correct attributes, the vectors are interpolated but not normalized
+		alignas(16) float u[Size];
+		alignas(16) float v[Size];
+		alignas(16) float ddxU[Size];
+		alignas(16) float ddxV[Size];
+		alignas(16) float ddyU[Size];
+		alignas(16) float ddyV[Size];
+		alignas(16) float normalX[Size];
+		alignas(16) float normalY[Size];
+		alignas(16) float normalZ[Size];
+		alignas(16) float tangentX[Size];
+		alignas(16) float tangentY[Size];
+		alignas(16) float tangentZ[Size];
+		alignas(16) float viewDirectionX[Size];
+		alignas(16) float viewDirectionY[Size];
+		alignas(16) float viewDirectionZ[Size];
+
+		//Backbuffer color below the fragment, for blending
+		alignas(16) uint32_t currentColor[Size];
+
+		//All fragments of a batch lie in the same screen tile and are lit by the lights of that tile.
+		//The world position of a fragment is cameraOrigin + its view direction
+		const Light* pLights{ nullptr };
+		const uint32_t* pLightIndices{ nullptr };
+		uint32_t numLights{};
+		Vector3 cameraOrigin{};
+		//Shadows of the light at pShadowMap->lightIdx, nullptr when there is no shadow casting light
+		const ShadowMap* pShadowMap{ nullptr };
+
+		//Written by the effect
+		alignas(16) float red[Size];
+		alignas(16) float green[Size];
+		alignas(16) float blue[Size];
+	};
+
+
+	//Axis aligned bounding box, starts out empty so any point grows it
+	struct BoundingBox
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = Vector3{ std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z) };
+			max = Vector3{ std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z) };
+		}
+
+		void Grow(const BoundingBox& box)
+		{
+			Grow(box.min);
+			Grow(box.max);
+		}
+
+		Vector3 GetCenter() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		Vector3 GetExtent() const
+		{
+			return (max - min) * 0.5f;
+		}
+	};
+
+	//Plane in the form dot(normal, point) + distance, positive on the inside
+	struct Plane
+	{
+		Vector3 normal{};
+		float distance{};
+	};
+
+	struct Frustum
+	{
+		//Left, Right, Bottom, Top, Near, Far
+		Plane planes[6]{};
+	};
+
+	//Triangles of a mesh that share a material, a range of its index buffer
+	struct Submesh
+	{
+		uint32_t indexOffset{};
+		uint32_t indexCount{};
+		uint32_t materialIdx{};
+	};
+
+	//Materials the submeshes of a mesh refer to by index, with the material libraries that define them by name
+	struct MeshMaterials
+	{
+		std::vector<std::string> libraryPaths{};
+		std::vector<std::string> names{};
+	};
+
+	//One copy of a mesh, all copies share the vertices, indices and effect of the mesh.
+	//The world matrix of an instance is rotation * transform * translation of the mesh, so every copy spins around its own origin
+	struct MeshInstance
+	{
+		Matrix transform{};
+		ColorRGB tint{ 1.f, 1.f, 1.f };
+	};
+
+	//Per instance data as it is stored in the instance buffer of the hardware rasterizer
+	struct InstanceData
+	{
+		Matrix world{};
+		ColorRGB tint{};
+	};
 
 	enum class PrimitiveTopology
 	{
@@ -34,6 +203,12 @@ namespace dae
 		TriangleStrip = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP
 	};
 
+	enum class VertexFormat
+	{
+		Float,
+		Quantized
+	};
+
 	enum class ShadingMode
 	{
 		Combined,
@@ -64,6 +239,14 @@ namespace dae
 		COUNT
 	};
 
+	//Decides how a texture is stored for the software rasterizer and which format it is uploaded in
+	enum class TextureUsage
+	{
+		Color,	//RGBA8
+		Normal,	//RG8, tangent space xy, z is rebuilt when sampling
+		Mask	//R8, grayscale maps like specular and glossiness
+	};
+
 	enum class RenderMode
 	{
 		FinalColor,
@@ -72,5 +255,14 @@ namespace dae
 		//Declare modes above
 		COUNT
 	};
+
+	//Submeshes that blend do not write depth, so they are rendered after the opaque submeshes of every mesh.
+	//Only the software rasterizer has a depth prepass
+	enum class RenderPass
+	{
+		DepthPrepass,
+		Opaque,
+		Transparent
+	};
 }
 
@@ -0,0 +1,229 @@
+#include "pch.h"
+#include "DepthRasterizer.h"
+#include "FrameArena.h"
+#include "Mesh.h"
+#include "Effect.h"
+#include "Utils.h"
+
+//Multithreading includes
+#include <ppl.h>
+
+namespace dae
+{
+	namespace DepthRasterizer
+	{
+		namespace
+		{
+			//Depth test and write of a single pixel, for the pixels at the end of a row that do not fill four lanes
+			void RasterizePixel(const DepthTarget& target, const Vector2& v0, const Vector2& v1, const Vector2& v2,
+				float depth0, float depth1, float depth2, float invTriangleArea, CullMode cullMode, int px, int py)
+			{
+				const Vector2 pixelCoordinates{ static_cast<float>(px), static_cast<float>(py) };
+				float signedAreaV0V1, signedAreaV1V2, signedAreaV2V0;
+				if (!GeometryUtils::IsPointInTriangle(v0, v1, v2, pixelCoordinates, signedAreaV0V1, signedAreaV1V2, signedAreaV2V0)) return;
+
+				const bool isFront{ signedAreaV0V1 >= 0.f };
+				if ((cullMode == CullMode::Back && !isFront) || (cullMode == CullMode::Front && isFront)) return;
+
+				const float weightV0{ signedAreaV1V2 * invTriangleArea };
+				const float weightV1{ signedAreaV2V0 * invTriangleArea };
+				const float weightV2{ signedAreaV0V1 * invTriangleArea };
+				const float depthInterpolated{ 1.f / (weightV0 / depth0 + weightV1 / depth1 + weightV2 / depth2) };
+
+				float& depth{ target.pDepth[px + py * target.width] };
+				if (depth <= depthInterpolated || depthInterpolated < 0.f || depthInterpolated > 1.f) return;
+				depth = depthInterpolated;
+			}
+		}
+
+		void Clear(const DepthTarget& target)
+		{
+			std::fill_n(target.pDepth, target.width * target.height, 1.f);
+		}
+
+		void RasterizeTriangle(const DepthTarget& target, const Vector2& v0, const Vector2& v1, const Vector2& v2,
+			float depth0, float depth1, float depth2, CullMode cullMode, int bandMinY, int bandMaxY)
+		{
+			//Create boundingbox around triangle, clipped to the target
+			Vector2 boundingBoxMin{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
+			Vector2 boundingBoxMax{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
+
+			const Vector2 targetSize{ static_cast<float>(target.width), static_cast<float>(target.height) };
+			boundingBoxMin = Vector2::Max(Vector2::Zero, Vector2::Min(boundingBoxMin, targetSize));
+			boundingBoxMax = Vector2::Max(Vector2::Zero, Vector2::Min(boundingBoxMax, targetSize));
+
+			const float invTriangleArea{ 1.f / Vector2::Cross(v1 - v0, v2 - v0) };
+			const Vector2 edgeV0V1{ v1 - v0 };
+			const Vector2 edgeV1V2{ v2 - v1 };
+			const Vector2 edgeV2V0{ v0 - v2 };
+
+			//Lanes hold four neighbouring pixels, groups start at a multiple of four so every group stays inside its row
+			const int minX{ static_cast<int>(boundingBoxMin.x) };
+			const __m128 minXLane{ _mm_set1_ps(static_cast<float>(minX)) };
+			const __m128 maxXLane{ _mm_set1_ps(boundingBoxMax.x) };
+			const __m128 laneOffsets{ _mm_setr_ps(0.f, 1.f, 2.f, 3.f) };
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.f) };
+			const __m128 invArea{ _mm_set1_ps(invTriangleArea) };
+			const __m128 depthV0{ _mm_set1_ps(depth0) };
+			const __m128 depthV1{ _mm_set1_ps(depth1) };
+			const __m128 depthV2{ _mm_set1_ps(depth2) };
+
+			//The sign of the areas tells which side of the triangle is visible
+			const __m128 acceptFront{ _mm_castsi128_ps(_mm_set1_epi32(cullMode != CullMode::Front ? -1 : 0)) };
+			const __m128 acceptBack{ _mm_castsi128_ps(_mm_set1_epi32(cullMode != CullMode::Back ? -1 : 0)) };
+
+			for (int py{ std::max(static_cast<int>(boundingBoxMin.y), bandMinY) }; py < boundingBoxMax.y && py < bandMaxY; ++py)
+			{
+				const float pixelY{ static_cast<float>(py) };
+				const __m128 pixelYV0{ _mm_set1_ps(pixelY - v0.y) };
+				const __m128 pixelYV1{ _mm_set1_ps(pixelY - v1.y) };
+				const __m128 pixelYV2{ _mm_set1_ps(pixelY - v2.y) };
+				float* pRow{ target.pDepth + py * target.width };
+
+				for (int px{ minX & ~3 }; px < boundingBoxMax.x; px += 4)
+				{
+					if (px + 4 > target.width)
+					{
+						for (int tailX{ std::max(px, minX) }; tailX < target.width && tailX < boundingBoxMax.x; ++tailX)
+						{
+							RasterizePixel(target, v0, v1, v2, depth0, depth1, depth2, invTriangleArea, cullMode, tailX, py);
+						}
+						continue;
+					}
+
+					const __m128 pixelX{ _mm_add_ps(_mm_set1_ps(static_cast<float>(px)), laneOffsets) };
+
+					//Cross(v1 - v0, pixel - v0) and the other two edges, as in GeometryUtils::IsPointInTriangle
+					const __m128 signedAreaV0V1{ _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(edgeV0V1.x), pixelYV0),
+						_mm_mul_ps(_mm_set1_ps(edgeV0V1.y), _mm_sub_ps(pixelX, _mm_set1_ps(v0.x)))) };
+					const __m128 signedAreaV1V2{ _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(edgeV1V2.x), pixelYV1),
+						_mm_mul_ps(_mm_set1_ps(edgeV1V2.y), _mm_sub_ps(pixelX, _mm_set1_ps(v1.x)))) };
+					const __m128 signedAreaV2V0{ _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(edgeV2V0.x), pixelYV2),
+						_mm_mul_ps(_mm_set1_ps(edgeV2V0.y), _mm_sub_ps(pixelX, _mm_set1_ps(v2.x)))) };
+
+					const __m128 isAreaV0V1Pos{ _mm_cmpge_ps(signedAreaV0V1, zero) };
+					const __m128 isAreaV1V2Pos{ _mm_cmpge_ps(signedAreaV1V2, zero) };
+					const __m128 isAreaV2V0Pos{ _mm_cmpge_ps(signedAreaV2V0, zero) };
+					const __m128 isFront{ _mm_and_ps(_mm_and_ps(isAreaV0V1Pos, isAreaV1V2Pos), isAreaV2V0Pos) };
+					const __m128 isBack{ _mm_cmpeq_ps(_mm_or_ps(_mm_or_ps(isAreaV0V1Pos, isAreaV1V2Pos), isAreaV2V0Pos), zero) };
+					const __m128 isInBoundingBox{ _mm_and_ps(_mm_cmpge_ps(pixelX, minXLane), _mm_cmplt_ps(pixelX, maxXLane)) };
+					const __m128 isCovered{ _mm_and_ps(_mm_or_ps(_mm_and_ps(isFront, acceptFront), _mm_and_ps(isBack, acceptBack)), isInBoundingBox) };
+					if (_mm_movemask_ps(isCovered) == 0) continue;
+
+					const __m128 weightV0{ _mm_mul_ps(signedAreaV1V2, invArea) };
+					const __m128 weightV1{ _mm_mul_ps(signedAreaV2V0, invArea) };
+					const __m128 weightV2{ _mm_mul_ps(signedAreaV0V1, invArea) };
+					const __m128 depthInterpolated{ _mm_div_ps(one, _mm_add_ps(_mm_add_ps(
+						_mm_div_ps(weightV0, depthV0), _mm_div_ps(weightV1, depthV1)), _mm_div_ps(weightV2, depthV2))) };
+
+					//Depth test, only the closer fragments inside the depth range are written
+					const __m128 depth{ _mm_loadu_ps(pRow + px) };
+					const __m128 isInRange{ _mm_and_ps(_mm_cmpge_ps(depthInterpolated, zero), _mm_cmple_ps(depthInterpolated, one)) };
+					const __m128 isCloser{ _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(depthInterpolated, depth), isInRange), isCovered) };
+					_mm_storeu_ps(pRow + px, _mm_or_ps(_mm_and_ps(isCloser, depthInterpolated), _mm_andnot_ps(isCloser, depth)));
+				}
+			}
+		}
+
+		void RenderMeshes(const std::vector<Mesh*>& meshes, const Matrix& viewProjection, const DepthTarget& target, FrameArena& frameArena)
+		{
+			const Frustum frustum{ GeometryUtils::ExtractFrustum(viewProjection) };
+			const int numBands{ (target.height + BandHeight - 1) / BandHeight };
+
+			for (const Mesh* pMesh : meshes)
+			{
+				if (!pMesh->ShouldRender() || !pMesh->UseDepthBuffer()) continue;
+
+				//Quantized positions are decoded by the matrix, as in ProcessorCPU
+				const bool isQuantized{ pMesh->GetVertexFormat() == VertexFormat::Quantized };
+				const std::span<const Vertex> vertices{ pMesh->GetVertices() };
+				const std::span<const QuantizedVertex> quantizedVertices{ pMesh->GetQuantizedVertices() };
+				const size_t numVertices{ isQuantized ? quantizedVertices.size() : vertices.size() };
+				const bool isTriangleStrip{ pMesh->GetPrimitiveTopology() == PrimitiveTopology::TriangleStrip };
+
+				const std::vector<Matrix>& worldMatrices{ pMesh->GetInstanceWorldMatrices() };
+				const std::vector<BoundingBox>& instanceBounds{ pMesh->GetInstanceBounds() };
+				for (uint32_t instanceIdx{}; instanceIdx < worldMatrices.size(); ++instanceIdx)
+				{
+					if (!GeometryUtils::IsBoxInFrustum(frustum, instanceBounds[instanceIdx])) continue;
+
+					const size_t arenaMarker{ frameArena.GetMarker() };
+					const std::span<Vector4> positions{ frameArena.Allocate<Vector4>(numVertices) };
+					const std::span<Vector2> screenVertices{ frameArena.Allocate<Vector2>(numVertices) };
+
+					//Position only vertex stage, same operations as ProcessorCPU::TransformVertex
+					const Matrix worldViewProjectionMatrix{ pMesh->GetPositionDecodeMatrix() * (worldMatrices[instanceIdx] * viewProjection) };
+					concurrency::parallel_for(size_t{}, numVertices, [&](size_t vertIdx)
+					{
+						const Vector3 objectPosition{ isQuantized ? VertexQuantization::LoadPosition(quantizedVertices[vertIdx]) : vertices[vertIdx].position };
+						Vector4 position{ worldViewProjectionMatrix.TransformPoint(Vector4{ objectPosition, 1.f }) };
+						const float perspectiveDiv{ 1.f / position.w };
+						position.x *= perspectiveDiv;
+						position.y *= perspectiveDiv;
+						position.z *= perspectiveDiv;
+
+						positions[vertIdx] = position;
+						screenVertices[vertIdx] = Vector2{
+							(position.x + 1) * 0.5f * target.width,
+							(1 - position.y) * 0.5f * target.height
+						};
+					});
+
+					//Every band owns its rows of the target, so bands do not race on the depth
+					concurrency::parallel_for(0, numBands, [&](int bandIdx)
+					{
+						const int bandMinY{ bandIdx * BandHeight };
+						const int bandMaxY{ std::min(bandMinY + BandHeight, target.height) };
+
+						//Only the submeshes that write depth, each with the cull mode of its own effect
+						for (uint32_t submeshIdx{}; submeshIdx < pMesh->GetSubmeshes().size(); ++submeshIdx)
+						{
+							const Effect* pEffect{ pMesh->GetSubmeshEffect(submeshIdx) };
+							if (!pEffect->UseDepthBuffer()) continue;
+
+							const Submesh& submesh{ pMesh->GetSubmeshes()[submeshIdx] };
+							const std::span<const uint32_t> indices{ pMesh->GetIndices().subspan(submesh.indexOffset, submesh.indexCount) };
+							const uint32_t numTriangles{ static_cast<uint32_t>(isTriangleStrip ? (indices.size() < 2 ? 0 : indices.size() - 2) : indices.size() / 3) };
+							const CullMode cullMode{ pEffect->GetCullMode() };
+
+							for (uint32_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+							{
+								uint32_t vertIdx0{}, vertIdx1{}, vertIdx2{};
+								if (isTriangleStrip)
+								{
+									//The vertices are swapped when the triangle is uneven to keep the winding order of the strip
+									const bool swapVertices{ (triangleIdx & 1) == 1 };
+									vertIdx0 = indices[triangleIdx + swapVertices * 2];
+									vertIdx1 = indices[triangleIdx + 1];
+									vertIdx2 = indices[triangleIdx + !swapVertices * 2];
+								}
+								else
+								{
+									vertIdx0 = indices[triangleIdx * 3];
+									vertIdx1 = indices[triangleIdx * 3 + 1];
+									vertIdx2 = indices[triangleIdx * 3 + 2];
+								}
+
+								if (vertIdx0 == vertIdx1 || vertIdx1 == vertIdx2 || vertIdx2 == vertIdx0) continue;
+								if (!GeometryUtils::IsVertexInFrustrum(positions[vertIdx0])
+									|| !GeometryUtils::IsVertexInFrustrum(positions[vertIdx1])
+									|| !GeometryUtils::IsVertexInFrustrum(positions[vertIdx2])) continue;
+
+								//Skip triangles outside of the band before the rasterizer sets up its edges
+								const float minY{ std::min(screenVertices[vertIdx0].y, std::min(screenVertices[vertIdx1].y, screenVertices[vertIdx2].y)) };
+								const float maxY{ std::max(screenVertices[vertIdx0].y, std::max(screenVertices[vertIdx1].y, screenVertices[vertIdx2].y)) };
+								if (maxY < bandMinY || minY >= bandMaxY) continue;
+
+								RasterizeTriangle(target, screenVertices[vertIdx0], screenVertices[vertIdx1], screenVertices[vertIdx2],
+									positions[vertIdx0].z, positions[vertIdx1].z, positions[vertIdx2].z, cullMode, bandMinY, bandMaxY);
+							}
+						}
+					});
+
+					frameArena.Rewind(arenaMarker);
+				}
+			}
+		}
+	}
+}
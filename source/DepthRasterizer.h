@@ -0,0 +1,28 @@
+#pragma once
+#include "DataTypes.h"
+
+namespace dae
+{
+	class Mesh;
+	class FrameArena;
+
+	//Rasterizer that only writes depth: no attributes and no shading, four pixels of a row are depth tested at once.
+	//The depth of a pixel is computed with the same operations as ProcessorCPU::RasterizeTriangle,
+	//so the full rasterizer can test its fragments against this output for equality
+	namespace DepthRasterizer
+	{
+		//Rows per parallel job, every job rasterizes all triangles but only writes its own rows
+		constexpr int BandHeight{ 64 };
+
+		void Clear(const DepthTarget& target);
+
+		//Screen positions are in pixels, depths in [0, 1]. Only the rows in [bandMinY, bandMaxY) are written,
+		//so bands of the same target can be rasterized in parallel
+		void RasterizeTriangle(const DepthTarget& target, const Vector2& v0, const Vector2& v1, const Vector2& v2,
+			float depth0, float depth1, float depth2, CullMode cullMode, int bandMinY, int bandMaxY);
+
+		//Renders the instances of the meshes that use the depth buffer as seen through viewProjection.
+		//Only the positions are transformed, their memory is taken from the arena and released again before returning
+		void RenderMeshes(const std::vector<Mesh*>& meshes, const Matrix& viewProjection, const DepthTarget& target, FrameArena& frameArena);
+	}
+}
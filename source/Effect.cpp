@@ -24,20 +24,24 @@ namespace dae
 		{
 			std::wcout << L"Rasterizer not valid\n";
 		}
+
+		//Vertex decoding
+		m_pIsQuantizedVar = m_pEffect->GetVariableByName("gIsQuantized")->AsScalar();
+		m_pPositionOffsetVar = m_pEffect->GetVariableByName("gPositionOffset")->AsVector();
+		m_pPositionScaleVar = m_pEffect->GetVariableByName("gPositionScale")->AsVector();
+		if (!m_pIsQuantizedVar->IsValid() || !m_pPositionOffsetVar->IsValid() || !m_pPositionScaleVar->IsValid())
+		{
+			std::wcout << L"Vertex decoding variables not valid!\n";
+		}
 	}
 
 	Effect::~Effect()
 	{
 		//Release the matrices
-		if (m_pMatWorldViewProjVar)
-		{
-			m_pMatWorldViewProjVar->Release();
-			m_pMatWorldViewProjVar = nullptr;
-		}
-		if (m_pMatWorldVar)
+		if (m_pMatViewProjVar)
 		{
-			m_pMatWorldVar->Release();
-			m_pMatWorldVar = nullptr;
+			m_pMatViewProjVar->Release();
+			m_pMatViewProjVar = nullptr;
 		}
 		if (m_pMatViewInverseVar)
 		{
@@ -45,6 +49,23 @@ namespace dae
 			m_pMatViewInverseVar = nullptr;
 		}
 
+		//Release the vertex decoding
+		if (m_pIsQuantizedVar)
+		{
+			m_pIsQuantizedVar->Release();
+			m_pIsQuantizedVar = nullptr;
+		}
+		if (m_pPositionOffsetVar)
+		{
+			m_pPositionOffsetVar->Release();
+			m_pPositionOffsetVar = nullptr;
+		}
+		if (m_pPositionScaleVar)
+		{
+			m_pPositionScaleVar->Release();
+			m_pPositionScaleVar = nullptr;
+		}
+
 		if (m_pRasterizerEffect)
 		{
 			m_pRasterizerEffect->Release();
@@ -134,28 +155,32 @@ namespace dae
 
 	void Effect::SetViewProjectionMatrix(const Matrix& matrix)
 	{
-		if (!m_pMatWorldViewProjVar) return;
-		m_pMatWorldViewProjVar->SetMatrix(reinterpret_cast<const float*>(&matrix));
+		if (!m_pMatViewProjVar) return;
+		m_pMatViewProjVar->SetMatrix(reinterpret_cast<const float*>(&matrix));
 	}
 
-	void Effect::SetWorldMatrix(const Matrix& matrix)
-	{
-		if (!m_pMatWorldVar) return;
-		m_pMatWorldVar->SetMatrix(reinterpret_cast<const float*>(&matrix));
-	}
 	void Effect::SetViewInverseMatrix(const Matrix& matrix)
 	{
 		if (!m_pMatViewInverseVar) return;
 		m_pMatViewInverseVar->SetMatrix(reinterpret_cast<const float*>(&matrix));
 	}
 
+	void Effect::SetVertexFormat(VertexFormat vertexFormat, const VertexQuantization::PositionDecoding& positionDecoding)
+	{
+		if (!m_pIsQuantizedVar || !m_pIsQuantizedVar->IsValid()) return;
+		m_pIsQuantizedVar->SetBool(vertexFormat == VertexFormat::Quantized);
+
+		//The input assembler already divides the positions by 65535
+		const float offset[4]{ positionDecoding.offset.x, positionDecoding.offset.y, positionDecoding.offset.z, 0.f };
+		const float scale[4]{ positionDecoding.scale.x, positionDecoding.scale.y, positionDecoding.scale.z, 0.f };
+		m_pPositionOffsetVar->SetFloatVector(offset);
+		m_pPositionScaleVar->SetFloatVector(scale);
+	}
+
 	//SamplerState desc: https://learn.microsoft.com/en-us/windows/win32/api/d3d11/ns-d3d11-d3d11_sampler_desc
-	void Effect::CycleSamplerState(ID3D11Device* pDevice)
+	void Effect::SetSamplerState(ID3D11Device* pDevice, SamplerState samplerState)
 	{
-		//Cycle through the sampler state
-		int state{ static_cast<int>(m_SamplerState) + 1 };
-		int count{ static_cast<int>(SamplerState::COUNT) };
-		m_SamplerState = static_cast<SamplerState>(state % count);
+		m_SamplerState = samplerState;
 
 
 		//Set up the sampler descriptor
@@ -209,12 +234,9 @@ namespace dae
 	}
 
 	//Rasterizer desc: https://learn.microsoft.com/en-us/windows/win32/api/d3d11/ns-d3d11-d3d11_rasterizer_desc
-	void Effect::CycleCullMode(ID3D11Device* pDevice)
+	void Effect::SetCullMode(ID3D11Device* pDevice, CullMode cullMode)
 	{
-		//Cycle through the cullmode
-		int state{ static_cast<int>(m_CullMode) + 1 };
-		int count{ static_cast<int>(CullMode::COUNT) };
-		m_CullMode = static_cast<CullMode>(state % count);
+		m_CullMode = cullMode;
 
 		//Prepare the rasterizer descriptor
 		D3D11_RASTERIZER_DESC rastDesc{};		
@@ -265,6 +287,75 @@ namespace dae
 		if (pRasterizerState) pRasterizerState->Release();
 	}
 
+	ID3D11InputLayout* Effect::CreateInstancedInputLayout(ID3D11Device* pDevice, const D3D11_INPUT_ELEMENT_DESC* pVertexDesc, uint32_t numVertexElements) const
+	{
+		//The instance data comes from the second vertex buffer, the world matrix is passed as four rows
+		static constexpr uint32_t numInstanceElements{ 5 };
+		static constexpr uint32_t maxVertexElements{ 8 };
+		if (numVertexElements > maxVertexElements)
+		{
+			std::wcout << L"Too many vertex elements for the input layout!\n";
+			return nullptr;
+		}
+
+		D3D11_INPUT_ELEMENT_DESC layoutDesc[maxVertexElements + numInstanceElements]{};
+		std::copy_n(pVertexDesc, numVertexElements, layoutDesc);
+
+		for (uint32_t rowIdx{}; rowIdx < 4; ++rowIdx)
+		{
+			D3D11_INPUT_ELEMENT_DESC& rowDesc{ layoutDesc[numVertexElements + rowIdx] };
+			rowDesc.SemanticName = "WORLD";
+			rowDesc.SemanticIndex = rowIdx;
+			rowDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			rowDesc.InputSlot = 1;
+			rowDesc.AlignedByteOffset = offsetof(InstanceData, world) + rowIdx * sizeof(Vector4);
+			rowDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+			rowDesc.InstanceDataStepRate = 1;
+		}
+
+		D3D11_INPUT_ELEMENT_DESC& tintDesc{ layoutDesc[numVertexElements + 4] };
+		tintDesc.SemanticName = "TINT";
+		tintDesc.Format = DXGI_FORMAT_R32G32B32_FLOAT;
+		tintDesc.InputSlot = 1;
+		tintDesc.AlignedByteOffset = offsetof(InstanceData, tint);
+		tintDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+		tintDesc.InstanceDataStepRate = 1;
+
+		//Create Input Layout
+		D3DX11_PASS_DESC passDesc{};
+		GetTechnique()->GetPassByIndex(0)->GetDesc(&passDesc);
+
+		ID3D11InputLayout* pInputLayout{ nullptr };
+
+		HRESULT result = pDevice->CreateInputLayout(
+			layoutDesc,
+			numVertexElements + numInstanceElements,
+			passDesc.pIAInputSignature,
+			passDesc.IAInputSignatureSize,
+			&pInputLayout
+		);
+
+		//Return nullptr if initialisation failed, 
+		//otherwise return the ptr to the initialised layout
+		if (FAILED(result))
+		{
+			std::wcout << L"Input Layout creation failed!\n";
+			return nullptr;
+		}
+
+		return pInputLayout;
+	}
+
+	void Effect::SetLights(const std::vector<Light>& lights)
+	{
+		//Effects without lighting ignore the lights
+	}
+
+	void Effect::BindTextures()
+	{
+		//Effects without textures have nothing to bind
+	}
+
 	bool Effect::UseDepthBuffer() const
 	{
 		return true;
@@ -1,5 +1,6 @@
 #pragma once
 #include "DataTypes.h"
+#include "VertexQuantization.h"
 namespace dae
 {
 	class Effect
@@ -17,30 +18,49 @@ namespace dae
 		ID3DX11Effect* GetEffect() const;
 		ID3DX11EffectTechnique* GetTechnique() const;
 
-		virtual ID3D11InputLayout* CreateInputLayout(ID3D11Device* pDevice) const = 0;
+		virtual ID3D11InputLayout* CreateInputLayout(ID3D11Device* pDevice, VertexFormat vertexFormat) const = 0;
 
+		//The world matrix is part of the instance data
 		void SetViewProjectionMatrix(const Matrix& matrix);
-		void SetWorldMatrix(const Matrix& matrix);
 		void SetViewInverseMatrix(const Matrix& matrix);
+		//Tells the vertex shader how to decode the vertices of the mesh, see VertexQuantization
+		void SetVertexFormat(VertexFormat vertexFormat, const VertexQuantization::PositionDecoding& positionDecoding);
+		//Uploads the lights for the hardware rasterizer, the software rasterizer passes them with every batch
+		virtual void SetLights(const std::vector<Light>& lights);
+		//Rebinds the textures of the hardware rasterizer before a draw, streaming can replace their views between frames
+		virtual void BindTextures();
 
-		//Shade pixel made virtual so each effect can shade the pixel based on it's properties
-		//Also the Pixel Shading stage
-		virtual ColorRGB ShadePixel(const VertexOut& out, ShadingMode shadingMode, const uint32_t currentColor, bool renderNormals) = 0;
-		virtual void CycleSamplerState(ID3D11Device* pDevice);
-		virtual void CycleCullMode(ID3D11Device* pDevice);
+		//Pixel Shading stage of the software rasterizer, shades every lane in the mask of the batch, called once per batch instead of once per pixel.
+		//The rasterizer picks the kernel for the shading options once per submesh and passes it down with the batches,
+		//the effect keeps no state of the frame so meshes that share it can be rasterized at the same time
+		using ShadeBatchFunction = void (*)(Effect* pEffect, FragmentBatch& batch, const ColorRGB& tint);
+		virtual ShadeBatchFunction SelectShadeBatch(ShadingMode shadingMode, bool renderNormals) const = 0;
+		virtual void SetSamplerState(ID3D11Device* pDevice, SamplerState samplerState);
+		virtual void SetCullMode(ID3D11Device* pDevice, CullMode cullMode);
 		virtual bool UseDepthBuffer() const;
 		virtual bool UseMultiThreading() const;
 		CullMode GetCullMode() const;
 		SamplerState GetSamplerState() const;
 
 	protected:
+		//Calls a shading kernel of a derived effect through a ShadeBatchFunction
+		template<typename EffectType, void (EffectType::*shadeBatch)(FragmentBatch& batch, const ColorRGB& tint)>
+		static void CallShadeBatch(Effect* pEffect, FragmentBatch& batch, const ColorRGB& tint)
+		{
+			(static_cast<EffectType*>(pEffect)->*shadeBatch)(batch, tint);
+		}
+
+		//Appends the per instance elements to the vertex elements and creates the layout for the technique
+		ID3D11InputLayout* CreateInstancedInputLayout(ID3D11Device* pDevice, const D3D11_INPUT_ELEMENT_DESC* pVertexDesc, uint32_t numVertexElements) const;
 
 		//DirectX variables
 		ID3DX11Effect* m_pEffect{ nullptr };
 		ID3DX11EffectTechnique* m_pTechnique{ nullptr };
-		ID3DX11EffectMatrixVariable* m_pMatWorldViewProjVar{ nullptr };
-		ID3DX11EffectMatrixVariable* m_pMatWorldVar{ nullptr };
+		ID3DX11EffectMatrixVariable* m_pMatViewProjVar{ nullptr };
 		ID3DX11EffectMatrixVariable* m_pMatViewInverseVar{ nullptr };
+		ID3DX11EffectScalarVariable* m_pIsQuantizedVar{ nullptr };
+		ID3DX11EffectVectorVariable* m_pPositionOffsetVar{ nullptr };
+		ID3DX11EffectVectorVariable* m_pPositionScaleVar{ nullptr };
 
 		
 		ID3DX11EffectSamplerVariable* m_pSamplerEffect;
@@ -1,25 +1,50 @@
 #include "pch.h"
 #include "EffectOpaque.h"
 #include "Texture.h"
+#include "ResourceManager.h"
+#include <cstddef>
 #include "Utils.h"
 
 namespace dae
 {
+	namespace
+	{
+		//Fraction of a 3x3 texel neighbourhood of the shadow map that is closer to the light than depth.
+		//x and y are in shadow map pixels, everything outside of the map is lit
+		float SampleShadowMap(const ShadowMap& shadowMap, float x, float y, float depth)
+		{
+			const DepthTarget& target{ shadowMap.target };
+			const int centerX{ static_cast<int>(x) };
+			const int centerY{ static_cast<int>(y) };
+			const float biasedDepth{ depth - shadowMap.depthBias };
+
+			float lit{};
+			for (int offsetY{ -1 }; offsetY <= 1; ++offsetY)
+			{
+				const int texelY{ centerY + offsetY };
+				for (int offsetX{ -1 }; offsetX <= 1; ++offsetX)
+				{
+					const int texelX{ centerX + offsetX };
+					if (texelX < 0 || texelY < 0 || texelX >= target.width || texelY >= target.height
+						|| biasedDepth <= target.pDepth[texelY * target.width + texelX])
+					{
+						lit += 1.f;
+					}
+				}
+			}
+			return lit / 9.f;
+		}
+	}
+
 	EffectOpaque::EffectOpaque(ID3D11Device* pDevice, const std::wstring& assetFile)
 		: Effect(pDevice, assetFile)
 	{
 		//connect the different matrices to the hlsl file
-		m_pMatWorldViewProjVar = m_pEffect->GetVariableByName("gWorldViewProj")->AsMatrix();
-		if (!m_pMatWorldViewProjVar->IsValid())
+		m_pMatViewProjVar = m_pEffect->GetVariableByName("gViewProj")->AsMatrix();
+		if (!m_pMatViewProjVar->IsValid())
 		{
 			std::wcout << L"m_pMatViewProjVar is not valid!\n";
 		}
-
-		m_pMatWorldVar = m_pEffect->GetVariableByName("gWorld")->AsMatrix();
-		if (!m_pMatWorldVar->IsValid())
-		{
-			std::wcout << L"m_pMatWorldVar is not valid!\n";
-		}
 		m_pMatViewInverseVar = m_pEffect->GetVariableByName("gViewInverse")->AsMatrix();
 		if (!m_pMatViewInverseVar->IsValid())
 		{
@@ -27,28 +52,29 @@ namespace dae
 		}
 
 		//connect the texture maps to the hlsl file
-		m_pDiffuseMapVar = m_pEffect->GetVariableByName("gDiffuseMap")->AsShaderResource();
-		if (!m_pDiffuseMapVar->IsValid())
+		m_pDiffuseGlossMapVar = m_pEffect->GetVariableByName("gDiffuseGlossMap")->AsShaderResource();
+		if (!m_pDiffuseGlossMapVar->IsValid())
 		{
-			std::wcout << L"m_pDiffuseMapVar not valid\n";
+			std::wcout << L"m_pDiffuseGlossMapVar not valid\n";
 		}
 
-		m_pNormalMapVar = m_pEffect->GetVariableByName("gNormalMap")->AsShaderResource();
-		if (!m_pNormalMapVar->IsValid())
+		m_pNormalSpecularMapVar = m_pEffect->GetVariableByName("gNormalSpecularMap")->AsShaderResource();
+		if (!m_pNormalSpecularMapVar->IsValid())
 		{
-			std::wcout << L"m_pNormalMapVar not valid\n";
+			std::wcout << L"m_pNormalSpecularMapVar not valid\n";
 		}
 
-		m_pSpecularMapVar = m_pEffect->GetVariableByName("gSpecularMap")->AsShaderResource();
-		if (!m_pSpecularMapVar->IsValid())
+		//connect the lights to the hlsl file
+		m_pLightsVar = m_pEffect->GetVariableByName("gLights");
+		if (!m_pLightsVar->IsValid())
 		{
-			std::wcout << L"m_pSpecularMapVar not valid\n";
+			std::wcout << L"m_pLightsVar not valid\n";
 		}
 
-		m_pGlossinessMapVar = m_pEffect->GetVariableByName("gGlossinessMap")->AsShaderResource();
-		if (!m_pGlossinessMapVar->IsValid())
+		m_pNumLightsVar = m_pEffect->GetVariableByName("gNumLights")->AsScalar();
+		if (!m_pNumLightsVar->IsValid())
 		{
-			std::wcout << L"m_pGlossinessMapVar not valid\n";
+			std::wcout << L"m_pNumLightsVar not valid\n";
 		}
 
 		//Set Cullmode
@@ -58,86 +84,70 @@ namespace dae
 	EffectOpaque::~EffectOpaque()
 	{
 		//Release resources
-		if (m_pDiffuseMapVar) m_pDiffuseMapVar->Release();
-		if (m_pNormalMapVar) m_pNormalMapVar->Release();
-		if (m_pSpecularMapVar) m_pSpecularMapVar->Release();
-		if (m_pGlossinessMapVar) m_pGlossinessMapVar->Release();
-
-		delete m_pDiffuseTexture;
-		delete m_pNormalTexture;
-		delete m_pSpecularTexture;
-		delete m_pGlossinessTexture;
+		if (m_pDiffuseGlossMapVar) m_pDiffuseGlossMapVar->Release();
+		if (m_pNormalSpecularMapVar) m_pNormalSpecularMapVar->Release();
+		if (m_pLightsVar) m_pLightsVar->Release();
+		if (m_pNumLightsVar) m_pNumLightsVar->Release();
 	}
 
-	//Diffuse map should be set at effect initialisation
-	void EffectOpaque::SetDiffuseMap(Texture* pDiffuseTexture)
+	//Diffuse gloss map should be set at effect initialisation
+	void EffectOpaque::SetDiffuseGlossMap(std::shared_ptr<Texture> pDiffuseGlossTexture)
 	{
-		if (m_pDiffuseMapVar && pDiffuseTexture)
+		if (m_pDiffuseGlossMapVar && pDiffuseGlossTexture)
 		{
-			m_pDiffuseTexture = pDiffuseTexture;
-			m_pDiffuseMapVar->SetResource(pDiffuseTexture->GetSRV());
+			m_pDiffuseGlossMapVar->SetResource(pDiffuseGlossTexture->GetSRV());
+			m_pDiffuseGlossTexture = std::move(pDiffuseGlossTexture);
 		}
 	}
 
-	//Normal map should be set at effect initialisation
-	void EffectOpaque::SetNormalMap(Texture* pNormalTexture)
+	//Normal specular map should be set at effect initialisation
+	void EffectOpaque::SetNormalSpecularMap(std::shared_ptr<Texture> pNormalSpecularTexture)
 	{
-		if (m_pNormalMapVar && pNormalTexture)
+		if (m_pNormalSpecularMapVar && pNormalSpecularTexture)
 		{
-			m_pNormalTexture = pNormalTexture;
-			m_pNormalMapVar->SetResource(pNormalTexture->GetSRV());
-		}
-	}
-
-	//Specular map should be set at effect initialisation
-	void EffectOpaque::SetSpecularMap(Texture* pSpecularTexture)
-	{
-		if (m_pSpecularMapVar && pSpecularTexture)
-		{
-			m_pSpecularTexture = pSpecularTexture;
-			m_pSpecularMapVar->SetResource(pSpecularTexture->GetSRV());
-		}
-	}
-
-	//Glossiness map should be set at effect initialisation
-	void EffectOpaque::SetGlossinessMap(Texture* pGlossinessTexture)
-	{
-		if (m_pGlossinessMapVar && pGlossinessTexture)
-		{
-			m_pGlossinessTexture = pGlossinessTexture;
-			m_pGlossinessMapVar->SetResource(pGlossinessTexture->GetSRV());
+			m_pNormalSpecularMapVar->SetResource(pNormalSpecularTexture->GetSRV());
+			m_pNormalSpecularTexture = std::move(pNormalSpecularTexture);
 		}
 	}
 
 	//Factory function for the opaque effect
-	EffectOpaque* EffectOpaque::CreateEffect(ID3D11Device* pDevice, const std::wstring& fxPath, const string& diffusePath, 
+	EffectOpaque* EffectOpaque::CreateEffect(ID3D11Device* pDevice, ResourceManager* pResourceManager, const std::wstring& fxPath, const string& diffusePath, 
 		const string& normalPath, const string& specularPath, const string& glossinessPath)
 	{
 		//Initialize effect
 		EffectOpaque* pEffect{ new EffectOpaque(pDevice, fxPath) };
 
-		//Add texture to the respective variable if valid
-		Texture* pDiffuseTexture{ nullptr };
-		Texture* pNormalTexture{ nullptr };
-		Texture* pSpecularTexture{ nullptr };
-		Texture* pGlossinessTexture{ nullptr };
-
-		if (!diffusePath.empty()) pDiffuseTexture = Texture::LoadFromFile(pDevice, diffusePath);
-		if (!normalPath.empty()) pNormalTexture = Texture::LoadFromFile(pDevice, normalPath);
-		if (!specularPath.empty()) pSpecularTexture = Texture::LoadFromFile(pDevice, specularPath);
-		if (!glossinessPath.empty()) pGlossinessTexture = Texture::LoadFromFile(pDevice, glossinessPath);
+		//Pack the maps that are sampled at the same uv, so a pixel only does two fetches.
+		//The normal is encoded hemi-octahedral in rg, 128 in both channels is the flat normal.
+		//Missing maps fall back to white diffuse, a flat normal, no specular and no gloss, so do the samples until a map is resident.
+		//A DDS file is already packed offline in the same layout and stays block compressed,
+		//its glossiness or specular path is not used
+		const Vector4 diffuseGlossFallback{ 1.f, 1.f, 1.f, 0.f };
+		std::shared_ptr<Texture> pDiffuseGlossTexture{ Texture::IsDDSFile(diffusePath)
+			? pResourceManager->LoadTexture(diffusePath, diffuseGlossFallback)
+			: pResourceManager->LoadPackedTexture({
+				Texture::PackedChannel{ diffusePath, 0, 255 },
+				Texture::PackedChannel{ diffusePath, 1, 255 },
+				Texture::PackedChannel{ diffusePath, 2, 255 },
+				Texture::PackedChannel{ glossinessPath, 0, 0 } }, false, diffuseGlossFallback) };
+
+		const Vector4 normalSpecularFallback{ 0.5f, 0.5f, 0.f, 1.f };
+		std::shared_ptr<Texture> pNormalSpecularTexture{ Texture::IsDDSFile(normalPath)
+			? pResourceManager->LoadTexture(normalPath, normalSpecularFallback)
+			: pResourceManager->LoadPackedTexture({
+				Texture::PackedChannel{ normalPath, 0, 128 },
+				Texture::PackedChannel{ normalPath, 1, 128 },
+				Texture::PackedChannel{ specularPath, 0, 0 },
+				Texture::PackedChannel{} }, true, normalSpecularFallback) };
 
 		//Add textures to the effect
-
-		pEffect->SetDiffuseMap(pDiffuseTexture);
-		pEffect->SetNormalMap(pNormalTexture);
-		pEffect->SetSpecularMap(pSpecularTexture);
-		pEffect->SetGlossinessMap(pGlossinessTexture);
+		pEffect->SetDiffuseGlossMap(std::move(pDiffuseGlossTexture));
+		pEffect->SetNormalSpecularMap(std::move(pNormalSpecularTexture));
 
 		return pEffect;
 	}
 
-	ID3D11InputLayout* EffectOpaque::CreateInputLayout(ID3D11Device* pDevice) const
+	ID3D11InputLayout* EffectOpaque::CreateInputLayout(ID3D11Device* pDevice, VertexFormat vertexFormat) const
 	{
 		//Create Vertex Layout
 		static constexpr uint32_t numElements{ 4 };
@@ -162,89 +172,256 @@ namespace dae
 		vertexDesc[3].AlignedByteOffset = 32;
 		vertexDesc[3].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 
-		//Create Input Layout
-		D3DX11_PASS_DESC passDesc{};
-		GetTechnique()->GetPassByIndex(0)->GetDesc(&passDesc);
+		//Quantized vertices are decoded in the vertex shader, see VertexQuantization
+		if (vertexFormat == VertexFormat::Quantized)
+		{
+			vertexDesc[0].Format = DXGI_FORMAT_R16G16B16A16_UNORM;
+			vertexDesc[0].AlignedByteOffset = offsetof(QuantizedVertex, position);
+			vertexDesc[1].Format = DXGI_FORMAT_R16G16_FLOAT;
+			vertexDesc[1].AlignedByteOffset = offsetof(QuantizedVertex, uv);
+			vertexDesc[2].Format = DXGI_FORMAT_R16G16_SNORM;
+			vertexDesc[2].AlignedByteOffset = offsetof(QuantizedVertex, normal);
+			vertexDesc[3].Format = DXGI_FORMAT_R16G16_SNORM;
+			vertexDesc[3].AlignedByteOffset = offsetof(QuantizedVertex, tangent);
+		}
 
-		ID3D11InputLayout* pInputLayout{ nullptr };
+		//Create Input Layout with the per instance data appended
+		return CreateInstancedInputLayout(pDevice, vertexDesc, numElements);
+	}
 
-		HRESULT result = pDevice->CreateInputLayout(
-			vertexDesc,
-			numElements,
-			passDesc.pIAInputSignature,
-			passDesc.IAInputSignatureSize,
-			&pInputLayout
-		);
+	void EffectOpaque::SetLights(const std::vector<Light>& lights)
+	{
+		if (!m_pLightsVar || !m_pNumLightsVar) return;
 
-		//Return nullptr if initialisation failed, 
-		//otherwise return the ptr to the initialised layout
-		if (FAILED(result))
+		//The hardware rasterizer loops over every light, lights beyond the size of the array are dropped
+		const uint32_t numLights{ std::min(static_cast<uint32_t>(lights.size()), m_MaxShaderLights) };
+		ShaderLight shaderLights[m_MaxShaderLights]{};
+		for (uint32_t lightIdx{}; lightIdx < numLights; ++lightIdx)
 		{
-			std::wcout << L"Input Layout creation failed!\n";
-			return nullptr;
+			const Light& light{ lights[lightIdx] };
+			shaderLights[lightIdx].positionType = Vector4{ light.position, static_cast<float>(light.type) };
+			shaderLights[lightIdx].directionRange = Vector4{ light.direction, light.range };
+			shaderLights[lightIdx].colorIntensity = Vector4{ light.color.r, light.color.g, light.color.b, light.intensity };
+			shaderLights[lightIdx].spotAngles = Vector4{ light.cosInnerAngle, light.cosOuterAngle, 0.f, 0.f };
 		}
 
-		return pInputLayout;
+		m_pLightsVar->SetRawValue(shaderLights, 0, numLights * sizeof(ShaderLight));
+		m_pNumLightsVar->SetInt(static_cast<int>(numLights));
 	}
 
 	//Pixel shading stage
-	ColorRGB EffectOpaque::ShadePixel(const VertexOut& out, ShadingMode shadingMode, const uint32_t currentColor, bool renderNormals)
+	Effect::ShadeBatchFunction EffectOpaque::SelectShadeBatch(ShadingMode shadingMode, bool renderNormals) const
 	{
-		Vector3 sampledNormal{ out.normal };
-
-		//Render normals if enabled
-		if (renderNormals)
+		//Indexed by [shadingMode][renderNormals]
+		static constexpr ShadeBatchFunction shadeBatchPermutations[static_cast<int>(ShadingMode::COUNT)][2]
 		{
-			const Vector3 binormal{ Vector3::Cross(out.normal, out.tangent) };
-			const Matrix tangentSpaceAxis{ out.tangent, binormal.Normalized(), out.normal, Vector3{0.f, 0.f, 0.f} };
-			sampledNormal = m_pNormalTexture->SampleNormal(out.uv);
-			sampledNormal = (2.f * sampledNormal) - Vector3{ 1.f, 1.f, 1.f };
-			sampledNormal = tangentSpaceAxis.TransformVector(sampledNormal);
-			sampledNormal.Normalize();
-		}
+			{ &CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::Combined, false>>,
+				&CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::Combined, true>> },
+			{ &CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::ObservedArea, false>>,
+				&CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::ObservedArea, true>> },
+			{ &CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::Diffuse, false>>,
+				&CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::Diffuse, true>> },
+			{ &CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::Specular, false>>,
+				&CallShadeBatch<EffectOpaque, &EffectOpaque::ShadeBatchPermutation<ShadingMode::Specular, true>> }
+		};
+
+		return shadeBatchPermutations[static_cast<int>(shadingMode)][renderNormals];
+	}
 
-		//Calculate shader based on the mode
-		switch (shadingMode)
-		{
-		case ShadingMode::Combined:
+	void EffectOpaque::BindTextures()
+	{
+		if (m_pDiffuseGlossMapVar && m_pDiffuseGlossTexture)
 		{
-			//Lambert BRDF
-			const ColorRGB diffuse{ dae::BRDF::Lambert(m_Kd, m_pDiffuseTexture->Sample(out.uv)) * m_LightIntensity };
-			
-			//Phong BRDF
-			const ColorRGB specular{ BRDF::Phong(m_pSpecularTexture->Sample(out.uv), 1.f, m_pGlossinessTexture->Sample(out.uv).r * m_Shininess,
-				m_LightDirection, -out.viewDirection, sampledNormal) };
-
-			const float observedArea{ std::max(Vector3::Dot(sampledNormal, -m_LightDirection), 0.f) };
-
-			return diffuse * observedArea + specular + m_AmbientLight;
+			m_pDiffuseGlossTexture->RequestResolution(UINT32_MAX);
+			m_pDiffuseGlossMapVar->SetResource(m_pDiffuseGlossTexture->GetSRV());
 		}
-		case ShadingMode::ObservedArea:
+		if (m_pNormalSpecularMapVar && m_pNormalSpecularTexture)
 		{
-			const float observedArea{ std::max(Vector3::Dot(sampledNormal, -m_LightDirection), 0.f) };
-			const ColorRGB observedAreaColor{ observedArea, observedArea, observedArea };
-			return observedAreaColor;
+			m_pNormalSpecularTexture->RequestResolution(UINT32_MAX);
+			m_pNormalSpecularMapVar->SetResource(m_pNormalSpecularTexture->GetSRV());
 		}
-		case ShadingMode::Diffuse:
+	}
+
+	template<ShadingMode shadingMode, bool renderNormals>
+	void EffectOpaque::ShadeBatchPermutation(FragmentBatch& batch, const ColorRGB& tint)
+	{
+		//Only the textures whose channels the permutation reads are sampled
+		constexpr bool useDiffuseGloss{ shadingMode != ShadingMode::ObservedArea };
+		constexpr bool useNormalSpecular{ renderNormals || shadingMode == ShadingMode::Combined || shadingMode == ShadingMode::Specular };
+
+		//One fetch per packed texture and lane, every shading mode reads its channels from these
+		alignas(16) float diffuseRed[FragmentBatch::Size]{};
+		alignas(16) float diffuseGreen[FragmentBatch::Size]{};
+		alignas(16) float diffuseBlue[FragmentBatch::Size]{};
+		alignas(16) float glossiness[FragmentBatch::Size]{};
+		alignas(16) float tangentNormalX[FragmentBatch::Size]{};
+		alignas(16) float tangentNormalY[FragmentBatch::Size]{};
+		alignas(16) float specular[FragmentBatch::Size]{};
+		for (uint32_t lane{}; lane < FragmentBatch::Size; ++lane)
 		{
-			const float observedArea{ std::max(Vector3::Dot(sampledNormal, -m_LightDirection), 0.f) };
-			const ColorRGB observedAreaColor{ observedArea, observedArea, observedArea };
+			if (!(batch.mask & (1u << lane))) continue;
+
+			const Vector2 uv{ batch.u[lane], batch.v[lane] };
+			const UVDerivatives uvDerivatives{ Vector2{ batch.ddxU[lane], batch.ddxV[lane] }, Vector2{ batch.ddyU[lane], batch.ddyV[lane] } };
+			if constexpr (useDiffuseGloss)
+			{
+				const Vector4 diffuseGloss{ m_pDiffuseGlossTexture->SampleRGBA(uv, uvDerivatives, m_SamplerState) };
+				diffuseRed[lane] = diffuseGloss.x * tint.r;
+				diffuseGreen[lane] = diffuseGloss.y * tint.g;
+				diffuseBlue[lane] = diffuseGloss.z * tint.b;
+				glossiness[lane] = diffuseGloss.w;
+			}
+			if constexpr (useNormalSpecular)
+			{
+				const Vector4 normalSpecular{ m_pNormalSpecularTexture->SampleRGBA(uv, uvDerivatives, m_SamplerState) };
+				tangentNormalX[lane] = normalSpecular.x * 2.f - 1.f;
+				tangentNormalY[lane] = normalSpecular.y * 2.f - 1.f;
+				specular[lane] = normalSpecular.z;
+			}
+		}
 
-			//Lambert BRDF
-			const ColorRGB diffuse{ BRDF::Lambert(m_Kd, m_pDiffuseTexture->Sample(out.uv) * m_LightIntensity) };
+		//Lighting is done four lanes at a time, only the lights of the tile the batch is in are evaluated
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 one{ _mm_set1_ps(1.f) };
+		const __m128 minSqrDistance{ _mm_set1_ps(0.01f) };
+		const SimdVector3 cameraOrigin{ SimdVector3::Set(batch.cameraOrigin) };
 
-			return diffuse * observedAreaColor;
-		}
-		case ShadingMode::Specular:
+		for (uint32_t first{}; first < FragmentBatch::Size; first += 4)
 		{
-			//Phong BRDF
-			const ColorRGB specular{ BRDF::Phong(m_pSpecularTexture->Sample(out.uv), 1.f, m_pGlossinessTexture->Sample(out.uv).r * m_Shininess,
-				m_LightDirection, -out.viewDirection, sampledNormal) };
-			return specular;
-		}
-		default:
-			//Return empty color by default
-			return ColorRGB{};
+			SimdVector3 normal{ SimdVector3::Load(batch.normalX + first, batch.normalY + first, batch.normalZ + first).Normalized() };
+
+			//Render normals if enabled
+			if constexpr (renderNormals)
+			{
+				const SimdVector3 tangent{ SimdVector3::Load(batch.tangentX + first, batch.tangentY + first, batch.tangentZ + first).Normalized() };
+				const SimdVector3 binormal{ SimdVector3::Cross(normal, tangent).Normalized() };
+
+				//Hemi-octahedral decode, see Texture::EncodeNormal. The tangent space normal is not normalized,
+				//the frame is orthonormal so normalizing the world normal once is enough
+				const __m128 half{ _mm_set1_ps(0.5f) };
+				const __m128 encodedX{ _mm_load_ps(tangentNormalX + first) };
+				const __m128 encodedY{ _mm_load_ps(tangentNormalY + first) };
+				const __m128 x{ _mm_mul_ps(_mm_add_ps(encodedX, encodedY), half) };
+				const __m128 y{ _mm_mul_ps(_mm_sub_ps(encodedX, encodedY), half) };
+				const __m128 absMask{ _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)) };
+				const __m128 z{ _mm_sub_ps(_mm_sub_ps(one, _mm_and_ps(x, absMask)), _mm_and_ps(y, absMask)) };
+
+				normal = (tangent * x + binormal * y + normal * z).Normalized();
+			}
+
+			const SimdVector3 viewVector{ SimdVector3::Load(batch.viewDirectionX + first, batch.viewDirectionY + first, batch.viewDirectionZ + first) };
+			const SimdVector3 position{ cameraOrigin + viewVector };
+			const SimdVector3 viewDirection{ viewVector.Normalized() };
+			const __m128 exponent{ _mm_mul_ps(_mm_load_ps(glossiness + first), _mm_set1_ps(m_Shininess)) };
+
+			//Shadow factor of the shadow casting light, the lookup position is pushed out along the normal against acne
+			__m128 shadow{ one };
+			if (batch.pShadowMap)
+			{
+				const ShadowMap& shadowMap{ *batch.pShadowMap };
+				const SimdVector3 offsetPosition{ position + normal * _mm_set1_ps(shadowMap.normalOffset) };
+				const Matrix& lightMatrix{ shadowMap.viewProjection };
+
+				//Row vector times matrix, the light projection is orthographic so w stays one
+				alignas(16) float shadowX[4], shadowY[4], shadowZ[4], shadowLit[4];
+				const auto transform{ [&](int column)
+				{
+					__m128 result{ _mm_set1_ps(lightMatrix[3][column]) };
+					result = _mm_add_ps(result, _mm_mul_ps(offsetPosition.x, _mm_set1_ps(lightMatrix[0][column])));
+					result = _mm_add_ps(result, _mm_mul_ps(offsetPosition.y, _mm_set1_ps(lightMatrix[1][column])));
+					return _mm_add_ps(result, _mm_mul_ps(offsetPosition.z, _mm_set1_ps(lightMatrix[2][column])));
+				} };
+				const __m128 halfSizeX{ _mm_set1_ps(0.5f * shadowMap.target.width) };
+				const __m128 halfSizeY{ _mm_set1_ps(0.5f * shadowMap.target.height) };
+				_mm_store_ps(shadowX, _mm_mul_ps(_mm_add_ps(transform(0), one), halfSizeX));
+				_mm_store_ps(shadowY, _mm_mul_ps(_mm_sub_ps(one, transform(1)), halfSizeY));
+				_mm_store_ps(shadowZ, transform(2));
+
+				for (uint32_t lane{}; lane < 4; ++lane)
+				{
+					shadowLit[lane] = SampleShadowMap(shadowMap, shadowX[lane], shadowY[lane], shadowZ[lane]);
+				}
+				shadow = _mm_load_ps(shadowLit);
+			}
+
+			__m128 red{ zero }, green{ zero }, blue{ zero };
+			for (uint32_t tileLightIdx{}; tileLightIdx < batch.numLights; ++tileLightIdx)
+			{
+				const uint32_t lightIdx{ batch.pLightIndices[tileLightIdx] };
+				const Light& light{ batch.pLights[lightIdx] };
+
+				//Direction the light travels in and the fraction of its intensity that reaches the fragments
+				SimdVector3 lightDirection{ SimdVector3::Set(light.direction) };
+				__m128 attenuation{ one };
+				if (light.type != LightType::Directional)
+				{
+					const SimdVector3 toFragment{ position - SimdVector3::Set(light.position) };
+					const __m128 sqrDistance{ _mm_max_ps(SimdVector3::Dot(toFragment, toFragment), minSqrDistance) };
+					lightDirection = toFragment * FastMath::Rsqrt(sqrDistance);
+
+					//Inverse square falloff, windowed so it reaches zero at the range
+					const __m128 rangeRatio{ _mm_mul_ps(sqrDistance, _mm_set1_ps(1.f / (light.range * light.range))) };
+					__m128 window{ _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(rangeRatio, rangeRatio)), zero) };
+					window = _mm_mul_ps(window, window);
+					attenuation = _mm_div_ps(window, sqrDistance);
+
+					if (light.type == LightType::Spot)
+					{
+						const __m128 cosAngle{ SimdVector3::Dot(lightDirection, SimdVector3::Set(light.direction)) };
+						const float invConeWidth{ 1.f / std::max(light.cosInnerAngle - light.cosOuterAngle, 0.0001f) };
+						__m128 cone{ _mm_mul_ps(_mm_sub_ps(cosAngle, _mm_set1_ps(light.cosOuterAngle)), _mm_set1_ps(invConeWidth)) };
+						cone = _mm_min_ps(_mm_max_ps(cone, zero), one);
+						attenuation = _mm_mul_ps(attenuation, _mm_mul_ps(cone, cone));
+					}
+				}
+				if (batch.pShadowMap && lightIdx == batch.pShadowMap->lightIdx)
+				{
+					attenuation = _mm_mul_ps(attenuation, shadow);
+				}
+
+				const __m128 observedArea{ _mm_max_ps(_mm_sub_ps(zero, SimdVector3::Dot(normal, lightDirection)), zero) };
+
+				if constexpr (shadingMode == ShadingMode::ObservedArea)
+				{
+					const __m128 litArea{ _mm_mul_ps(observedArea, attenuation) };
+					red = _mm_add_ps(red, litArea);
+					green = _mm_add_ps(green, litArea);
+					blue = _mm_add_ps(blue, litArea);
+				}
+
+				if constexpr (shadingMode == ShadingMode::Combined || shadingMode == ShadingMode::Specular)
+				{
+					//Phong BRDF, scaled by the light color but not by its intensity
+					const __m128 lightDotNormal{ SimdVector3::Dot(lightDirection, normal) };
+					const SimdVector3 reflect{ lightDirection - normal * _mm_add_ps(lightDotNormal, lightDotNormal) };
+					const __m128 cosa{ _mm_max_ps(_mm_sub_ps(zero, SimdVector3::Dot(reflect, viewDirection)), zero) };
+					const __m128 phong{ _mm_mul_ps(_mm_mul_ps(_mm_load_ps(specular + first), FastMath::Pow(cosa, exponent)), attenuation) };
+
+					red = _mm_add_ps(red, _mm_mul_ps(phong, _mm_set1_ps(light.color.r)));
+					green = _mm_add_ps(green, _mm_mul_ps(phong, _mm_set1_ps(light.color.g)));
+					blue = _mm_add_ps(blue, _mm_mul_ps(phong, _mm_set1_ps(light.color.b)));
+				}
+
+				if constexpr (shadingMode == ShadingMode::Combined || shadingMode == ShadingMode::Diffuse)
+				{
+					//Lambert BRDF
+					const __m128 diffuse{ _mm_mul_ps(_mm_set1_ps(m_Kd / PI * light.intensity), _mm_mul_ps(observedArea, attenuation)) };
+					red = _mm_add_ps(red, _mm_mul_ps(_mm_mul_ps(_mm_load_ps(diffuseRed + first), diffuse), _mm_set1_ps(light.color.r)));
+					green = _mm_add_ps(green, _mm_mul_ps(_mm_mul_ps(_mm_load_ps(diffuseGreen + first), diffuse), _mm_set1_ps(light.color.g)));
+					blue = _mm_add_ps(blue, _mm_mul_ps(_mm_mul_ps(_mm_load_ps(diffuseBlue + first), diffuse), _mm_set1_ps(light.color.b)));
+				}
+			}
+
+			if constexpr (shadingMode == ShadingMode::Combined)
+			{
+				red = _mm_add_ps(red, _mm_set1_ps(m_AmbientLight.r));
+				green = _mm_add_ps(green, _mm_set1_ps(m_AmbientLight.g));
+				blue = _mm_add_ps(blue, _mm_set1_ps(m_AmbientLight.b));
+			}
+
+			_mm_store_ps(batch.red + first, red);
+			_mm_store_ps(batch.green + first, green);
+			_mm_store_ps(batch.blue + first, blue);
 		}
 	}
 	
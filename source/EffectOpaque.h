@@ -4,6 +4,7 @@
 namespace dae
 {
 	class Texture;
+	class ResourceManager;
 	using std::string;
 
     class EffectOpaque final : public Effect
@@ -16,35 +17,50 @@ namespace dae
 		EffectOpaque& operator=(const EffectOpaque&) = delete;
 		EffectOpaque& operator=(EffectOpaque&&) noexcept = delete;
 
-		void SetDiffuseMap(Texture* pDiffuseTexture);
-		void SetNormalMap(Texture* pNormalTexture);
-		void SetSpecularMap(Texture* pSpecularTexture);
-		void SetGlossinessMap(Texture* pGlossinessTexture);
+		//Diffuse in rgb, glossiness in a
+		void SetDiffuseGlossMap(std::shared_ptr<Texture> pDiffuseGlossTexture);
+		//Tangent space normal xy in rg, specular in b
+		void SetNormalSpecularMap(std::shared_ptr<Texture> pNormalSpecularTexture);
 
-		static EffectOpaque* CreateEffect(ID3D11Device* pDevice, const std::wstring& fxPath, const string& diffusePath, 
+		//The four maps are packed in two streamed textures, they are loaded when they are first used.
+		//Effects with the same maps share their textures
+		static EffectOpaque* CreateEffect(ID3D11Device* pDevice, ResourceManager* pResourceManager, const std::wstring& fxPath, const string& diffusePath, 
 			const string& normalPath, const string& specularPath, const string& glossinessPath);
 
-		virtual ID3D11InputLayout* CreateInputLayout(ID3D11Device* pDevice) const override;
-		virtual ColorRGB ShadePixel(const VertexOut& out, ShadingMode shadingMode, const uint32_t currentColor, bool renderNormals) override;
+		virtual ID3D11InputLayout* CreateInputLayout(ID3D11Device* pDevice, VertexFormat vertexFormat) const override;
+		virtual void SetLights(const std::vector<Light>& lights) override;
+		virtual void BindTextures() override;
+		virtual ShadeBatchFunction SelectShadeBatch(ShadingMode shadingMode, bool renderNormals) const override;
 
 	private:
+		//One kernel per shading mode with and without normal mapping, the options are known at compile time inside a kernel
+		template<ShadingMode shadingMode, bool renderNormals>
+		void ShadeBatchPermutation(FragmentBatch& batch, const ColorRGB& tint);
+
+		//Light as it is laid out in the gLights array of the shader
+		struct ShaderLight
+		{
+			Vector4 positionType{};
+			Vector4 directionRange{};
+			Vector4 colorIntensity{};
+			Vector4 spotAngles{};
+		};
+
 		//DirectX variables
-		ID3DX11EffectShaderResourceVariable* m_pDiffuseMapVar{ nullptr };
-		ID3DX11EffectShaderResourceVariable* m_pNormalMapVar{ nullptr };
-		ID3DX11EffectShaderResourceVariable* m_pSpecularMapVar{ nullptr };
-		ID3DX11EffectShaderResourceVariable* m_pGlossinessMapVar{ nullptr };
+		ID3DX11EffectShaderResourceVariable* m_pDiffuseGlossMapVar{ nullptr };
+		ID3DX11EffectShaderResourceVariable* m_pNormalSpecularMapVar{ nullptr };
+		ID3DX11EffectVariable* m_pLightsVar{ nullptr };
+		ID3DX11EffectScalarVariable* m_pNumLightsVar{ nullptr };
 
-		//Textures
-		Texture* m_pDiffuseTexture{ nullptr };
-		Texture* m_pNormalTexture{ nullptr };
-		Texture* m_pSpecularTexture{ nullptr };
-		Texture* m_pGlossinessTexture{ nullptr };
+		//Textures, shared with the other effects that use them
+		std::shared_ptr<Texture> m_pDiffuseGlossTexture{};
+		std::shared_ptr<Texture> m_pNormalSpecularTexture{};
 
 		//Light calculation 
-		const float m_LightIntensity{ 7.f };
 		const float m_Kd{ 1.f };
 		const float m_Shininess{ 25.f };
 		const ColorRGB m_AmbientLight{ 0.025f, 0.025f, 0.025f };
-		const Vector3 m_LightDirection{ 0.577f, -0.577f, 0.577f };
+		//Has to match MAX_LIGHTS in the shader
+		static constexpr uint32_t m_MaxShaderLights{ 256 };
     };
 }
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "EffectTransparent.h"
 #include "Texture.h"
+#include "ResourceManager.h"
+#include <cstddef>
 
 namespace dae
 {
@@ -8,8 +10,8 @@ namespace dae
 		:Effect(pDevice, assetFile)
 	{
 		//connect the different matrices to the hlsl file
-		m_pMatWorldViewProjVar = m_pEffect->GetVariableByName("gWorldViewProj")->AsMatrix();
-		if (!m_pMatWorldViewProjVar->IsValid())
+		m_pMatViewProjVar = m_pEffect->GetVariableByName("gViewProj")->AsMatrix();
+		if (!m_pMatViewProjVar->IsValid())
 		{
 			std::wcout << L"m_pMatViewProjVar is not valid!\n";
 		}
@@ -29,36 +31,47 @@ namespace dae
 	{
 		//Release resources
 		if (m_pDiffuseMapVar) m_pDiffuseMapVar->Release();
-		if (m_pDiffuseTexture) delete m_pDiffuseTexture;
 	}
 
 	//Diffuse map should be set at effect initialisation
-	void EffectTransparent::SetDiffuseMap(Texture* pDiffuseTexture)
+	void EffectTransparent::SetDiffuseMap(std::shared_ptr<Texture> pDiffuseTexture)
 	{
 		if (m_pDiffuseMapVar && pDiffuseTexture)
 		{
-			m_pDiffuseTexture = pDiffuseTexture;
 			m_pDiffuseMapVar->SetResource(pDiffuseTexture->GetSRV());
+			m_pDiffuseTexture = std::move(pDiffuseTexture);
 		}
 	}
 
-	EffectTransparent* EffectTransparent::CreateEffect(ID3D11Device* pDevice, const std::wstring& fxPath, const string& diffusePath)
+	EffectTransparent* EffectTransparent::CreateEffect(ID3D11Device* pDevice, ResourceManager* pResourceManager, const std::wstring& fxPath, const string& diffusePath)
 	{
 		//Initialize effect
 		EffectTransparent* pEffect{ new EffectTransparent(pDevice, fxPath) };
 
 		//Add texture to the respective variable if valid
-		Texture* pDiffuseTexture{ nullptr };
+		std::shared_ptr<Texture> pDiffuseTexture{};
 
-		if (!diffusePath.empty()) pDiffuseTexture = Texture::LoadFromFile(pDevice, diffusePath);
+		//Transparent black until the map is resident
+		if (!diffusePath.empty())
+		{
+			pDiffuseTexture = pResourceManager->LoadTexture(diffusePath, Vector4{ 0.f, 0.f, 0.f, 0.f });
+		}
 
 		//Add textures to the effect
-		pEffect->SetDiffuseMap(pDiffuseTexture);
+		pEffect->SetDiffuseMap(std::move(pDiffuseTexture));
 		
 		return pEffect;
 	}
 
-	ID3D11InputLayout* EffectTransparent::CreateInputLayout(ID3D11Device* pDevice) const
+	void EffectTransparent::BindTextures()
+	{
+		if (!m_pDiffuseMapVar || !m_pDiffuseTexture) return;
+
+		m_pDiffuseTexture->RequestResolution(UINT32_MAX);
+		m_pDiffuseMapVar->SetResource(m_pDiffuseTexture->GetSRV());
+	}
+
+	ID3D11InputLayout* EffectTransparent::CreateInputLayout(ID3D11Device* pDevice, VertexFormat vertexFormat) const
 	{
 		//Create Vertex Layout
 		static constexpr uint32_t numElements{ 4 };
@@ -83,55 +96,65 @@ namespace dae
 		vertexDesc[2].AlignedByteOffset = 32;
 		vertexDesc[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 
-		//Create Input Layout
-		D3DX11_PASS_DESC passDesc{};
-		GetTechnique()->GetPassByIndex(0)->GetDesc(&passDesc);
-
-		ID3D11InputLayout* pInputLayout{ nullptr };
-
-		HRESULT result = pDevice->CreateInputLayout(
-			vertexDesc,
-			numElements,
-			passDesc.pIAInputSignature,
-			passDesc.IAInputSignatureSize,
-			&pInputLayout
-		);
-
-		if (FAILED(result))
+		//Quantized vertices are decoded in the vertex shader, see VertexQuantization
+		if (vertexFormat == VertexFormat::Quantized)
 		{
-			std::wcout << L"Input Layout creation failed!\n";
-			return nullptr;
+			vertexDesc[0].Format = DXGI_FORMAT_R16G16B16A16_UNORM;
+			vertexDesc[0].AlignedByteOffset = offsetof(QuantizedVertex, position);
+			vertexDesc[3].Format = DXGI_FORMAT_R16G16_FLOAT;
+			vertexDesc[3].AlignedByteOffset = offsetof(QuantizedVertex, uv);
+			vertexDesc[1].Format = DXGI_FORMAT_R16G16_SNORM;
+			vertexDesc[1].AlignedByteOffset = offsetof(QuantizedVertex, normal);
+			vertexDesc[2].Format = DXGI_FORMAT_R16G16_SNORM;
+			vertexDesc[2].AlignedByteOffset = offsetof(QuantizedVertex, tangent);
 		}
 
-		return pInputLayout;
+		//Create Input Layout with the per instance data appended
+		return CreateInstancedInputLayout(pDevice, vertexDesc, numElements);
 	}
 
 	//Pixel Shading stage
-	ColorRGB EffectTransparent::ShadePixel(const VertexOut& out, ShadingMode shadingMode, const uint32_t currentColor, bool renderNormals)
+	Effect::ShadeBatchFunction EffectTransparent::SelectShadeBatch(ShadingMode shadingMode, bool renderNormals) const
 	{
-		//Sample color from diffuse map
-		const Vector4 sampleColor{ m_pDiffuseTexture->SampleTransparency(out.uv) };
-
-		//extract the colors by bitshifting
-		const uint8_t red{ static_cast<uint8_t>(currentColor >> 16) };
-		const uint8_t green{ static_cast<uint8_t>(currentColor >> 8) };
-		const uint8_t blue{ static_cast<uint8_t>(currentColor) };
-
-		//remap color values between [0, 1]
-		const ColorRGB oldColor{ 
-			static_cast<float>(red) * m_ColorModifier, 
-			static_cast<float>(green) * m_ColorModifier,
-			static_cast<float>(blue) * m_ColorModifier 
-		};
-
-		//Extract the color from the sampled Color
-		const ColorRGB newColor{ sampleColor.x, sampleColor.y, sampleColor.z };
-
-		//Calculate the partial coverage
-		return newColor * sampleColor.w + oldColor * (1 - sampleColor.w);
+		return &CallShadeBatch<EffectTransparent, &EffectTransparent::ShadeBatch>;
+	}
+
+	void EffectTransparent::ShadeBatch(FragmentBatch& batch, const ColorRGB& tint)
+	{
+		//Sample color from diffuse map, texture fetches are done one lane at a time
+		alignas(16) float sampleRed[FragmentBatch::Size]{};
+		alignas(16) float sampleGreen[FragmentBatch::Size]{};
+		alignas(16) float sampleBlue[FragmentBatch::Size]{};
+		alignas(16) float sampleAlpha[FragmentBatch::Size]{};
+		for (uint32_t lane{}; lane < FragmentBatch::Size; ++lane)
+		{
+			if (!(batch.mask & (1u << lane))) continue;
+
+			const UVDerivatives uvDerivatives{ Vector2{ batch.ddxU[lane], batch.ddxV[lane] }, Vector2{ batch.ddyU[lane], batch.ddyV[lane] } };
+			const Vector4 sampleColor{ m_pDiffuseTexture->SampleTransparency(Vector2{ batch.u[lane], batch.v[lane] }, uvDerivatives, m_SamplerState) };
+			sampleRed[lane] = sampleColor.x * tint.r;
+			sampleGreen[lane] = sampleColor.y * tint.g;
+			sampleBlue[lane] = sampleColor.z * tint.b;
+			sampleAlpha[lane] = sampleColor.w;
+		}
+
+		//Calculate the partial coverage, a plain loop over the arrays that the compiler vectorizes
+		for (uint32_t lane{}; lane < FragmentBatch::Size; ++lane)
+		{
+			//extract the colors by bitshifting and remap them between [0, 1]
+			const uint32_t currentColor{ batch.currentColor[lane] };
+			const float oldRed{ static_cast<float>((currentColor >> 16) & 0xFF) * m_ColorModifier };
+			const float oldGreen{ static_cast<float>((currentColor >> 8) & 0xFF) * m_ColorModifier };
+			const float oldBlue{ static_cast<float>(currentColor & 0xFF) * m_ColorModifier };
+
+			const float alpha{ sampleAlpha[lane] };
+			batch.red[lane] = sampleRed[lane] * alpha + oldRed * (1.f - alpha);
+			batch.green[lane] = sampleGreen[lane] * alpha + oldGreen * (1.f - alpha);
+			batch.blue[lane] = sampleBlue[lane] * alpha + oldBlue * (1.f - alpha);
+		}
 	}
 	
-	void EffectTransparent::CycleCullMode(ID3D11Device* pDevice)
+	void EffectTransparent::SetCullMode(ID3D11Device* pDevice, CullMode cullMode)
 	{
 		//Cullmode for transparency is not changed
 	}
@@ -4,6 +4,7 @@
 namespace dae
 {
 	class Texture;
+	class ResourceManager;
 	using std::string;
 	class EffectTransparent : public Effect
 	{
@@ -16,22 +17,27 @@ namespace dae
 		EffectTransparent& operator=(const EffectTransparent&) = delete;
 		EffectTransparent& operator=(EffectTransparent&&) noexcept = delete;
 
-		void SetDiffuseMap(Texture* pDiffuseTexture);
+		void SetDiffuseMap(std::shared_ptr<Texture> pDiffuseTexture);
 
-		static EffectTransparent* CreateEffect(ID3D11Device* pDevice, const std::wstring& fxPath, const string& diffusePath);
+		//The diffuse map is streamed, it is loaded when it is first used
+		static EffectTransparent* CreateEffect(ID3D11Device* pDevice, ResourceManager* pResourceManager, const std::wstring& fxPath, const string& diffusePath);
 
-		virtual ID3D11InputLayout* CreateInputLayout(ID3D11Device* pDevice) const override;
-		virtual ColorRGB ShadePixel(const VertexOut& out, ShadingMode shadingMode, const uint32_t currentColor, bool renderNormals) override;
-		virtual void CycleCullMode(ID3D11Device* pDevice) override;
+		virtual ID3D11InputLayout* CreateInputLayout(ID3D11Device* pDevice, VertexFormat vertexFormat) const override;
+		virtual void BindTextures() override;
+		virtual ShadeBatchFunction SelectShadeBatch(ShadingMode shadingMode, bool renderNormals) const override;
+		virtual void SetCullMode(ID3D11Device* pDevice, CullMode cullMode) override;
 		virtual bool UseDepthBuffer() const override;
 		virtual bool UseMultiThreading() const override;
 
 	private:
+		//The shading options do not apply to the transparent effect, it only has this kernel
+		void ShadeBatch(FragmentBatch& batch, const ColorRGB& tint);
+
 		//DirectX
 		ID3DX11EffectShaderResourceVariable* m_pDiffuseMapVar{ nullptr };
 
 		//Textures
-		Texture* m_pDiffuseTexture{ nullptr };
+		std::shared_ptr<Texture> m_pDiffuseTexture{};
 
 		//Color Calculation
 		const float m_ColorModifier{ 1.f / 255.f };
@@ -0,0 +1,261 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//Approximate math for the shading hot paths.
+//Define EXACT_MATH in the project to use the standard library everywhere instead, for reference renders.
+//
+//Error bounds, measured against double precision:
+//	Log2	absolute error below 2e-6 for x in [1e-6, 1], about the rounding of a float of that size
+//	Exp2	relative error below 3e-7 for x in [-30, 30]
+//	Pow		relative error below 1e-5 for x in [1e-6, 1] and y in [0, 64], the range the specular lobe uses
+//	Rsqrt	relative error below 3e-7, one Newton step on top of the hardware estimate
+namespace dae
+{
+	namespace FastMath
+	{
+		//ln(2)^k / k!, Taylor series of 2^x around 0
+		constexpr float Exp2C1{ 0.693147181f };
+		constexpr float Exp2C2{ 0.240226507f };
+		constexpr float Exp2C3{ 0.0555041087f };
+		constexpr float Exp2C4{ 0.00961812911f };
+		constexpr float Exp2C5{ 0.00133335581f };
+		constexpr float Exp2C6{ 0.000154035304f };
+
+		//2 / ln(2), series of log2((1 + t) / (1 - t))
+		constexpr float Log2C{ 2.88539008f };
+
+		inline float Log2(float x)
+		{
+#if defined(EXACT_MATH)
+			return log2f(x);
+#else
+			//Only defined for positive, normal x.
+			//Split in exponent and a mantissa in [sqrt(0.5), sqrt(2)), so the series below converges fast
+			uint32_t bits{};
+			memcpy(&bits, &x, sizeof(float));
+			int exponent{ static_cast<int>((bits >> 23) & 0xFF) - 127 };
+			bits = (bits & 0x007FFFFF) | 0x3F800000;
+			float mantissa{};
+			memcpy(&mantissa, &bits, sizeof(float));
+			if (mantissa > 1.41421356f)
+			{
+				mantissa *= 0.5f;
+				++exponent;
+			}
+
+			const float t{ (mantissa - 1.f) / (mantissa + 1.f) };
+			const float t2{ t * t };
+			const float series{ t * (1.f + t2 * (1.f / 3.f + t2 * (1.f / 5.f + t2 * (1.f / 7.f)))) };
+			return static_cast<float>(exponent) + Log2C * series;
+#endif
+		}
+
+		inline float Exp2(float x)
+		{
+#if defined(EXACT_MATH)
+			return exp2f(x);
+#else
+			//Split in an integer part that goes in the exponent and a fraction in [-0.5, 0.5]
+			x = std::fmin(std::fmax(x, -126.f), 127.f);
+			const float integer{ std::nearbyint(x) };
+			const float f{ x - integer };
+
+			const float fraction{ 1.f + f * (Exp2C1 + f * (Exp2C2 + f * (Exp2C3 + f * (Exp2C4 + f * (Exp2C5 + f * Exp2C6))))) };
+			const uint32_t bits{ static_cast<uint32_t>(static_cast<int>(integer) + 127) << 23 };
+			float scale{};
+			memcpy(&scale, &bits, sizeof(float));
+			return fraction * scale;
+#endif
+		}
+
+		//x ^ y for x >= 0. Returns 0 for x == 0, the specular lobe never uses y <= 0
+		inline float Pow(float x, float y)
+		{
+#if defined(EXACT_MATH)
+			return powf(x, y);
+#else
+			if (x <= 0.f) return 0.f;
+			return Exp2(y * Log2(x));
+#endif
+		}
+
+		inline float Rsqrt(float x)
+		{
+#if defined(EXACT_MATH)
+			return 1.f / sqrtf(x);
+#else
+			const float estimate{ _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x))) };
+			return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#endif
+		}
+
+		/* --- 4 WIDE --- */
+		inline __m128 Log2(__m128 x)
+		{
+#if defined(EXACT_MATH)
+			alignas(16) float values[4];
+			_mm_store_ps(values, x);
+			for (float& value : values) value = log2f(value);
+			return _mm_load_ps(values);
+#else
+			const __m128i bits{ _mm_castps_si128(x) };
+			__m128i exponent{ _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0xFF)), _mm_set1_epi32(127)) };
+			__m128 mantissa{ _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000))) };
+
+			//Branchless version of the range reduction above
+			const __m128 isLarge{ _mm_cmpgt_ps(mantissa, _mm_set1_ps(1.41421356f)) };
+			mantissa = _mm_or_ps(_mm_and_ps(isLarge, _mm_mul_ps(mantissa, _mm_set1_ps(0.5f))), _mm_andnot_ps(isLarge, mantissa));
+			exponent = _mm_sub_epi32(exponent, _mm_castps_si128(isLarge));
+
+			const __m128 one{ _mm_set1_ps(1.f) };
+			const __m128 t{ _mm_div_ps(_mm_sub_ps(mantissa, one), _mm_add_ps(mantissa, one)) };
+			const __m128 t2{ _mm_mul_ps(t, t) };
+			__m128 series{ _mm_add_ps(_mm_set1_ps(1.f / 5.f), _mm_mul_ps(t2, _mm_set1_ps(1.f / 7.f))) };
+			series = _mm_add_ps(_mm_set1_ps(1.f / 3.f), _mm_mul_ps(t2, series));
+			series = _mm_add_ps(one, _mm_mul_ps(t2, series));
+			series = _mm_mul_ps(t, series);
+
+			return _mm_add_ps(_mm_cvtepi32_ps(exponent), _mm_mul_ps(_mm_set1_ps(Log2C), series));
+#endif
+		}
+
+		inline __m128 Exp2(__m128 x)
+		{
+#if defined(EXACT_MATH)
+			alignas(16) float values[4];
+			_mm_store_ps(values, x);
+			for (float& value : values) value = exp2f(value);
+			return _mm_load_ps(values);
+#else
+			x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.f)), _mm_set1_ps(127.f));
+			const __m128i integer{ _mm_cvtps_epi32(x) };
+			const __m128 f{ _mm_sub_ps(x, _mm_cvtepi32_ps(integer)) };
+
+			__m128 fraction{ _mm_add_ps(_mm_set1_ps(Exp2C5), _mm_mul_ps(f, _mm_set1_ps(Exp2C6))) };
+			fraction = _mm_add_ps(_mm_set1_ps(Exp2C4), _mm_mul_ps(f, fraction));
+			fraction = _mm_add_ps(_mm_set1_ps(Exp2C3), _mm_mul_ps(f, fraction));
+			fraction = _mm_add_ps(_mm_set1_ps(Exp2C2), _mm_mul_ps(f, fraction));
+			fraction = _mm_add_ps(_mm_set1_ps(Exp2C1), _mm_mul_ps(f, fraction));
+			fraction = _mm_add_ps(_mm_set1_ps(1.f), _mm_mul_ps(f, fraction));
+
+			const __m128 scale{ _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(integer, _mm_set1_epi32(127)), 23)) };
+			return _mm_mul_ps(fraction, scale);
+#endif
+		}
+
+		inline __m128 Pow(__m128 x, __m128 y)
+		{
+			const __m128 isPositive{ _mm_cmpgt_ps(x, _mm_setzero_ps()) };
+#if defined(EXACT_MATH)
+			alignas(16) float xs[4];
+			alignas(16) float ys[4];
+			_mm_store_ps(xs, x);
+			_mm_store_ps(ys, y);
+			for (int idx{}; idx < 4; ++idx) xs[idx] = powf(xs[idx], ys[idx]);
+			return _mm_and_ps(isPositive, _mm_load_ps(xs));
+#else
+			//Lanes with x <= 0 are masked to 0 after the fact, their intermediate results are garbage
+			return _mm_and_ps(isPositive, Exp2(_mm_mul_ps(y, Log2(x))));
+#endif
+		}
+
+		inline __m128 Rsqrt(__m128 x)
+		{
+#if defined(EXACT_MATH)
+			return _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(x));
+#else
+			const __m128 estimate{ _mm_rsqrt_ps(x) };
+			const __m128 halfXEstimate2{ _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(estimate, estimate)) };
+			return _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), halfXEstimate2));
+#endif
+		}
+
+		/* --- 8 WIDE --- */
+#if defined(__AVX2__)
+		//Only available when the project is built with /arch:AVX2, same math as the 4 wide versions
+		inline __m256 Log2(__m256 x)
+		{
+#if defined(EXACT_MATH)
+			alignas(32) float values[8];
+			_mm256_store_ps(values, x);
+			for (float& value : values) value = log2f(value);
+			return _mm256_load_ps(values);
+#else
+			const __m256i bits{ _mm256_castps_si256(x) };
+			__m256i exponent{ _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xFF)), _mm256_set1_epi32(127)) };
+			__m256 mantissa{ _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000))) };
+
+			const __m256 isLarge{ _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ) };
+			mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), isLarge);
+			exponent = _mm256_sub_epi32(exponent, _mm256_castps_si256(isLarge));
+
+			const __m256 one{ _mm256_set1_ps(1.f) };
+			const __m256 t{ _mm256_div_ps(_mm256_sub_ps(mantissa, one), _mm256_add_ps(mantissa, one)) };
+			const __m256 t2{ _mm256_mul_ps(t, t) };
+			__m256 series{ _mm256_add_ps(_mm256_set1_ps(1.f / 5.f), _mm256_mul_ps(t2, _mm256_set1_ps(1.f / 7.f))) };
+			series = _mm256_add_ps(_mm256_set1_ps(1.f / 3.f), _mm256_mul_ps(t2, series));
+			series = _mm256_add_ps(one, _mm256_mul_ps(t2, series));
+			series = _mm256_mul_ps(t, series);
+
+			return _mm256_add_ps(_mm256_cvtepi32_ps(exponent), _mm256_mul_ps(_mm256_set1_ps(Log2C), series));
+#endif
+		}
+
+		inline __m256 Exp2(__m256 x)
+		{
+#if defined(EXACT_MATH)
+			alignas(32) float values[8];
+			_mm256_store_ps(values, x);
+			for (float& value : values) value = exp2f(value);
+			return _mm256_load_ps(values);
+#else
+			x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.f)), _mm256_set1_ps(127.f));
+			const __m256i integer{ _mm256_cvtps_epi32(x) };
+			const __m256 f{ _mm256_sub_ps(x, _mm256_cvtepi32_ps(integer)) };
+
+			__m256 fraction{ _mm256_add_ps(_mm256_set1_ps(Exp2C5), _mm256_mul_ps(f, _mm256_set1_ps(Exp2C6))) };
+			fraction = _mm256_add_ps(_mm256_set1_ps(Exp2C4), _mm256_mul_ps(f, fraction));
+			fraction = _mm256_add_ps(_mm256_set1_ps(Exp2C3), _mm256_mul_ps(f, fraction));
+			fraction = _mm256_add_ps(_mm256_set1_ps(Exp2C2), _mm256_mul_ps(f, fraction));
+			fraction = _mm256_add_ps(_mm256_set1_ps(Exp2C1), _mm256_mul_ps(f, fraction));
+			fraction = _mm256_add_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(f, fraction));
+
+			const __m256 scale{ _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(integer, _mm256_set1_epi32(127)), 23)) };
+			return _mm256_mul_ps(fraction, scale);
+#endif
+		}
+
+		inline __m256 Pow(__m256 x, __m256 y)
+		{
+			const __m256 isPositive{ _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ) };
+#if defined(EXACT_MATH)
+			alignas(32) float xs[8];
+			alignas(32) float ys[8];
+			_mm256_store_ps(xs, x);
+			_mm256_store_ps(ys, y);
+			for (int idx{}; idx < 8; ++idx) xs[idx] = powf(xs[idx], ys[idx]);
+			return _mm256_and_ps(isPositive, _mm256_load_ps(xs));
+#else
+			return _mm256_and_ps(isPositive, Exp2(_mm256_mul_ps(y, Log2(x))));
+#endif
+		}
+
+		inline __m256 Rsqrt(__m256 x)
+		{
+#if defined(EXACT_MATH)
+			return _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(x));
+#else
+			const __m256 estimate{ _mm256_rsqrt_ps(x) };
+			const __m256 halfXEstimate2{ _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), x), _mm256_mul_ps(estimate, estimate)) };
+			return _mm256_mul_ps(estimate, _mm256_sub_ps(_mm256_set1_ps(1.5f), halfXEstimate2));
+#endif
+		}
+#endif
+	}
+}
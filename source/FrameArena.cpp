@@ -0,0 +1,153 @@
+#include "pch.h"
+#include "FrameArena.h"
+
+#include <cassert>
+#include <Windows.h>
+
+namespace dae
+{
+	namespace
+	{
+		size_t AlignUp(size_t size, size_t alignment)
+		{
+			return (size + alignment - 1) & ~(alignment - 1);
+		}
+	}
+
+	FrameArena::FrameArena(size_t capacity, bool useLargePages)
+	{
+		AllocateBuffer(capacity, useLargePages);
+		m_HeapAllocations.reserve(64);
+	}
+
+	FrameArena::~FrameArena()
+	{
+		Reset();
+		FreeBuffer();
+	}
+
+	void* FrameArena::Allocate(size_t size)
+	{
+		//Round every allocation up to a full cache line, this keeps the next allocation aligned as well
+		const size_t alignedSize{ AlignUp(std::max(size, size_t{ 1 }), CacheLineSize) };
+		const size_t offset{ m_Offset.fetch_add(alignedSize, std::memory_order_relaxed) };
+
+		if (offset + alignedSize <= m_Capacity)
+		{
+			return m_pBuffer + offset;
+		}
+
+		//The arena is full, fall back to the heap for the rest of the frame
+		return AllocateFromHeap(alignedSize);
+	}
+
+	void FrameArena::Reset()
+	{
+		const size_t usedSize{ m_Offset.load(std::memory_order_relaxed) };
+		m_PeakSize = std::max(m_PeakSize, usedSize);
+		m_Offset.store(0, std::memory_order_relaxed);
+
+		if (m_HeapAllocations.empty()) return;
+
+		//The render loop should never have to touch the heap, the arena capacity is too small
+		assert(m_HeapAllocations.empty() && "FrameArena overflowed, increase its capacity");
+
+		for (void* pAllocation : m_HeapAllocations)
+		{
+			::operator delete(pAllocation, std::align_val_t{ CacheLineSize });
+		}
+		m_HeapAllocations.clear();
+
+		//Grow to the peak usage so the next frame fits again
+		const bool useLargePages{ m_UsesLargePages };
+		FreeBuffer();
+		AllocateBuffer(m_PeakSize + m_PeakSize / 2, useLargePages);
+	}
+
+	size_t FrameArena::GetMarker() const
+	{
+		return m_Offset.load(std::memory_order_relaxed);
+	}
+
+	void FrameArena::Rewind(size_t marker)
+	{
+		//Heap allocations made after the marker stay alive until Reset
+		const size_t usedSize{ m_Offset.load(std::memory_order_relaxed) };
+		m_PeakSize = std::max(m_PeakSize, usedSize);
+		m_Offset.store(std::min(marker, usedSize), std::memory_order_relaxed);
+	}
+
+	size_t FrameArena::GetCapacity() const
+	{
+		return m_Capacity;
+	}
+
+	size_t FrameArena::GetUsedSize() const
+	{
+		return std::min(m_Offset.load(std::memory_order_relaxed), m_Capacity);
+	}
+
+	bool FrameArena::UsesLargePages() const
+	{
+		return m_UsesLargePages;
+	}
+
+	uint32_t FrameArena::GetFrameHeapAllocations() const
+	{
+		return static_cast<uint32_t>(m_HeapAllocations.size());
+	}
+
+	uint32_t FrameArena::GetTotalHeapAllocations() const
+	{
+		return m_TotalHeapAllocations;
+	}
+
+	void FrameArena::AllocateBuffer(size_t capacity, bool useLargePages)
+	{
+		//Large pages need the SeLockMemoryPrivilege, when they are unavailable regular pages are used
+		if (useLargePages)
+		{
+			const size_t largePageSize{ GetLargePageMinimum() };
+			if (largePageSize > 0)
+			{
+				const size_t largeCapacity{ AlignUp(capacity, largePageSize) };
+				m_pBuffer = static_cast<uint8_t*>(VirtualAlloc(nullptr, largeCapacity,
+					MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+
+				if (m_pBuffer)
+				{
+					m_Capacity = largeCapacity;
+					m_UsesLargePages = true;
+					return;
+				}
+			}
+		}
+
+		//VirtualAlloc returns page aligned memory, which is always cache line aligned
+		m_pBuffer = static_cast<uint8_t*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+		m_Capacity = m_pBuffer ? capacity : 0;
+		m_UsesLargePages = false;
+
+		if (!m_pBuffer)
+		{
+			std::wcout << L"FrameArena buffer allocation failed!\n";
+		}
+	}
+
+	void FrameArena::FreeBuffer()
+	{
+		if (m_pBuffer) VirtualFree(m_pBuffer, 0, MEM_RELEASE);
+		m_pBuffer = nullptr;
+		m_Capacity = 0;
+	}
+
+	void* FrameArena::AllocateFromHeap(size_t size)
+	{
+		void* pAllocation{ ::operator new(size, std::align_val_t{ CacheLineSize }) };
+
+		const std::lock_guard<std::mutex> lock{ m_HeapMutex };
+		m_HeapAllocations.push_back(pAllocation);
+		++m_TotalHeapAllocations;
+		return pAllocation;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <span>
+
+namespace dae
+{
+	//Linear allocator for data that only lives for a single frame.
+	//Allocations bump an atomic offset, so worker threads can allocate at the same time.
+	//Reset() releases everything in O(1) at the end of the frame.
+	class FrameArena final
+	{
+	public:
+		FrameArena(size_t capacity, bool useLargePages = false);
+		~FrameArena();
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena(FrameArena&&) noexcept = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+		FrameArena& operator=(FrameArena&&) noexcept = delete;
+
+		void* Allocate(size_t size);
+		void Reset();
+
+		//Releases everything allocated after the marker was taken, so a frame can reuse memory between batches.
+		//Must not be called while other threads are allocating
+		size_t GetMarker() const;
+		void Rewind(size_t marker);
+
+		template<typename T>
+		std::span<T> Allocate(size_t count)
+		{
+			//Memory is handed out uninitialized, only use this for types without invariants
+			static_assert(std::is_trivially_destructible_v<T>, "Frame arena memory is never destructed");
+			return std::span<T>{ static_cast<T*>(Allocate(sizeof(T) * count)), count };
+		}
+
+		size_t GetCapacity() const;
+		size_t GetUsedSize() const;
+		bool UsesLargePages() const;
+		uint32_t GetFrameHeapAllocations() const;
+		uint32_t GetTotalHeapAllocations() const;
+
+		//Every allocation starts on its own cache line so threads never share one
+		static constexpr size_t CacheLineSize{ 64 };
+
+	private:
+		void AllocateBuffer(size_t capacity, bool useLargePages);
+		void FreeBuffer();
+		void* AllocateFromHeap(size_t size);
+
+		uint8_t* m_pBuffer{ nullptr };
+		size_t m_Capacity{};
+		bool m_UsesLargePages{ false };
+		std::atomic<size_t> m_Offset{};
+
+		//Allocations that did not fit anymore. These go to the heap and
+		//are counted so a debug build can assert the render loop never does this.
+		std::mutex m_HeapMutex{};
+		std::vector<void*> m_HeapAllocations{};
+		size_t m_PeakSize{};
+		uint32_t m_TotalHeapAllocations{};
+	};
+}
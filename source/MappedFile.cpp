@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+namespace dae
+{
+	MappedFile::MappedFile(const std::string& path)
+	{
+		//Read front to back, the hint lets the system read ahead
+		m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_File == INVALID_HANDLE_VALUE) return;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(m_File, &fileSize))
+		{
+			std::wcout << L"File size query failed!\n";
+			return;
+		}
+
+		//A mapping of zero bytes cannot be created
+		if (fileSize.QuadPart == 0)
+		{
+			m_IsValid = true;
+			return;
+		}
+
+		m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_Mapping)
+		{
+			std::wcout << L"File mapping creation failed!\n";
+			return;
+		}
+
+		m_pData = static_cast<const char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_pData)
+		{
+			std::wcout << L"File view mapping failed!\n";
+			return;
+		}
+
+		m_Size = static_cast<size_t>(fileSize.QuadPart);
+		m_IsValid = true;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		//Release resources
+		if (m_pData) UnmapViewOfFile(m_pData);
+		if (m_Mapping) CloseHandle(m_Mapping);
+		if (m_File != INVALID_HANDLE_VALUE) CloseHandle(m_File);
+	}
+
+	bool MappedFile::IsValid() const
+	{
+		return m_IsValid;
+	}
+
+	const char* MappedFile::GetData() const
+	{
+		return m_pData;
+	}
+
+	size_t MappedFile::GetSize() const
+	{
+		return m_Size;
+	}
+
+	std::string_view MappedFile::GetView() const
+	{
+		return std::string_view{ m_pData, m_Size };
+	}
+}
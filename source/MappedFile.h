@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <Windows.h>
+
+namespace dae
+{
+	//Read only view of a whole file, mapped into memory instead of copied.
+	//Pages are read from disk when they are first touched, so scanning the view streams the file
+	class MappedFile final
+	{
+	public:
+		explicit MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		//False when the file could not be opened, empty files are valid but have no view
+		bool IsValid() const;
+		const char* GetData() const;
+		size_t GetSize() const;
+		std::string_view GetView() const;
+
+	private:
+		HANDLE m_File{ INVALID_HANDLE_VALUE };
+		HANDLE m_Mapping{ nullptr };
+		const char* m_pData{ nullptr };
+		size_t m_Size{};
+		bool m_IsValid{ false };
+	};
+}
@@ -4,4 +4,6 @@
 #include "Vector3.h"
 #include "Vector4.h"
 #include "Matrix.h"
-#include "MathHelpers.h"
\ No newline at end of file
+#include "MathHelpers.h"
+#include "FastMath.h"
+#include "SimdVector3.h"
\ No newline at end of file
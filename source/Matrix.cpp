@@ -146,7 +146,22 @@ namespace dae {
 
 	Matrix Matrix::CreateLookAtLH(const Vector3& origin, const Vector3& forward, const Vector3& up)
 	{
-		return {};
+		//ONB of the viewer, the view matrix is its inverse
+		const Vector3 zAxis{ forward.Normalized() };
+		const Vector3 xAxis{ Vector3::Cross(up, zAxis).Normalized() };
+		const Vector3 yAxis{ Vector3::Cross(zAxis, xAxis) };
+
+		return Inverse(Matrix{ xAxis, yAxis, zAxis, origin });
+	}
+
+	Matrix Matrix::CreateOrthographicLH(float width, float height, float zn, float zf)
+	{
+		return {
+			Vector4{2.f / width, 0.f, 0.f, 0.f},
+			Vector4{0.f, 2.f / height, 0.f, 0.f},
+			Vector4{0.f, 0.f, 1.f / (zf - zn), 0.f},
+			Vector4{0.f, 0.f, -zn / (zf - zn), 1.f}
+		};
 	}
 
 	Matrix Matrix::CreatePerspectiveFovLH(float fov, float aspect, float zn, float zf)
@@ -2,181 +2,281 @@
 #include "Mesh.h"
 #include "Effect.h"
 #include "Texture.h"
+#include "Utils.h"
 
 namespace dae
 {
-	Mesh::Mesh(ID3D11Device* pDevice, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, Effect* pEffect,
+	Mesh::Mesh(ID3D11Device* pDevice, std::shared_ptr<const MeshGeometry> pGeometry, std::vector<Effect*> pEffects,
 		const Vector3& rotation, const Vector3& translation)
-		: m_pEffect{pEffect}
+		: m_pEffects{ std::move(pEffects) }
+		, m_pGeometry{ std::move(pGeometry) }
 	{
 		m_RotationMatrix = Matrix::CreateRotation(rotation);
 		m_TranslationMatrix = Matrix::CreateTranslation(translation);
 
-		m_pInputLayout = m_pEffect->CreateInputLayout(pDevice);
-
-		//Create Vertex Buffer
-		D3D11_BUFFER_DESC bd{};
-		bd.Usage = D3D11_USAGE_IMMUTABLE;
-		bd.ByteWidth = sizeof(Vertex) * static_cast<uint32_t>(vertices.size());
-		bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-		bd.CPUAccessFlags = 0;
-		bd.MiscFlags = 0;
-
-		D3D11_SUBRESOURCE_DATA initData{};
-		initData.pSysMem = vertices.data();
-
-		HRESULT result = pDevice->CreateBuffer(&bd, &initData, &m_pVertexBuffer);
-		if (FAILED(result))
+		for (Effect* pEffect : m_pEffects)
 		{
-			std::wcout << L"Vertex Buffer creation failed!\n";
-			return;
+			m_pInputLayouts.push_back(pEffect->CreateInputLayout(pDevice, m_pGeometry->GetVertexFormat()));
+			pEffect->SetVertexFormat(m_pGeometry->GetVertexFormat(), m_pGeometry->GetPositionDecoding());
 		}
 
-		//Create Index Buffer
-		m_NumIndices = static_cast<uint32_t>(indices.size());
-		bd.Usage = D3D11_USAGE_IMMUTABLE;
-		bd.ByteWidth = sizeof(uint32_t) * m_NumIndices;
-		bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		bd.CPUAccessFlags = 0;
-		bd.MiscFlags = 0;
-		initData.pSysMem = indices.data();
-		
-		result = pDevice->CreateBuffer(&bd, &initData, &m_pIndexBuffer);
-		if (FAILED(result))
-		{
-			std::wcout << L"Index Buffer creation failed!\n";
-			return;
-		}
-
-		//Transfer the indices and the vertices to appropriate variables
-		m_Indices = indices;
-		for (const Vertex& vertex : vertices)
-		{
-			VertexExt out{};
-			out.position = vertex.position;
-			out.uv = vertex.uv;
-			out.normal = vertex.normal;
-			out.tangent = vertex.tangent;
-
-			m_Vertices.emplace_back(out);
-		}
+		m_WorldMatrix = m_RotationMatrix * m_TranslationMatrix;
+		UpdateInstances();
+		CreateInstanceBuffer(pDevice);
 	}
 
 
 	Mesh::~Mesh()
 	{
 		//Release resources
-		if (m_pEffect) delete m_pEffect;
-		if (m_pIndexBuffer) m_pIndexBuffer->Release();		
-		if (m_pVertexBuffer) m_pVertexBuffer->Release();		
-		if (m_pInputLayout) m_pInputLayout->Release();		
+		for (Effect* pEffect : m_pEffects) delete pEffect;
+		if (m_pInstanceBuffer) m_pInstanceBuffer->Release();		
+		for (ID3D11InputLayout* pInputLayout : m_pInputLayouts)
+		{
+			if (pInputLayout) pInputLayout->Release();
+		}
 	}
 
 
 	void Mesh::RotateY(float angle)
 	{
 		m_RotationMatrix = Matrix::CreateRotationY(angle) * m_RotationMatrix;
+		m_IsTransformDirty = true;
 	}
 
 
-	void Mesh::Render(ID3D11DeviceContext* pDeviceContext) const
+	void Mesh::UploadVisibleInstances(ID3D11DeviceContext* pDeviceContext, const Frustum& frustum)
 	{
+		m_NumVisibleInstances = 0;
+		if (!m_pInstanceBuffer) return;
+
+		D3D11_MAPPED_SUBRESOURCE mappedResource{};
+		HRESULT result{ pDeviceContext->Map(m_pInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource) };
+		if (FAILED(result))
+		{
+			std::wcout << L"Instance Buffer mapping failed!\n";
+			return;
+		}
+
+		InstanceData* pInstanceData{ static_cast<InstanceData*>(mappedResource.pData) };
+		for (uint32_t instanceIdx{}; instanceIdx < m_Instances.size(); ++instanceIdx)
+		{
+			if (!GeometryUtils::IsBoxInFrustum(frustum, m_InstanceBounds[instanceIdx])) continue;
+			pInstanceData[m_NumVisibleInstances++] = InstanceData{ m_InstanceWorldMatrices[instanceIdx], m_Instances[instanceIdx].tint };
+		}
+		pDeviceContext->Unmap(m_pInstanceBuffer, 0);
+	}
+
+	void Mesh::Render(ID3D11DeviceContext* pDeviceContext, RenderPass pass) const
+	{
+		if (m_NumVisibleInstances == 0) return;
+
 		//1. Set Primitive Topology
-		pDeviceContext->IASetPrimitiveTopology(static_cast<D3D11_PRIMITIVE_TOPOLOGY>(m_Topology));
+		pDeviceContext->IASetPrimitiveTopology(static_cast<D3D11_PRIMITIVE_TOPOLOGY>(m_pGeometry->GetPrimitiveTopology()));
 		
-		//2. Set Input Layout
-		pDeviceContext->IASetInputLayout(m_pInputLayout);
+		//2. Set Vertex Buffer, the second slot holds the instance data
+		ID3D11Buffer* const pVertexBuffers[]{ m_pGeometry->GetVertexBuffer(), m_pInstanceBuffer };
+		const UINT strides[]{ m_pGeometry->GetVertexStride(), sizeof(InstanceData) };
+		constexpr UINT offsets[]{ 0, 0 };
+		pDeviceContext->IASetVertexBuffers(0, 2, pVertexBuffers, strides, offsets);
+
+		//3. Set IndexBuffer
+		pDeviceContext->IASetIndexBuffer(m_pGeometry->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
 
-		//3. Set Vertex Buffer
-		constexpr UINT stride = sizeof(Vertex);
-		constexpr UINT offset = 0;
-		pDeviceContext->IASetVertexBuffers(0, 1, &m_pVertexBuffer, &stride, &offset);
+		//4. Draw every submesh of the pass with the effect of its material, the buffers are shared
+		const std::span<const Submesh> submeshes{ m_pGeometry->GetSubmeshes() };
+		for (uint32_t submeshIdx{}; submeshIdx < submeshes.size(); ++submeshIdx)
+		{
+			if (!IsSubmeshInPass(submeshIdx, pass)) continue;
 
-		//4. Set IndexBuffer
-		pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			const Submesh& submesh{ submeshes[submeshIdx] };
+			const size_t effectIdx{ submesh.materialIdx < m_pEffects.size() ? submesh.materialIdx : 0 };
+			Effect* pEffect{ m_pEffects[effectIdx] };
 
-		//5. Draw
-		D3DX11_TECHNIQUE_DESC techDesc{};
-		m_pEffect->GetTechnique()->GetDesc(&techDesc);
+			pDeviceContext->IASetInputLayout(m_pInputLayouts[effectIdx]);
+			pEffect->BindTextures();
+			D3DX11_TECHNIQUE_DESC techDesc{};
+			pEffect->GetTechnique()->GetDesc(&techDesc);
 
-		for (UINT p{ 0 }; p < techDesc.Passes; ++p)
-		{
-			m_pEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, pDeviceContext);
-			pDeviceContext->DrawIndexed(m_NumIndices, 0, 0);
+			for (UINT p{ 0 }; p < techDesc.Passes; ++p)
+			{
+				pEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, pDeviceContext);
+				pDeviceContext->DrawIndexedInstanced(submesh.indexCount, m_NumVisibleInstances, submesh.indexOffset, 0, 0);
+			}
 		}
 	}
 
 	void Mesh::SetMatrices(const Matrix& viewProjMatrix, const Matrix& inverseViewMatrix)
 	{
 		//Set the different matrices
-		m_WorldMatrix = m_RotationMatrix * m_TranslationMatrix;
-		const Matrix worldMatrix{ m_WorldMatrix };
-		m_pEffect->SetViewProjectionMatrix(worldMatrix * viewProjMatrix);
-		m_pEffect->SetWorldMatrix(worldMatrix);
-		m_pEffect->SetViewInverseMatrix(inverseViewMatrix);
+		if (m_IsTransformDirty)
+		{
+			m_WorldMatrix = m_RotationMatrix * m_TranslationMatrix;
+			UpdateInstances();
+			m_IsTransformDirty = false;
+		}
+		for (Effect* pEffect : m_pEffects)
+		{
+			pEffect->SetViewProjectionMatrix(viewProjMatrix);
+			pEffect->SetViewInverseMatrix(inverseViewMatrix);
+		}
+	}
+
+	void Mesh::SetLights(const std::vector<Light>& lights)
+	{
+		for (Effect* pEffect : m_pEffects)
+		{
+			pEffect->SetLights(lights);
+		}
+	}
+
+	void Mesh::SetInstances(ID3D11Device* pDevice, const std::vector<MeshInstance>& instances)
+	{
+		m_Instances = instances;
+		UpdateInstances();
+
+		//The instance buffer only grows
+		if (m_Instances.size() <= m_InstanceCapacity) return;
+
+		if (m_pInstanceBuffer) m_pInstanceBuffer->Release();
+		m_pInstanceBuffer = nullptr;
+		CreateInstanceBuffer(pDevice);
+	}
+	VertexFormat Mesh::GetVertexFormat() const
+	{
+		return m_pGeometry->GetVertexFormat();
 	}
-	const std::vector<VertexExt>& Mesh::GetVertices() const
+	std::span<const Vertex> Mesh::GetVertices() const
 	{
-		return m_Vertices;
+		return m_pGeometry->GetVertices();
 	}
-	std::vector<VertexOut>& Mesh::GetVerticesOut()
+	std::span<const QuantizedVertex> Mesh::GetQuantizedVertices() const
 	{
-		return m_VerticesOut;
+		return m_pGeometry->GetQuantizedVertices();
 	}
-	const std::vector<uint32_t>& Mesh::GetIndices() const
+	const Matrix& Mesh::GetPositionDecodeMatrix() const
 	{
-		return m_Indices;
+		return m_pGeometry->GetPositionDecodeMatrix();
+	}
+	std::span<const uint32_t> Mesh::GetIndices() const
+	{
+		return m_pGeometry->GetIndices();
+	}
+	std::span<const Submesh> Mesh::GetSubmeshes() const
+	{
+		return m_pGeometry->GetSubmeshes();
+	}
+	Effect* Mesh::GetSubmeshEffect(uint32_t submeshIdx) const
+	{
+		const uint32_t materialIdx{ m_pGeometry->GetSubmeshes()[submeshIdx].materialIdx };
+		return materialIdx < m_pEffects.size() ? m_pEffects[materialIdx] : m_pEffects.front();
+	}
+	bool Mesh::IsSubmeshInPass(uint32_t submeshIdx, RenderPass pass) const
+	{
+		return GetSubmeshEffect(submeshIdx)->UseDepthBuffer() != (pass == RenderPass::Transparent);
+	}
+	const std::vector<MeshLod>& Mesh::GetLods() const
+	{
+		return m_pGeometry->GetLods();
 	}
 	const Matrix& Mesh::GetWorldMatrix() const
 	{
 		return m_WorldMatrix;
 	}
-	PrimitiveTopology Mesh::GetPrimitiveTopology() const
+	const BoundingBox& Mesh::GetWorldBounds() const
 	{
-		return m_Topology;
+		return m_WorldBounds;
 	}
-	void Mesh::ToggleRender()
+	bool Mesh::AreWorldBoundsDirty() const
 	{
-		m_ShouldRender = !m_ShouldRender;
-		std::wcout << "\033[33m" << "**(Shared) FireFX " << (m_ShouldRender ? "ON" : "OFF") << "\033[0m" << "\n";
+		return m_AreWorldBoundsDirty;
 	}
-	void Mesh::CycleCullMode(ID3D11Device* pDevice)
+	void Mesh::ClearWorldBoundsDirty()
 	{
-		m_pEffect->CycleCullMode(pDevice);
+		m_AreWorldBoundsDirty = false;
 	}
-
-	void Mesh::CycleSamplerState(ID3D11Device* pDevice)
+	const std::vector<MeshInstance>& Mesh::GetInstances() const
 	{
-		m_pEffect->CycleSamplerState(pDevice);
+		return m_Instances;
 	}
-
-	bool Mesh::ShouldRender() const
+	const std::vector<Matrix>& Mesh::GetInstanceWorldMatrices() const
 	{
-		return m_ShouldRender;
+		return m_InstanceWorldMatrices;
 	}
-	CullMode Mesh::GetCullMode() const
+	const std::vector<BoundingBox>& Mesh::GetInstanceBounds() const
 	{
-		return m_pEffect->GetCullMode();
+		return m_InstanceBounds;
 	}
-	SamplerState Mesh::GetSamplerState() const
+	PrimitiveTopology Mesh::GetPrimitiveTopology() const
 	{
-		return m_pEffect->GetSamplerState();
+		return m_pGeometry->GetPrimitiveTopology();
 	}
-	ColorRGB Mesh::ShadePixel(const VertexOut& out, ShadingMode shadingMode, const uint32_t currentColor, bool renderNormals)
+	void Mesh::SetCullMode(ID3D11Device* pDevice, CullMode cullMode)
 	{
-		//Transfer the necessary values to the effect
-		return m_pEffect->ShadePixel(out, shadingMode, currentColor, renderNormals);
+		for (Effect* pEffect : m_pEffects)
+		{
+			pEffect->SetCullMode(pDevice, cullMode);
+		}
+	}
+
+	void Mesh::SetSamplerState(ID3D11Device* pDevice, SamplerState samplerState)
+	{
+		for (Effect* pEffect : m_pEffects)
+		{
+			pEffect->SetSamplerState(pDevice, samplerState);
+		}
+	}
+
+	void Mesh::SetShouldRender(bool shouldRender)
+	{
+		m_ShouldRender = shouldRender;
+	}
+
+	bool Mesh::ShouldRender() const
+	{
+		return m_ShouldRender;
 	}
 
 	bool Mesh::UseDepthBuffer() const
 	{
-		return m_pEffect->UseDepthBuffer();
+		return std::any_of(m_pEffects.begin(), m_pEffects.end(), [](const Effect* pEffect)
+		{
+			return pEffect->UseDepthBuffer();
+		});
 	}
 
-	bool Mesh::UseMultiThreading() const
+	void Mesh::CreateInstanceBuffer(ID3D11Device* pDevice)
 	{
-		return m_pEffect->UseMultiThreading();
+		//Rewritten every frame with the visible instances
+		m_InstanceCapacity = static_cast<uint32_t>(std::max(m_Instances.size(), size_t{ 1 }));
+
+		D3D11_BUFFER_DESC bd{};
+		bd.Usage = D3D11_USAGE_DYNAMIC;
+		bd.ByteWidth = sizeof(InstanceData) * m_InstanceCapacity;
+		bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bd.MiscFlags = 0;
+
+		HRESULT result = pDevice->CreateBuffer(&bd, nullptr, &m_pInstanceBuffer);
+		if (FAILED(result))
+		{
+			std::wcout << L"Instance Buffer creation failed!\n";
+			m_InstanceCapacity = 0;
+		}
 	}
 
-	
-}
\ No newline at end of file
+	void Mesh::UpdateInstances()
+	{
+		m_InstanceWorldMatrices.resize(m_Instances.size());
+		m_InstanceBounds.resize(m_Instances.size());
+		m_WorldBounds = BoundingBox{};
+
+		for (uint32_t instanceIdx{}; instanceIdx < m_Instances.size(); ++instanceIdx)
+		{
+			m_InstanceWorldMatrices[instanceIdx] = m_RotationMatrix * m_Instances[instanceIdx].transform * m_TranslationMatrix;
+			m_InstanceBounds[instanceIdx] = GeometryUtils::TransformBoundingBox(m_pGeometry->GetLocalBounds(), m_InstanceWorldMatrices[instanceIdx]);
+			m_WorldBounds.Grow(m_InstanceBounds[instanceIdx]);
+		}
+		m_AreWorldBoundsDirty = true;
+	}
+}
@@ -1,14 +1,19 @@
 #pragma once
 #include "DataTypes.h"
+#include "MeshGeometry.h"
+#include <memory>
 #include <vector>
 namespace dae
 {
 	
 	class Effect;
+
 	class Mesh final
 	{
 	public:
-		Mesh(ID3D11Device* pDevice, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, Effect* pEffect,
+		//The geometry can be shared with other meshes. There is one effect per material of the geometry, at least one,
+		//the effects are owned by the mesh. Submeshes with a material that has no effect use the first one
+		Mesh(ID3D11Device* pDevice, std::shared_ptr<const MeshGeometry> pGeometry, std::vector<Effect*> pEffects,
 			const Vector3& rotation, const Vector3& translation);
 		~Mesh();
 
@@ -18,46 +23,73 @@ namespace dae
 		Mesh& operator=(Mesh&&) noexcept = delete;
 
 		void RotateY(float angle);
-		void Render(ID3D11DeviceContext* pDeviceContext) const;
+		//Uploads the instances that intersect the frustum, the submeshes of the passes draw them afterwards
+		void UploadVisibleInstances(ID3D11DeviceContext* pDeviceContext, const Frustum& frustum);
+		void Render(ID3D11DeviceContext* pDeviceContext, RenderPass pass) const;
 		void SetMatrices(const Matrix& viewProjMatrix, const Matrix& inverseViewMatrix);
+		void SetLights(const std::vector<Light>& lights);
+
+		//Replaces the copies of the mesh, every mesh starts out with a single instance at its own position
+		void SetInstances(ID3D11Device* pDevice, const std::vector<MeshInstance>& instances);
 
-		const std::vector<VertexExt>& GetVertices() const;
-		std::vector<VertexOut>& GetVerticesOut();
-		const std::vector<uint32_t>& GetIndices() const;
+		//Only the vertices of the format of the geometry are filled in
+		VertexFormat GetVertexFormat() const;
+		std::span<const Vertex> GetVertices() const;
+		std::span<const QuantizedVertex> GetQuantizedVertices() const;
+		const Matrix& GetPositionDecodeMatrix() const;
+		std::span<const uint32_t> GetIndices() const;
+		std::span<const Submesh> GetSubmeshes() const;
+		Effect* GetSubmeshEffect(uint32_t submeshIdx) const;
+		//The depth prepass and the opaque pass take the submeshes that write depth, the transparent pass the others
+		bool IsSubmeshInPass(uint32_t submeshIdx, RenderPass pass) const;
+		const std::vector<MeshLod>& GetLods() const;
 		const Matrix& GetWorldMatrix() const;
+		const BoundingBox& GetWorldBounds() const;
+		//Set whenever the world bounds change, until the scene has refit them
+		bool AreWorldBoundsDirty() const;
+		void ClearWorldBoundsDirty();
+		const std::vector<MeshInstance>& GetInstances() const;
+		const std::vector<Matrix>& GetInstanceWorldMatrices() const;
+		const std::vector<BoundingBox>& GetInstanceBounds() const;
 		PrimitiveTopology GetPrimitiveTopology() const;
 
-		void ToggleRender();
-		void CycleCullMode(ID3D11Device* pDevice);
-		void CycleSamplerState(ID3D11Device* pDevice);
+		//Applied to every effect of the mesh
+		void SetCullMode(ID3D11Device* pDevice, CullMode cullMode);
+		void SetSamplerState(ID3D11Device* pDevice, SamplerState samplerState);
+		void SetShouldRender(bool shouldRender);
 		bool ShouldRender() const;
 
-		CullMode GetCullMode() const;
-		SamplerState GetSamplerState() const;
-		ColorRGB ShadePixel(const VertexOut& out, ShadingMode shadingMode, const uint32_t currentColor, bool renderNormals);
+		//True when any submesh writes depth
 		bool UseDepthBuffer() const;
-		bool UseMultiThreading() const;
 
 	private:
-		//DirectX variables
-		Effect* m_pEffect{ nullptr };
-		ID3D11Buffer* m_pVertexBuffer{ nullptr };
-		ID3D11Buffer* m_pIndexBuffer{ nullptr };
-		ID3D11InputLayout* m_pInputLayout{ nullptr };
+		void CreateInstanceBuffer(ID3D11Device* pDevice);
+		void UpdateInstances();
+
+		//DirectX variables, one effect and input layout per material
+		std::vector<Effect*> m_pEffects{};
+		std::vector<ID3D11InputLayout*> m_pInputLayouts{};
+		ID3D11Buffer* m_pInstanceBuffer{ nullptr };
+		uint32_t m_InstanceCapacity{};
+		uint32_t m_NumVisibleInstances{};
 
 		//Matricces
 		Matrix m_TranslationMatrix{};
 		Matrix m_RotationMatrix{};
 		Matrix m_WorldMatrix;
 
-		//Topology
-		PrimitiveTopology m_Topology{ PrimitiveTopology::TriangleList };
+		//The world bounds contain every instance. The matrices and bounds are only recomputed when the transform changed
+		BoundingBox m_WorldBounds{};
+		bool m_IsTransformDirty{ false };
+		bool m_AreWorldBoundsDirty{ true };
+
+		//Instances, the world matrices and bounds are updated together with the matrices of the mesh
+		std::vector<MeshInstance> m_Instances{ MeshInstance{} };
+		std::vector<Matrix> m_InstanceWorldMatrices{};
+		std::vector<BoundingBox> m_InstanceBounds{};
 
-		//Data variables
-		uint32_t m_NumIndices{};
-		std::vector<VertexExt> m_Vertices{};
-		std::vector<VertexOut> m_VerticesOut{};
-		std::vector<uint32_t> m_Indices{};
+		//Vertices, indices, submeshes and levels of detail
+		std::shared_ptr<const MeshGeometry> m_pGeometry{};
 
 		bool m_ShouldRender{ true };
 	};
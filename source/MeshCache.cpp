@@ -0,0 +1,386 @@
+#include "pch.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <cstddef>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace dae
+{
+	namespace MeshCache
+	{
+		namespace
+		{
+			//Changes whenever the layout of the file or of the stored types changes
+			constexpr uint32_t Version{ 4 };
+			constexpr char Magic[4]{ 'D', 'A', 'E', 'M' };
+
+			//Every array starts on a multiple of this, relative to the start of the file
+			constexpr size_t SectionAlignment{ 16 };
+
+			constexpr uint64_t XxPrime1{ 11400714785074694791ull };
+			constexpr uint64_t XxPrime2{ 14029467366897019727ull };
+			constexpr uint64_t XxPrime3{ 1609587929392839161ull };
+			constexpr uint64_t XxPrime4{ 9650029242287828579ull };
+			constexpr uint64_t XxPrime5{ 2870177450012600261ull };
+
+			struct Header
+			{
+				char magic[4]{};
+				uint32_t version{};
+
+				//Sizes of the stored types, a cache written by a build with another layout is rejected
+				uint32_t vertexSize{};
+				uint32_t quantizedVertexSize{};
+				uint32_t meshletSize{};
+				uint32_t padding{};
+
+				uint64_t sourceHash{};
+				uint64_t sourceSize{};
+				int64_t sourceWriteTime{};
+
+				uint32_t numVertices{};
+				uint32_t numIndices{};
+				uint32_t numLods{};
+				//Only the vertices of this format are stored
+				VertexFormat vertexFormat{};
+				uint32_t numSubmeshes{};
+				//The library paths and then the material names, each ended by a zero
+				uint32_t numMaterialLibraries{};
+				uint32_t numMaterials{};
+				uint32_t stringTableSize{};
+				BoundingBox localBounds{};
+				VertexQuantization::PositionDecoding positionDecoding{};
+
+				//The payload is everything after the header, its size is a multiple of 8 bytes
+				uint64_t payloadSize{};
+				uint64_t payloadChecksum{};
+				//Of all header bytes before it
+				uint64_t headerChecksum{};
+			};
+			static_assert(sizeof(Header) == 152, "Every byte of the header has to be covered by its checksum, so it cannot have padding");
+
+			//The payload starts with one of these per level of detail
+			struct LodHeader
+			{
+				uint32_t numMeshlets{};
+				uint32_t numMeshletVertices{};
+				uint32_t numMeshletTriangleBytes{};
+				uint32_t numTriangles{};
+				float error{};
+				uint32_t numSubmeshMeshlets{};
+			};
+
+			size_t AlignUp(size_t size, size_t alignment)
+			{
+				return (size + alignment - 1) / alignment * alignment;
+			}
+
+			uint64_t ReadWord(const uint8_t* pBytes)
+			{
+				uint64_t word{};
+				std::memcpy(&word, pBytes, sizeof(word));
+				return word;
+			}
+
+			uint64_t ChecksumRound(uint64_t accumulator, uint64_t word)
+			{
+				return std::rotl(accumulator + word * XxPrime2, 31) * XxPrime1;
+			}
+
+			uint64_t ChecksumMerge(uint64_t hash, uint64_t accumulator)
+			{
+				return (hash ^ ChecksumRound(0, accumulator)) * XxPrime1 + XxPrime4;
+			}
+
+			//XXH64 with seed 0. Every bit of the input reaches every bit of the result, and the four independent
+			//lanes keep checking a cache of hundreds of megabytes close to memory bandwidth
+			uint64_t Checksum(const void* pData, size_t size)
+			{
+				const uint8_t* pBytes{ static_cast<const uint8_t*>(pData) };
+				const uint8_t* pEnd{ pBytes + size };
+				uint64_t hash{};
+
+				if (size >= 32)
+				{
+					uint64_t lanes[4]{ XxPrime1 + XxPrime2, XxPrime2, 0, 0 - XxPrime1 };
+					for (; pBytes + 32 <= pEnd; pBytes += 32)
+					{
+						for (uint32_t laneIdx{}; laneIdx < 4; ++laneIdx)
+						{
+							lanes[laneIdx] = ChecksumRound(lanes[laneIdx], ReadWord(pBytes + laneIdx * 8));
+						}
+					}
+
+					hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+					for (const uint64_t lane : lanes) hash = ChecksumMerge(hash, lane);
+				}
+				else
+				{
+					hash = XxPrime5;
+				}
+				hash += size;
+
+				for (; pBytes + 8 <= pEnd; pBytes += 8)
+				{
+					hash = std::rotl(hash ^ ChecksumRound(0, ReadWord(pBytes)), 27) * XxPrime1 + XxPrime4;
+				}
+				if (pBytes + 4 <= pEnd)
+				{
+					uint32_t word{};
+					std::memcpy(&word, pBytes, sizeof(word));
+					hash = std::rotl(hash ^ (word * XxPrime1), 23) * XxPrime2 + XxPrime3;
+					pBytes += 4;
+				}
+				for (; pBytes < pEnd; ++pBytes)
+				{
+					hash = std::rotl(hash ^ (*pBytes * XxPrime5), 11) * XxPrime1;
+				}
+
+				//Avalanche, so the last bytes change the high bits as well
+				hash = (hash ^ (hash >> 33)) * XxPrime2;
+				hash = (hash ^ (hash >> 29)) * XxPrime3;
+				return hash ^ (hash >> 32);
+			}
+
+			bool GetSourceInfo(const std::string& sourcePath, uint64_t& size, int64_t& writeTime)
+			{
+				std::error_code error{};
+				size = std::filesystem::file_size(sourcePath, error);
+				if (error) return false;
+
+				const std::filesystem::file_time_type time{ std::filesystem::last_write_time(sourcePath, error) };
+				if (error) return false;
+
+				writeTime = static_cast<int64_t>(time.time_since_epoch().count());
+				return true;
+			}
+
+			bool IsHeaderValid(const Header& header)
+			{
+				return std::memcmp(header.magic, Magic, sizeof(Magic)) == 0
+					&& header.version == Version
+					&& header.vertexSize == sizeof(Vertex)
+					&& header.quantizedVertexSize == sizeof(QuantizedVertex)
+					&& header.meshletSize == sizeof(Meshlet)
+					&& header.headerChecksum == Checksum(&header, offsetof(Header, headerChecksum));
+			}
+
+			//Appends an array to the payload, starting on the section alignment
+			template<typename T>
+			void AppendSection(std::vector<uint8_t>& file, std::span<const T> elements)
+			{
+				file.resize(AlignUp(file.size(), SectionAlignment));
+				const uint8_t* pBytes{ reinterpret_cast<const uint8_t*>(elements.data()) };
+				file.insert(file.end(), pBytes, pBytes + elements.size_bytes());
+			}
+
+			std::vector<char> WriteStringTable(const MeshMaterials& materials)
+			{
+				std::vector<char> stringTable{};
+				for (const std::vector<std::string>* pStrings : { &materials.libraryPaths, &materials.names })
+				{
+					for (const std::string& string : *pStrings)
+					{
+						stringTable.insert(stringTable.end(), string.begin(), string.end());
+						stringTable.push_back('\0');
+					}
+				}
+				return stringTable;
+			}
+
+			bool ReadStringTable(std::span<const char> stringTable, uint32_t numLibraries, uint32_t numMaterials, MeshMaterials& materials)
+			{
+				std::vector<std::string> strings{};
+				for (size_t stringBegin{}; stringBegin < stringTable.size();)
+				{
+					const auto stringEnd{ std::find(stringTable.begin() + stringBegin, stringTable.end(), '\0') };
+					if (stringEnd == stringTable.end()) return false;
+
+					strings.emplace_back(stringTable.begin() + stringBegin, stringEnd);
+					stringBegin = static_cast<size_t>(stringEnd - stringTable.begin()) + 1;
+				}
+				if (strings.size() != static_cast<size_t>(numLibraries) + numMaterials) return false;
+
+				materials.libraryPaths.assign(strings.begin(), strings.begin() + numLibraries);
+				materials.names.assign(strings.begin() + numLibraries, strings.end());
+				return true;
+			}
+
+			//Points the span at the next array of the payload, returns false when it does not fit in the file
+			template<typename T>
+			bool ReadSection(const MappedFile& file, size_t& offset, size_t count, std::span<const T>& elements)
+			{
+				offset = AlignUp(offset, SectionAlignment);
+				if (offset > file.GetSize() || count > (file.GetSize() - offset) / sizeof(T)) return false;
+
+				elements = std::span<const T>{ reinterpret_cast<const T*>(file.GetData() + offset), count };
+				offset += count * sizeof(T);
+				return true;
+			}
+		}
+
+		std::string GetCachePath(const std::string& sourcePath, VertexFormat vertexFormat)
+		{
+			return sourcePath + (vertexFormat == VertexFormat::Quantized ? ".quantized.meshcache" : ".meshcache");
+		}
+
+		bool ReadSourceHash(const std::string& cachePath, const std::string& sourcePath, uint64_t& sourceHash)
+		{
+			std::ifstream file{ cachePath, std::ios::binary };
+			if (!file) return false;
+
+			Header header{};
+			if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || !IsHeaderValid(header)) return false;
+
+			uint64_t sourceSize{};
+			int64_t sourceWriteTime{};
+			if (!GetSourceInfo(sourcePath, sourceSize, sourceWriteTime)) return false;
+			if (header.sourceSize != sourceSize || header.sourceWriteTime != sourceWriteTime) return false;
+
+			sourceHash = header.sourceHash;
+			return true;
+		}
+
+		std::unique_ptr<MappedFile> Open(const std::string& cachePath, uint64_t sourceHash, VertexFormat vertexFormat, MeshGeometry::View& view)
+		{
+			if (!std::filesystem::exists(cachePath)) return nullptr;
+
+			std::unique_ptr<MappedFile> pFile{ std::make_unique<MappedFile>(cachePath) };
+			if (!pFile->IsValid() || pFile->GetSize() < sizeof(Header)) return nullptr;
+
+			//1. Check the header and the payload before anything points into them
+			Header header{};
+			std::memcpy(&header, pFile->GetData(), sizeof(header));
+			if (!IsHeaderValid(header) || header.sourceHash != sourceHash || header.vertexFormat != vertexFormat) return nullptr;
+			if (header.payloadSize != pFile->GetSize() - sizeof(Header)) return nullptr;
+			if (header.payloadChecksum != Checksum(pFile->GetData() + sizeof(Header), header.payloadSize))
+			{
+				std::wcout << L"Mesh cache checksum mismatch!\n";
+				return nullptr;
+			}
+
+			//2. Point the view at the arrays, the sizes are still checked against the file
+			size_t offset{ sizeof(Header) };
+			std::span<const LodHeader> lodHeaders{};
+			if (!ReadSection(*pFile, offset, header.numLods, lodHeaders)) return nullptr;
+
+			view = MeshGeometry::View{};
+			view.vertexFormat = header.vertexFormat;
+			view.localBounds = header.localBounds;
+			view.positionDecoding = header.positionDecoding;
+			if (header.vertexFormat == VertexFormat::Quantized)
+			{
+				if (!ReadSection(*pFile, offset, header.numVertices, view.quantizedVertices)) return nullptr;
+			}
+			else
+			{
+				if (!ReadSection(*pFile, offset, header.numVertices, view.vertices)) return nullptr;
+			}
+			if (!ReadSection(*pFile, offset, header.numIndices, view.indices)) return nullptr;
+			if (!ReadSection(*pFile, offset, header.numSubmeshes, view.submeshes)) return nullptr;
+
+			std::span<const char> stringTable{};
+			if (!ReadSection(*pFile, offset, header.stringTableSize, stringTable)) return nullptr;
+			if (!ReadStringTable(stringTable, header.numMaterialLibraries, header.numMaterials, view.materials)) return nullptr;
+
+			view.lods.resize(lodHeaders.size());
+			for (size_t lodIdx{}; lodIdx < lodHeaders.size(); ++lodIdx)
+			{
+				const LodHeader& lodHeader{ lodHeaders[lodIdx] };
+				MeshLod& lod{ view.lods[lodIdx] };
+				lod.numTriangles = lodHeader.numTriangles;
+				lod.error = lodHeader.error;
+
+				if (!ReadSection(*pFile, offset, lodHeader.numMeshlets, lod.meshlets)) return nullptr;
+				if (!ReadSection(*pFile, offset, lodHeader.numMeshletVertices, lod.meshletVertices)) return nullptr;
+				if (!ReadSection(*pFile, offset, lodHeader.numMeshletTriangleBytes, lod.meshletTriangles)) return nullptr;
+				if (!ReadSection(*pFile, offset, lodHeader.numSubmeshMeshlets, lod.submeshMeshlets)) return nullptr;
+			}
+
+			return pFile;
+		}
+
+		bool Write(const std::string& cachePath, const std::string& sourcePath, uint64_t sourceHash, const MeshGeometry& geometry)
+		{
+			Header header{};
+			std::memcpy(header.magic, Magic, sizeof(Magic));
+			header.version = Version;
+			header.vertexSize = sizeof(Vertex);
+			header.quantizedVertexSize = sizeof(QuantizedVertex);
+			header.meshletSize = sizeof(Meshlet);
+			header.sourceHash = sourceHash;
+			if (!GetSourceInfo(sourcePath, header.sourceSize, header.sourceWriteTime)) return false;
+
+			const std::vector<MeshLod>& lods{ geometry.GetLods() };
+			const bool isQuantized{ geometry.GetVertexFormat() == VertexFormat::Quantized };
+			header.numVertices = static_cast<uint32_t>(isQuantized ? geometry.GetQuantizedVertices().size() : geometry.GetVertices().size());
+			header.numIndices = static_cast<uint32_t>(geometry.GetIndices().size());
+			header.numLods = static_cast<uint32_t>(lods.size());
+			header.vertexFormat = geometry.GetVertexFormat();
+			header.numSubmeshes = static_cast<uint32_t>(geometry.GetSubmeshes().size());
+			header.numMaterialLibraries = static_cast<uint32_t>(geometry.GetMaterials().libraryPaths.size());
+			header.numMaterials = static_cast<uint32_t>(geometry.GetMaterials().names.size());
+			header.localBounds = geometry.GetLocalBounds();
+			header.positionDecoding = geometry.GetPositionDecoding();
+
+			//1. Lay out the file in memory, the header is filled in last
+			std::vector<LodHeader> lodHeaders(lods.size());
+			for (size_t lodIdx{}; lodIdx < lods.size(); ++lodIdx)
+			{
+				lodHeaders[lodIdx].numMeshlets = static_cast<uint32_t>(lods[lodIdx].meshlets.size());
+				lodHeaders[lodIdx].numMeshletVertices = static_cast<uint32_t>(lods[lodIdx].meshletVertices.size());
+				lodHeaders[lodIdx].numMeshletTriangleBytes = static_cast<uint32_t>(lods[lodIdx].meshletTriangles.size());
+				lodHeaders[lodIdx].numTriangles = lods[lodIdx].numTriangles;
+				lodHeaders[lodIdx].error = lods[lodIdx].error;
+				lodHeaders[lodIdx].numSubmeshMeshlets = static_cast<uint32_t>(lods[lodIdx].submeshMeshlets.size());
+			}
+
+			const std::vector<char> stringTable{ WriteStringTable(geometry.GetMaterials()) };
+			header.stringTableSize = static_cast<uint32_t>(stringTable.size());
+
+			std::vector<uint8_t> file(sizeof(Header));
+			AppendSection(file, std::span<const LodHeader>{ lodHeaders });
+			if (isQuantized) AppendSection(file, geometry.GetQuantizedVertices());
+			else AppendSection(file, geometry.GetVertices());
+			AppendSection(file, geometry.GetIndices());
+			AppendSection(file, geometry.GetSubmeshes());
+			AppendSection(file, std::span<const char>{ stringTable });
+			for (const MeshLod& lod : lods)
+			{
+				AppendSection(file, lod.meshlets);
+				AppendSection(file, lod.meshletVertices);
+				AppendSection(file, lod.meshletTriangles);
+				AppendSection(file, lod.submeshMeshlets);
+			}
+			file.resize(AlignUp(file.size(), SectionAlignment));
+
+			header.payloadSize = file.size() - sizeof(Header);
+			header.payloadChecksum = Checksum(file.data() + sizeof(Header), header.payloadSize);
+			header.headerChecksum = Checksum(&header, offsetof(Header, headerChecksum));
+			std::memcpy(file.data(), &header, sizeof(header));
+
+			//2. Write and move it in place
+			const std::string temporaryPath{ cachePath + ".tmp" };
+			{
+				std::ofstream output{ temporaryPath, std::ios::binary | std::ios::trunc };
+				if (!output.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size())))
+				{
+					std::wcout << L"Mesh cache write failed!\n";
+					return false;
+				}
+			}
+
+			std::error_code error{};
+			std::filesystem::rename(temporaryPath, cachePath, error);
+			if (error)
+			{
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "MeshGeometry.h"
+#include <string>
+
+namespace dae
+{
+	class MappedFile;
+
+	//Binary file with the processed geometry of a model: float or quantized vertices, indices, submeshes with the names
+	//of their materials, bounds and every level of detail with its meshlets. The arrays are laid out exactly as they are used in memory, so a mapped cache
+	//is used in place without copying or parsing anything.
+	//The header holds the version, the hash, size and write time of the model it was built from, and checksums
+	//of the header and of the arrays
+	namespace MeshCache
+	{
+		//Each vertex format has its own cache, so switching formats does not rebuild the other one
+		std::string GetCachePath(const std::string& sourcePath, VertexFormat vertexFormat);
+
+		//Returns the content hash of the model stored in its cache, when the cache is still valid for the size and write
+		//time of the model. Only the header is read, so large models do not have to be hashed to be identified
+		bool ReadSourceHash(const std::string& cachePath, const std::string& sourcePath, uint64_t& sourceHash);
+
+		//Maps the cache and points the view at its arrays. Returns nullptr when the cache is missing, has another version
+		//or vertex format, was built from another model or fails its checksums
+		std::unique_ptr<MappedFile> Open(const std::string& cachePath, uint64_t sourceHash, VertexFormat vertexFormat, MeshGeometry::View& view);
+
+		//Written to a temporary file first, so a reader never sees a partial cache
+		bool Write(const std::string& cachePath, const std::string& sourcePath, uint64_t sourceHash, const MeshGeometry& geometry);
+	}
+}
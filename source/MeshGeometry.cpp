@@ -0,0 +1,299 @@
+#include "pch.h"
+#include "MeshGeometry.h"
+#include "MeshSimplifier.h"
+#include "MappedFile.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Copy of the vertices one submesh uses, in the order it first uses them
+		struct SubmeshVertices
+		{
+			std::vector<Vertex> vertices{};
+			//Mesh vertex of every submesh vertex
+			std::vector<uint32_t> meshVertices{};
+		};
+
+		//localIndices maps mesh vertices to submesh vertices, it is all UINT32_MAX before and after the call
+		void GatherSubmeshVertices(std::span<const Vertex> vertices, std::span<const uint32_t> indices, std::vector<uint32_t>& localIndices,
+			SubmeshVertices& submesh, std::vector<uint32_t>& submeshIndices)
+		{
+			submeshIndices.resize(indices.size());
+			for (size_t indexIdx{}; indexIdx < indices.size(); ++indexIdx)
+			{
+				uint32_t& localIndex{ localIndices[indices[indexIdx]] };
+				if (localIndex == UINT32_MAX)
+				{
+					localIndex = static_cast<uint32_t>(submesh.vertices.size());
+					submesh.vertices.push_back(vertices[indices[indexIdx]]);
+					submesh.meshVertices.push_back(indices[indexIdx]);
+				}
+				submeshIndices[indexIdx] = localIndex;
+			}
+
+			for (const uint32_t meshVertex : submesh.meshVertices)
+			{
+				localIndices[meshVertex] = UINT32_MAX;
+			}
+		}
+	}
+
+	MeshGeometry::MeshGeometry(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		const std::vector<Submesh>& submeshes, const MeshMaterials& materials, VertexFormat vertexFormat)
+		: m_IndexStorage{ indices }
+		, m_SubmeshStorage{ submeshes }
+		, m_VertexFormat{ vertexFormat }
+		, m_Materials{ materials }
+	{
+		if (m_SubmeshStorage.empty() && !m_IndexStorage.empty())
+		{
+			m_SubmeshStorage.push_back(Submesh{ 0, static_cast<uint32_t>(m_IndexStorage.size()), 0 });
+		}
+		m_Indices = m_IndexStorage;
+		m_Submeshes = m_SubmeshStorage;
+		for (const Vertex& vertex : vertices)
+		{
+			m_LocalBounds.Grow(vertex.position);
+		}
+
+		//Quantized geometry keeps no float vertices, its levels of detail are built from the decoded vertices
+		//so the meshlet bounds match what is rendered
+		std::vector<Vertex> decodedVertices{};
+		if (m_VertexFormat == VertexFormat::Quantized)
+		{
+			m_PositionDecoding = VertexQuantization::GetPositionDecoding(m_LocalBounds);
+			m_PositionDecodeMatrix = VertexQuantization::GetPositionDecodeMatrix(m_PositionDecoding);
+
+			m_QuantizedVertexStorage.reserve(vertices.size());
+			decodedVertices.reserve(vertices.size());
+			for (const Vertex& vertex : vertices)
+			{
+				const QuantizedVertex& quantized{ m_QuantizedVertexStorage.emplace_back(VertexQuantization::Quantize(vertex, m_PositionDecoding)) };
+				decodedVertices.push_back(VertexQuantization::Dequantize(quantized, m_PositionDecoding));
+			}
+			m_QuantizedVertices = m_QuantizedVertexStorage;
+		}
+		else
+		{
+			m_VertexStorage = vertices;
+			m_Vertices = m_VertexStorage;
+		}
+
+		//Split the mesh in meshlets so the software rasterizer can cull whole clusters,
+		//and simplify it so distant copies can use fewer triangles
+		if (m_Topology == PrimitiveTopology::TriangleList)
+		{
+			BuildLods(m_VertexFormat == VertexFormat::Quantized ? std::span<const Vertex>{ decodedVertices } : m_Vertices);
+		}
+
+		CreateBuffers(pDevice);
+	}
+
+	MeshGeometry::MeshGeometry(ID3D11Device* pDevice, std::unique_ptr<MappedFile> pFile, const View& view)
+		: m_pFile{ std::move(pFile) }
+		, m_VertexFormat{ view.vertexFormat }
+		, m_Vertices{ view.vertices }
+		, m_QuantizedVertices{ view.quantizedVertices }
+		, m_PositionDecoding{ view.positionDecoding }
+		, m_Indices{ view.indices }
+		, m_Submeshes{ view.submeshes }
+		, m_Materials{ view.materials }
+		, m_LocalBounds{ view.localBounds }
+		, m_Lods{ view.lods }
+	{
+		if (m_VertexFormat == VertexFormat::Quantized)
+		{
+			m_PositionDecodeMatrix = VertexQuantization::GetPositionDecodeMatrix(m_PositionDecoding);
+		}
+		CreateBuffers(pDevice);
+	}
+
+	MeshGeometry::~MeshGeometry()
+	{
+		//Release resources
+		if (m_pIndexBuffer) m_pIndexBuffer->Release();
+		if (m_pVertexBuffer) m_pVertexBuffer->Release();
+	}
+
+	ID3D11Buffer* MeshGeometry::GetVertexBuffer() const
+	{
+		return m_pVertexBuffer;
+	}
+	ID3D11Buffer* MeshGeometry::GetIndexBuffer() const
+	{
+		return m_pIndexBuffer;
+	}
+	uint32_t MeshGeometry::GetNumIndices() const
+	{
+		return static_cast<uint32_t>(m_Indices.size());
+	}
+	VertexFormat MeshGeometry::GetVertexFormat() const
+	{
+		return m_VertexFormat;
+	}
+	uint32_t MeshGeometry::GetVertexStride() const
+	{
+		return m_VertexFormat == VertexFormat::Quantized ? sizeof(QuantizedVertex) : sizeof(Vertex);
+	}
+	std::span<const Vertex> MeshGeometry::GetVertices() const
+	{
+		return m_Vertices;
+	}
+	std::span<const QuantizedVertex> MeshGeometry::GetQuantizedVertices() const
+	{
+		return m_QuantizedVertices;
+	}
+	const VertexQuantization::PositionDecoding& MeshGeometry::GetPositionDecoding() const
+	{
+		return m_PositionDecoding;
+	}
+	const Matrix& MeshGeometry::GetPositionDecodeMatrix() const
+	{
+		return m_PositionDecodeMatrix;
+	}
+	std::span<const uint32_t> MeshGeometry::GetIndices() const
+	{
+		return m_Indices;
+	}
+	std::span<const Submesh> MeshGeometry::GetSubmeshes() const
+	{
+		return m_Submeshes;
+	}
+	const MeshMaterials& MeshGeometry::GetMaterials() const
+	{
+		return m_Materials;
+	}
+	const std::vector<MeshLod>& MeshGeometry::GetLods() const
+	{
+		return m_Lods;
+	}
+	const BoundingBox& MeshGeometry::GetLocalBounds() const
+	{
+		return m_LocalBounds;
+	}
+	PrimitiveTopology MeshGeometry::GetPrimitiveTopology() const
+	{
+		return m_Topology;
+	}
+
+	void MeshGeometry::CreateBuffers(ID3D11Device* pDevice)
+	{
+		//Create Vertex Buffer
+		const bool isQuantized{ m_VertexFormat == VertexFormat::Quantized };
+		const size_t numVertices{ isQuantized ? m_QuantizedVertices.size() : m_Vertices.size() };
+
+		D3D11_BUFFER_DESC bd{};
+		bd.Usage = D3D11_USAGE_IMMUTABLE;
+		bd.ByteWidth = GetVertexStride() * static_cast<uint32_t>(numVertices);
+		bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		bd.CPUAccessFlags = 0;
+		bd.MiscFlags = 0;
+
+		D3D11_SUBRESOURCE_DATA initData{};
+		initData.pSysMem = isQuantized ? static_cast<const void*>(m_QuantizedVertices.data()) : static_cast<const void*>(m_Vertices.data());
+
+		HRESULT result = pDevice->CreateBuffer(&bd, &initData, &m_pVertexBuffer);
+		if (FAILED(result))
+		{
+			std::wcout << L"Vertex Buffer creation failed!\n";
+			return;
+		}
+
+		//Create Index Buffer
+		bd.Usage = D3D11_USAGE_IMMUTABLE;
+		bd.ByteWidth = sizeof(uint32_t) * static_cast<uint32_t>(m_Indices.size());
+		bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		bd.CPUAccessFlags = 0;
+		bd.MiscFlags = 0;
+		initData.pSysMem = m_Indices.data();
+		
+		result = pDevice->CreateBuffer(&bd, &initData, &m_pIndexBuffer);
+		if (FAILED(result))
+		{
+			std::wcout << L"Index Buffer creation failed!\n";
+			return;
+		}
+	}
+
+	void MeshGeometry::BuildLods(std::span<const Vertex> vertices)
+	{
+		//Every submesh is split and simplified on its own, so meshlets never mix materials and the borders between
+		//materials stay in place. A submesh works on a copy of only its own vertices, so the cost of a submesh
+		//depends on its size and not on the size of the whole mesh
+		std::vector<SubmeshVertices> submeshVertices(m_Submeshes.size());
+		std::vector<std::vector<uint32_t>> lodIndices(m_Submeshes.size());
+		std::vector<uint32_t> localIndices(vertices.size(), UINT32_MAX);
+		for (size_t submeshIdx{}; submeshIdx < m_Submeshes.size(); ++submeshIdx)
+		{
+			const Submesh& submesh{ m_Submeshes[submeshIdx] };
+			GatherSubmeshVertices(vertices, m_Indices.subspan(submesh.indexOffset, submesh.indexCount), localIndices,
+				submeshVertices[submeshIdx], lodIndices[submeshIdx]);
+		}
+		float lodError{};
+
+		while (true)
+		{
+			LodStorage& storage{ m_LodStorage.emplace_back() };
+			MeshLod& lod{ m_Lods.emplace_back() };
+			lod.error = lodError;
+
+			std::vector<Meshlet> meshlets{};
+			std::vector<uint32_t> meshletVertices{};
+			std::vector<uint8_t> meshletTriangles{};
+			for (size_t submeshIdx{}; submeshIdx < lodIndices.size(); ++submeshIdx)
+			{
+				const SubmeshVertices& submesh{ submeshVertices[submeshIdx] };
+				MeshletUtils::BuildMeshlets(submesh.vertices, lodIndices[submeshIdx], meshlets, meshletVertices, meshletTriangles);
+
+				//The meshlets of a submesh point into its own arrays, move them behind the ones of the submeshes before it
+				const uint32_t vertexBase{ static_cast<uint32_t>(storage.meshletVertices.size()) };
+				const uint32_t triangleBase{ static_cast<uint32_t>(storage.meshletTriangles.size() / 3) };
+				storage.submeshMeshlets.push_back(static_cast<uint32_t>(storage.meshlets.size()));
+				for (Meshlet& meshlet : meshlets)
+				{
+					meshlet.vertexOffset += vertexBase;
+					meshlet.triangleOffset += triangleBase;
+					storage.meshlets.push_back(meshlet);
+				}
+				for (const uint32_t localVertex : meshletVertices)
+				{
+					storage.meshletVertices.push_back(submesh.meshVertices[localVertex]);
+				}
+				storage.meshletTriangles.insert(storage.meshletTriangles.end(), meshletTriangles.begin(), meshletTriangles.end());
+				lod.numTriangles += static_cast<uint32_t>(lodIndices[submeshIdx].size() / 3);
+			}
+			storage.submeshMeshlets.push_back(static_cast<uint32_t>(storage.meshlets.size()));
+
+			//Every level has about half of the triangles of the previous one
+			if (m_Lods.size() == m_MaxLods || lod.numTriangles < m_MinLodTriangles * 2) break;
+
+			std::vector<std::vector<uint32_t>> simplifiedIndices(lodIndices.size());
+			size_t numSimplifiedIndices{};
+			float error{};
+			for (size_t submeshIdx{}; submeshIdx < lodIndices.size(); ++submeshIdx)
+			{
+				const uint32_t numSubmeshTriangles{ static_cast<uint32_t>(lodIndices[submeshIdx].size() / 3) };
+				error = std::max(error, MeshSimplifier::Simplify(submeshVertices[submeshIdx].vertices, lodIndices[submeshIdx],
+					numSubmeshTriangles / 2, simplifiedIndices[submeshIdx]));
+				numSimplifiedIndices += simplifiedIndices[submeshIdx].size();
+			}
+
+			//Borders and seams are kept in place, stop when they prevent a meaningful reduction
+			if (numSimplifiedIndices * 5 > static_cast<size_t>(lod.numTriangles) * 3 * 4) break;
+
+			//Each level is simplified from the previous one, so the errors add up
+			lodIndices = std::move(simplifiedIndices);
+			lodError += error;
+		}
+
+		//The storage does not move anymore, so the levels can point into it
+		for (size_t lodIdx{}; lodIdx < m_Lods.size(); ++lodIdx)
+		{
+			m_Lods[lodIdx].meshlets = m_LodStorage[lodIdx].meshlets;
+			m_Lods[lodIdx].meshletVertices = m_LodStorage[lodIdx].meshletVertices;
+			m_Lods[lodIdx].meshletTriangles = m_LodStorage[lodIdx].meshletTriangles;
+			m_Lods[lodIdx].submeshMeshlets = m_LodStorage[lodIdx].submeshMeshlets;
+		}
+	}
+}
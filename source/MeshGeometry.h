@@ -0,0 +1,122 @@
+#pragma once
+#include "DataTypes.h"
+#include "Meshlet.h"
+#include "VertexQuantization.h"
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace dae
+{
+	class MappedFile;
+
+	//Level of detail of a mesh. The meshlets of every level index into the shared vertices of the mesh
+	struct MeshLod
+	{
+		std::span<const Meshlet> meshlets{};
+		std::span<const uint32_t> meshletVertices{};
+		std::span<const uint8_t> meshletTriangles{};
+		//Meshlets never mix submeshes, the meshlets of submesh i are [submeshMeshlets[i], submeshMeshlets[i + 1])
+		std::span<const uint32_t> submeshMeshlets{};
+		uint32_t numTriangles{};
+
+		//Upper bound of the distance of the vertices of this level to the planes of the full detail triangles, in object space
+		float error{};
+	};
+
+	//Vertices, indices, submeshes and levels of detail of a model with their GPU buffers.
+	//Nothing changes after construction, so every mesh of the same model shares one.
+	//The arrays are either built from the parsed model or point straight into a mapped mesh cache, see MeshCache.
+	//Depending on the vertex format only the float or only the quantized vertices are stored
+	class MeshGeometry final
+	{
+	public:
+		//Arrays of a geometry that is stored elsewhere
+		struct View
+		{
+			VertexFormat vertexFormat{ VertexFormat::Float };
+			std::span<const Vertex> vertices{};
+			std::span<const QuantizedVertex> quantizedVertices{};
+			VertexQuantization::PositionDecoding positionDecoding{};
+			std::span<const uint32_t> indices{};
+			std::span<const Submesh> submeshes{};
+			MeshMaterials materials{};
+			std::vector<MeshLod> lods{};
+			BoundingBox localBounds{};
+		};
+
+		//The submeshes are sorted by material and cover every index, without submeshes all indices use material 0
+		MeshGeometry(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+			const std::vector<Submesh>& submeshes, const MeshMaterials& materials, VertexFormat vertexFormat = VertexFormat::Float);
+		//Takes ownership of the file the view points into
+		MeshGeometry(ID3D11Device* pDevice, std::unique_ptr<MappedFile> pFile, const View& view);
+		~MeshGeometry();
+
+		MeshGeometry(const MeshGeometry&) = delete;
+		MeshGeometry(MeshGeometry&&) noexcept = delete;
+		MeshGeometry& operator=(const MeshGeometry&) = delete;
+		MeshGeometry& operator=(MeshGeometry&&) noexcept = delete;
+
+		ID3D11Buffer* GetVertexBuffer() const;
+		ID3D11Buffer* GetIndexBuffer() const;
+		uint32_t GetNumIndices() const;
+		VertexFormat GetVertexFormat() const;
+		uint32_t GetVertexStride() const;
+		std::span<const Vertex> GetVertices() const;
+		std::span<const QuantizedVertex> GetQuantizedVertices() const;
+		const VertexQuantization::PositionDecoding& GetPositionDecoding() const;
+		//Identity for float vertices
+		const Matrix& GetPositionDecodeMatrix() const;
+		std::span<const uint32_t> GetIndices() const;
+		std::span<const Submesh> GetSubmeshes() const;
+		const MeshMaterials& GetMaterials() const;
+		const std::vector<MeshLod>& GetLods() const;
+		const BoundingBox& GetLocalBounds() const;
+		PrimitiveTopology GetPrimitiveTopology() const;
+
+	private:
+		//Arrays of a level of detail that was built, the MeshLod points into them
+		struct LodStorage
+		{
+			std::vector<Meshlet> meshlets{};
+			std::vector<uint32_t> meshletVertices{};
+			std::vector<uint8_t> meshletTriangles{};
+			std::vector<uint32_t> submeshMeshlets{};
+		};
+
+		void CreateBuffers(ID3D11Device* pDevice);
+		//The vertices are those the levels are simplified from, for quantized geometry the decoded ones
+		void BuildLods(std::span<const Vertex> vertices);
+
+		//DirectX variables
+		ID3D11Buffer* m_pVertexBuffer{ nullptr };
+		ID3D11Buffer* m_pIndexBuffer{ nullptr };
+
+		//Topology
+		PrimitiveTopology m_Topology{ PrimitiveTopology::TriangleList };
+
+		//Storage, only one of them is used
+		std::vector<Vertex> m_VertexStorage{};
+		std::vector<QuantizedVertex> m_QuantizedVertexStorage{};
+		std::vector<uint32_t> m_IndexStorage{};
+		std::vector<Submesh> m_SubmeshStorage{};
+		std::vector<LodStorage> m_LodStorage{};
+		std::unique_ptr<MappedFile> m_pFile{};
+
+		//Data variables
+		VertexFormat m_VertexFormat{ VertexFormat::Float };
+		std::span<const Vertex> m_Vertices{};
+		std::span<const QuantizedVertex> m_QuantizedVertices{};
+		VertexQuantization::PositionDecoding m_PositionDecoding{};
+		Matrix m_PositionDecodeMatrix{};
+		std::span<const uint32_t> m_Indices{};
+		std::span<const Submesh> m_Submeshes{};
+		MeshMaterials m_Materials{};
+		BoundingBox m_LocalBounds{};
+
+		//Levels of detail with their meshlets, only built for the TriangleList topology
+		std::vector<MeshLod> m_Lods{};
+		static constexpr uint32_t m_MaxLods{ 6 };
+		static constexpr uint32_t m_MinLodTriangles{ 64 };
+	};
+}
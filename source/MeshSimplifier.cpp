@@ -0,0 +1,385 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+
+namespace dae
+{
+	namespace MeshSimplifier
+	{
+		namespace
+		{
+			//Symmetric 4x4 matrix that sums the squared distances to a set of planes
+			struct Quadric
+			{
+				float a00{}, a11{}, a22{}, a10{}, a20{}, a21{};
+				float b0{}, b1{}, b2{};
+				float c{};
+				float weight{};
+
+				void AddPlane(const Vector3& normal, float distance, float planeWeight)
+				{
+					a00 += planeWeight * normal.x * normal.x;
+					a11 += planeWeight * normal.y * normal.y;
+					a22 += planeWeight * normal.z * normal.z;
+					a10 += planeWeight * normal.y * normal.x;
+					a20 += planeWeight * normal.z * normal.x;
+					a21 += planeWeight * normal.z * normal.y;
+					b0 += planeWeight * normal.x * distance;
+					b1 += planeWeight * normal.y * distance;
+					b2 += planeWeight * normal.z * distance;
+					c += planeWeight * distance * distance;
+					weight += planeWeight;
+				}
+
+				void Add(const Quadric& quadric)
+				{
+					a00 += quadric.a00;
+					a11 += quadric.a11;
+					a22 += quadric.a22;
+					a10 += quadric.a10;
+					a20 += quadric.a20;
+					a21 += quadric.a21;
+					b0 += quadric.b0;
+					b1 += quadric.b1;
+					b2 += quadric.b2;
+					c += quadric.c;
+					weight += quadric.weight;
+				}
+
+				//Weighted sum of the squared distances from the point to all planes
+				float Error(const Vector3& point) const
+				{
+					const float rx{ a00 * point.x + a10 * point.y + a20 * point.z };
+					const float ry{ a10 * point.x + a11 * point.y + a21 * point.z };
+					const float rz{ a20 * point.x + a21 * point.y + a22 * point.z };
+					const float error{ point.x * rx + point.y * ry + point.z * rz + 2.f * (b0 * point.x + b1 * point.y + b2 * point.z) + c };
+					return std::max(error, 0.f);
+				}
+			};
+
+			//Plane of a triangle of the input, unit normal and distance to the origin
+			struct Plane
+			{
+				Vector3 normal{};
+				float distance{};
+			};
+			constexpr uint32_t NoPlaneNode{ UINT32_MAX };
+
+			//Moves the vertex from onto the vertex to, removing the triangles that share the edge
+			struct Collapse
+			{
+				uint32_t from{};
+				uint32_t to{};
+				uint32_t numTriangles{};
+				float cost{};
+			};
+
+			uint32_t FindTarget(std::vector<uint32_t>& remap, uint32_t positionIdx)
+			{
+				uint32_t targetIdx{ positionIdx };
+				while (remap[targetIdx] != targetIdx) targetIdx = remap[targetIdx];
+
+				//Point the whole chain at the final target so the next lookup is direct
+				while (remap[positionIdx] != targetIdx)
+				{
+					const uint32_t nextIdx{ remap[positionIdx] };
+					remap[positionIdx] = targetIdx;
+					positionIdx = nextIdx;
+				}
+				return targetIdx;
+			}
+
+			//A collapse is rejected when one of the remaining triangles around the vertex would flip
+			bool HasFlippedTriangle(uint32_t from, uint32_t to, const std::vector<Vector3>& positions, const std::vector<uint32_t>& triangles,
+				const std::vector<uint32_t>& adjacencyOffsets, const std::vector<uint32_t>& adjacency)
+			{
+				for (uint32_t adjacencyIdx{ adjacencyOffsets[from] }; adjacencyIdx < adjacencyOffsets[from + 1]; ++adjacencyIdx)
+				{
+					const uint32_t* pTriangle{ triangles.data() + adjacency[adjacencyIdx] * 3 };
+					if (pTriangle[0] == to || pTriangle[1] == to || pTriangle[2] == to) continue;
+
+					Vector3 corners[3]{ positions[pTriangle[0]], positions[pTriangle[1]], positions[pTriangle[2]] };
+					const Vector3 oldNormal{ Vector3::Cross(corners[1] - corners[0], corners[2] - corners[0]) };
+
+					for (uint32_t cornerIdx{}; cornerIdx < 3; ++cornerIdx)
+					{
+						if (pTriangle[cornerIdx] == from) corners[cornerIdx] = positions[to];
+					}
+					const Vector3 newNormal{ Vector3::Cross(corners[1] - corners[0], corners[2] - corners[0]) };
+
+					if (Vector3::Dot(oldNormal, newNormal) <= 0.f) return true;
+				}
+				return false;
+			}
+		}
+
+		float Simplify(std::span<const Vertex> vertices, const std::vector<uint32_t>& indices,
+			uint32_t targetTriangleCount, std::vector<uint32_t>& simplifiedIndices)
+		{
+			simplifiedIndices.clear();
+			const uint32_t numVertices{ static_cast<uint32_t>(vertices.size()) };
+			const uint32_t numIndices{ static_cast<uint32_t>(indices.size() - indices.size() % 3) };
+
+			//Weld vertices with the same position, sorting puts all vertices of a position next to each other
+			std::vector<uint32_t> sortedVertices(numVertices);
+			for (uint32_t vertIdx{}; vertIdx < numVertices; ++vertIdx) sortedVertices[vertIdx] = vertIdx;
+			std::sort(sortedVertices.begin(), sortedVertices.end(), [&vertices](uint32_t a, uint32_t b)
+			{
+				const Vector3& positionA{ vertices[a].position };
+				const Vector3& positionB{ vertices[b].position };
+				if (positionA.x != positionB.x) return positionA.x < positionB.x;
+				if (positionA.y != positionB.y) return positionA.y < positionB.y;
+				return positionA.z < positionB.z;
+			});
+
+			BoundingBox bounds{};
+			for (const Vertex& vertex : vertices) bounds.Grow(vertex.position);
+			const Vector3 extent{ bounds.max - bounds.min };
+			const float scale{ 1.f / std::max(std::max(extent.x, extent.y), std::max(extent.z, FLT_EPSILON)) };
+
+			//Positions are scaled to the unit cube to keep the quadrics in float precision
+			std::vector<uint32_t> positionOfVertex(numVertices);
+			std::vector<uint32_t> positionOffsets{};
+			std::vector<Vector3> positions{};
+			for (uint32_t sortedIdx{}; sortedIdx < numVertices; ++sortedIdx)
+			{
+				const Vector3& position{ vertices[sortedVertices[sortedIdx]].position };
+				const Vector3& previousPosition{ vertices[sortedVertices[std::max(sortedIdx, 1u) - 1]].position };
+				if (sortedIdx == 0 || position.x != previousPosition.x || position.y != previousPosition.y || position.z != previousPosition.z)
+				{
+					positionOffsets.push_back(sortedIdx);
+					positions.push_back((position - bounds.min) * scale);
+				}
+				positionOfVertex[sortedVertices[sortedIdx]] = static_cast<uint32_t>(positions.size() - 1);
+			}
+			positionOffsets.push_back(numVertices);
+			const uint32_t numPositions{ static_cast<uint32_t>(positions.size()) };
+
+			//Triangles on the welded positions, every triangle adds its plane to the quadrics of its corners
+			std::vector<uint32_t> triangles{};
+			triangles.reserve(numIndices);
+			std::vector<Quadric> quadrics(numPositions);
+
+			//Every position keeps a list of the planes of the input triangles around the positions collapsed onto it.
+			//The quadrics only hold the sum of the squared distances, the lists give the largest one
+			std::vector<Plane> planes{};
+			std::vector<uint32_t> planeOfNode{};
+			std::vector<uint32_t> nextNodes{};
+			std::vector<uint32_t> firstNodes(numPositions, NoPlaneNode);
+			std::vector<uint32_t> lastNodes(numPositions, NoPlaneNode);
+			for (uint32_t index{}; index < numIndices; index += 3)
+			{
+				const uint32_t p0{ positionOfVertex[indices[index]] };
+				const uint32_t p1{ positionOfVertex[indices[index + 1]] };
+				const uint32_t p2{ positionOfVertex[indices[index + 2]] };
+				if (p0 == p1 || p1 == p2 || p2 == p0) continue;
+
+				triangles.push_back(p0);
+				triangles.push_back(p1);
+				triangles.push_back(p2);
+
+				const Vector3 normal{ Vector3::Cross(positions[p1] - positions[p0], positions[p2] - positions[p0]) };
+				const float doubleArea{ normal.Magnitude() };
+				if (doubleArea <= 0.f) continue;
+
+				const Vector3 unitNormal{ normal / doubleArea };
+				const float distance{ -Vector3::Dot(unitNormal, positions[p0]) };
+				quadrics[p0].AddPlane(unitNormal, distance, doubleArea * 0.5f);
+				quadrics[p1].AddPlane(unitNormal, distance, doubleArea * 0.5f);
+				quadrics[p2].AddPlane(unitNormal, distance, doubleArea * 0.5f);
+
+				for (const uint32_t positionIdx : { p0, p1, p2 })
+				{
+					const uint32_t nodeIdx{ static_cast<uint32_t>(planeOfNode.size()) };
+					planeOfNode.push_back(static_cast<uint32_t>(planes.size()));
+					nextNodes.push_back(firstNodes[positionIdx]);
+					firstNodes[positionIdx] = nodeIdx;
+					if (lastNodes[positionIdx] == NoPlaneNode) lastNodes[positionIdx] = nodeIdx;
+				}
+				planes.push_back(Plane{ unitNormal, distance });
+			}
+
+			std::vector<uint32_t> remap(numPositions);
+			for (uint32_t positionIdx{}; positionIdx < numPositions; ++positionIdx) remap[positionIdx] = positionIdx;
+
+			std::vector<uint64_t> edges{};
+			std::vector<Collapse> collapses{};
+			std::vector<bool> isLocked(numPositions);
+			std::vector<bool> isTouched(numPositions);
+			std::vector<uint32_t> adjacencyOffsets(numPositions + 1);
+			std::vector<uint32_t> adjacency{};
+			float maxError{};
+
+			//Every pass collapses the cheapest edges whose neighbourhoods do not overlap
+			uint32_t numTriangles{ static_cast<uint32_t>(triangles.size() / 3) };
+			while (numTriangles > targetTriangleCount)
+			{
+				//Edges as sorted key pairs, an edge that only appears once lies on a border
+				edges.clear();
+				for (uint32_t index{}; index < triangles.size(); index += 3)
+				{
+					for (uint32_t cornerIdx{}; cornerIdx < 3; ++cornerIdx)
+					{
+						const uint32_t a{ triangles[index + cornerIdx] };
+						const uint32_t b{ triangles[index + (cornerIdx + 1) % 3] };
+						edges.push_back((static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b));
+					}
+				}
+				std::sort(edges.begin(), edges.end());
+
+				std::fill(isLocked.begin(), isLocked.end(), false);
+				for (size_t edgeIdx{}; edgeIdx < edges.size();)
+				{
+					size_t nextIdx{ edgeIdx + 1 };
+					while (nextIdx < edges.size() && edges[nextIdx] == edges[edgeIdx]) ++nextIdx;
+					if (nextIdx - edgeIdx == 1)
+					{
+						isLocked[static_cast<uint32_t>(edges[edgeIdx] >> 32)] = true;
+						isLocked[static_cast<uint32_t>(edges[edgeIdx])] = true;
+					}
+					edgeIdx = nextIdx;
+				}
+
+				//Each edge collapses in the direction with the smallest error, border vertices never move
+				collapses.clear();
+				for (size_t edgeIdx{}; edgeIdx < edges.size();)
+				{
+					size_t nextIdx{ edgeIdx + 1 };
+					while (nextIdx < edges.size() && edges[nextIdx] == edges[edgeIdx]) ++nextIdx;
+
+					const uint32_t a{ static_cast<uint32_t>(edges[edgeIdx] >> 32) };
+					const uint32_t b{ static_cast<uint32_t>(edges[edgeIdx]) };
+					const uint32_t numEdgeTriangles{ static_cast<uint32_t>(nextIdx - edgeIdx) };
+					edgeIdx = nextIdx;
+
+					if (isLocked[a] && isLocked[b]) continue;
+
+					//The error is normalized by the area of the planes, so small triangles are not collapsed over large distances
+					Quadric quadric{ quadrics[a] };
+					quadric.Add(quadrics[b]);
+					const float invWeight{ 1.f / std::max(quadric.weight, FLT_MIN) };
+					const float costAToB{ isLocked[a] ? FLT_MAX : quadric.Error(positions[b]) * invWeight };
+					const float costBToA{ isLocked[b] ? FLT_MAX : quadric.Error(positions[a]) * invWeight };
+
+					if (costAToB <= costBToA) collapses.push_back(Collapse{ a, b, numEdgeTriangles, costAToB });
+					else collapses.push_back(Collapse{ b, a, numEdgeTriangles, costBToA });
+				}
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+				if (collapses.empty()) break;
+
+				//Only collapse edges about as cheap as the ones needed to reach the target. Most collapses are blocked by
+				//a neighbour in the same pass, expensive edges have to wait for the cheap ones in the next passes
+				const size_t numNeededCollapses{ std::max((numTriangles - targetTriangleCount) / 2, 1u) };
+				const float passCostLimit{ collapses[std::min(numNeededCollapses, collapses.size()) - 1].cost * 2.f };
+
+				//Triangles around each position, used to reject collapses that flip a triangle
+				std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+				for (const uint32_t positionIdx : triangles) ++adjacencyOffsets[positionIdx + 1];
+				for (uint32_t positionIdx{}; positionIdx < numPositions; ++positionIdx) adjacencyOffsets[positionIdx + 1] += adjacencyOffsets[positionIdx];
+				adjacency.resize(triangles.size());
+				for (uint32_t index{}; index < triangles.size(); ++index)
+				{
+					//Offsets are used as write cursors and restored afterwards
+					adjacency[adjacencyOffsets[triangles[index]]++] = index / 3;
+				}
+				for (uint32_t positionIdx{ numPositions }; positionIdx > 0; --positionIdx) adjacencyOffsets[positionIdx] = adjacencyOffsets[positionIdx - 1];
+				adjacencyOffsets[0] = 0;
+
+				std::fill(isTouched.begin(), isTouched.end(), false);
+				uint32_t numCollapses{};
+				for (const Collapse& collapse : collapses)
+				{
+					if (numTriangles <= targetTriangleCount || collapse.cost > passCostLimit) break;
+					if (isTouched[collapse.from] || isTouched[collapse.to]) continue;
+					if (HasFlippedTriangle(collapse.from, collapse.to, positions, triangles, adjacencyOffsets, adjacency)) continue;
+
+					remap[collapse.from] = collapse.to;
+					quadrics[collapse.to].Add(quadrics[collapse.from]);
+
+					//The neighbourhood is frozen for the rest of the pass so the flip test stays valid
+					for (uint32_t adjacencyIdx{ adjacencyOffsets[collapse.from] }; adjacencyIdx < adjacencyOffsets[collapse.from + 1]; ++adjacencyIdx)
+					{
+						const uint32_t* pTriangle{ triangles.data() + adjacency[adjacencyIdx] * 3 };
+						isTouched[pTriangle[0]] = true;
+						isTouched[pTriangle[1]] = true;
+						isTouched[pTriangle[2]] = true;
+					}
+
+					//The collapsed positions now lie at to, measure their original planes from there and hand them over
+					const Vector3& target{ positions[collapse.to] };
+					for (uint32_t nodeIdx{ firstNodes[collapse.from] }; nodeIdx != NoPlaneNode; nodeIdx = nextNodes[nodeIdx])
+					{
+						const Plane& plane{ planes[planeOfNode[nodeIdx]] };
+						maxError = std::max(maxError, std::abs(Vector3::Dot(plane.normal, target) + plane.distance));
+					}
+					if (firstNodes[collapse.from] != NoPlaneNode)
+					{
+						if (firstNodes[collapse.to] == NoPlaneNode) firstNodes[collapse.to] = firstNodes[collapse.from];
+						else nextNodes[lastNodes[collapse.to]] = firstNodes[collapse.from];
+						lastNodes[collapse.to] = lastNodes[collapse.from];
+						firstNodes[collapse.from] = NoPlaneNode;
+						lastNodes[collapse.from] = NoPlaneNode;
+					}
+
+					numTriangles -= std::min(numTriangles, collapse.numTriangles);
+					++numCollapses;
+				}
+
+				if (numCollapses == 0) break;
+
+				//Apply the collapses of this pass and remove the triangles that became degenerate
+				uint32_t writeIdx{};
+				for (uint32_t index{}; index < triangles.size(); index += 3)
+				{
+					const uint32_t p0{ remap[triangles[index]] };
+					const uint32_t p1{ remap[triangles[index + 1]] };
+					const uint32_t p2{ remap[triangles[index + 2]] };
+					if (p0 == p1 || p1 == p2 || p2 == p0) continue;
+
+					triangles[writeIdx++] = p0;
+					triangles[writeIdx++] = p1;
+					triangles[writeIdx++] = p2;
+				}
+				triangles.resize(writeIdx);
+				numTriangles = writeIdx / 3;
+			}
+
+			//Map the collapsed positions back to vertices. A corner that moved takes the vertex at its new position
+			//with the closest uv, which keeps texture seams intact
+			simplifiedIndices.reserve(triangles.size());
+			for (uint32_t index{}; index < numIndices; index += 3)
+			{
+				uint32_t targets[3]{};
+				for (uint32_t cornerIdx{}; cornerIdx < 3; ++cornerIdx)
+				{
+					targets[cornerIdx] = FindTarget(remap, positionOfVertex[indices[index + cornerIdx]]);
+				}
+				if (targets[0] == targets[1] || targets[1] == targets[2] || targets[2] == targets[0]) continue;
+
+				for (uint32_t cornerIdx{}; cornerIdx < 3; ++cornerIdx)
+				{
+					const uint32_t vertIdx{ indices[index + cornerIdx] };
+					if (positionOfVertex[vertIdx] == targets[cornerIdx])
+					{
+						simplifiedIndices.push_back(vertIdx);
+						continue;
+					}
+
+					uint32_t closestIdx{ sortedVertices[positionOffsets[targets[cornerIdx]]] };
+					float closestDistance{ FLT_MAX };
+					for (uint32_t sortedIdx{ positionOffsets[targets[cornerIdx]] }; sortedIdx < positionOffsets[targets[cornerIdx] + 1]; ++sortedIdx)
+					{
+						const float distance{ (vertices[sortedVertices[sortedIdx]].uv - vertices[vertIdx].uv).SqrMagnitude() };
+						if (distance < closestDistance)
+						{
+							closestDistance = distance;
+							closestIdx = sortedVertices[sortedIdx];
+						}
+					}
+					simplifiedIndices.push_back(closestIdx);
+				}
+			}
+
+			return maxError / scale;
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "DataTypes.h"
+#include <span>
+
+namespace dae
+{
+	namespace MeshSimplifier
+	{
+		//Reduces a triangle list to about targetTriangleCount triangles by collapsing edges in order of their quadric error.
+		//Vertices are welded by position, open borders are kept in place. The simplified indices point into the same vertices.
+		//Returns the largest distance of a collapsed vertex to the planes of the input triangles it was part of, in object space
+		float Simplify(std::span<const Vertex> vertices, const std::vector<uint32_t>& indices,
+			uint32_t targetTriangleCount, std::vector<uint32_t>& simplifiedIndices);
+	}
+}
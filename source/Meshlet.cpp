@@ -0,0 +1,213 @@
+#include "pch.h"
+#include "Meshlet.h"
+
+namespace dae
+{
+	namespace MeshletUtils
+	{
+		namespace
+		{
+			void CalculateBounds(Meshlet& meshlet, std::span<const Vertex> vertices, const std::vector<uint32_t>& meshletVertices,
+				const std::vector<uint8_t>& meshletTriangles)
+			{
+				//Bounding sphere around the center of the bounding box
+				BoundingBox bounds{};
+				for (uint32_t localIdx{}; localIdx < meshlet.vertexCount; ++localIdx)
+				{
+					bounds.Grow(vertices[meshletVertices[meshlet.vertexOffset + localIdx]].position);
+				}
+
+				meshlet.center = bounds.GetCenter();
+				float radiusSquared{};
+				for (uint32_t localIdx{}; localIdx < meshlet.vertexCount; ++localIdx)
+				{
+					const Vector3& position{ vertices[meshletVertices[meshlet.vertexOffset + localIdx]].position };
+					radiusSquared = std::max(radiusSquared, (position - meshlet.center).SqrMagnitude());
+				}
+				meshlet.radius = sqrtf(radiusSquared);
+
+				//Normal cone around the average face normal.
+				//The winding matches the rasterizer: front faces have a normal pointing towards the camera
+				Vector3 normalSum{};
+				const uint8_t* pTriangles{ meshletTriangles.data() + meshlet.triangleOffset * 3 };
+				for (uint32_t triangleIdx{}; triangleIdx < meshlet.triangleCount; ++triangleIdx)
+				{
+					const Vector3& p0{ vertices[meshletVertices[meshlet.vertexOffset + pTriangles[triangleIdx * 3]]].position };
+					const Vector3& p1{ vertices[meshletVertices[meshlet.vertexOffset + pTriangles[triangleIdx * 3 + 1]]].position };
+					const Vector3& p2{ vertices[meshletVertices[meshlet.vertexOffset + pTriangles[triangleIdx * 3 + 2]]].position };
+
+					const Vector3 faceNormal{ Vector3::Cross(p1 - p0, p2 - p0) };
+					if (faceNormal.SqrMagnitude() > 0.f) normalSum += faceNormal.Normalized();
+				}
+
+				if (normalSum.SqrMagnitude() <= FLT_EPSILON)
+				{
+					meshlet.coneCutoff = 1.f;
+					return;
+				}
+				meshlet.coneAxis = normalSum.Normalized();
+
+				float minDot{ 1.f };
+				for (uint32_t triangleIdx{}; triangleIdx < meshlet.triangleCount; ++triangleIdx)
+				{
+					const Vector3& p0{ vertices[meshletVertices[meshlet.vertexOffset + pTriangles[triangleIdx * 3]]].position };
+					const Vector3& p1{ vertices[meshletVertices[meshlet.vertexOffset + pTriangles[triangleIdx * 3 + 1]]].position };
+					const Vector3& p2{ vertices[meshletVertices[meshlet.vertexOffset + pTriangles[triangleIdx * 3 + 2]]].position };
+
+					const Vector3 faceNormal{ Vector3::Cross(p1 - p0, p2 - p0) };
+					if (faceNormal.SqrMagnitude() > 0.f) minDot = std::min(minDot, Vector3::Dot(faceNormal.Normalized(), meshlet.coneAxis));
+				}
+
+				//Cones wider than ~85 degrees are practically never culled, mark them as such
+				meshlet.coneCutoff = minDot <= 0.1f ? 1.f : sqrtf(1.f - minDot * minDot);
+			}
+
+			uint32_t ExpandBits(uint32_t value)
+			{
+				//Spread the lower 10 bits so there are two zero bits between each of them
+				value = (value | (value << 16)) & 0x030000FF;
+				value = (value | (value << 8)) & 0x0300F00F;
+				value = (value | (value << 4)) & 0x030C30C3;
+				value = (value | (value << 2)) & 0x09249249;
+				return value;
+			}
+
+			//Number of cells along each side of the normal grid, more cells give narrower cones but wider spheres
+			constexpr uint32_t NormalGridSize{ 8 };
+
+			//Orders triangles so neighbouring triangles that face the same direction end up next to each other.
+			//Triangles are grouped by the direction of their normal, and sorted along a morton curve inside each group
+			std::vector<uint32_t> SortTriangles(std::span<const Vertex> vertices, const std::vector<uint32_t>& indices)
+			{
+				const uint32_t numTriangles{ static_cast<uint32_t>(indices.size() / 3) };
+
+				BoundingBox bounds{};
+				for (const Vertex& vertex : vertices)
+				{
+					bounds.Grow(vertex.position);
+				}
+				const Vector3 extent{ bounds.max - bounds.min };
+				const float invExtent{ 1.f / std::max(std::max(extent.x, extent.y), std::max(extent.z, FLT_EPSILON)) };
+
+				std::vector<uint64_t> keys(numTriangles);
+				for (uint32_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+				{
+					const Vector3& p0{ vertices[indices[triangleIdx * 3]].position };
+					const Vector3& p1{ vertices[indices[triangleIdx * 3 + 1]].position };
+					const Vector3& p2{ vertices[indices[triangleIdx * 3 + 2]].position };
+					const Vector3 faceNormal{ Vector3::Cross(p1 - p0, p2 - p0) };
+
+					//Map the normal on an octahedron and pick its cell in a grid on the unfolded octahedron
+					const Vector3 octNormal{ faceNormal / std::max(abs(faceNormal.x) + abs(faceNormal.y) + abs(faceNormal.z), FLT_MIN) };
+					float octX{ octNormal.x };
+					float octY{ octNormal.y };
+					if (octNormal.z < 0.f)
+					{
+						octX = (1.f - abs(octNormal.y)) * (octNormal.x >= 0.f ? 1.f : -1.f);
+						octY = (1.f - abs(octNormal.x)) * (octNormal.y >= 0.f ? 1.f : -1.f);
+					}
+					const uint32_t cellX{ std::min(static_cast<uint32_t>((octX * 0.5f + 0.5f) * NormalGridSize), NormalGridSize - 1) };
+					const uint32_t cellY{ std::min(static_cast<uint32_t>((octY * 0.5f + 0.5f) * NormalGridSize), NormalGridSize - 1) };
+					const uint32_t direction{ cellY * NormalGridSize + cellX };
+
+					//Quantize the centroid to 10 bits per axis
+					const Vector3 centroid{ ((p0 + p1 + p2) / 3.f - bounds.min) * invExtent * 1023.f };
+					const uint32_t morton{ ExpandBits(static_cast<uint32_t>(centroid.x)) 
+						| (ExpandBits(static_cast<uint32_t>(centroid.y)) << 1) 
+						| (ExpandBits(static_cast<uint32_t>(centroid.z)) << 2) };
+
+					keys[triangleIdx] = (static_cast<uint64_t>(direction) << 32) | morton;
+				}
+
+				std::vector<uint32_t> order(numTriangles);
+				for (uint32_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx) order[triangleIdx] = triangleIdx;
+				std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+				return order;
+			}
+		}
+
+		void BuildMeshlets(std::span<const Vertex> vertices, const std::vector<uint32_t>& indices,
+			std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletTriangles)
+		{
+			meshlets.clear();
+			meshletVertices.clear();
+			meshletTriangles.clear();
+
+			const uint32_t numTriangles{ static_cast<uint32_t>(indices.size() / 3) };
+			meshletTriangles.reserve(numTriangles * 3);
+
+			//Local index of each mesh vertex in the meshlet that is being built
+			constexpr uint8_t invalidIdx{ 0xFF };
+			std::vector<uint8_t> localIndices(vertices.size(), invalidIdx);
+
+			Meshlet meshlet{};
+			auto finishMeshlet = [&]()
+			{
+				if (meshlet.triangleCount == 0) return;
+
+				CalculateBounds(meshlet, vertices, meshletVertices, meshletTriangles);
+				meshlets.push_back(meshlet);
+
+				//Only reset the vertices that were used instead of the full lookup
+				for (uint32_t localIdx{}; localIdx < meshlet.vertexCount; ++localIdx)
+				{
+					localIndices[meshletVertices[meshlet.vertexOffset + localIdx]] = invalidIdx;
+				}
+
+				meshlet = Meshlet{};
+				meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+				meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size() / 3);
+			};
+
+			//Triangles are added in an order that keeps them close together and facing the same way,
+			//which gives tight bounding spheres and narrow normal cones
+			const std::vector<uint32_t> triangleOrder{ SortTriangles(vertices, indices) };
+			for (const uint32_t triangleIdx : triangleOrder)
+			{
+				const uint32_t* pTriangle{ indices.data() + triangleIdx * 3 };
+
+				uint32_t numNewVertices{};
+				for (uint32_t cornerIdx{}; cornerIdx < 3; ++cornerIdx)
+				{
+					numNewVertices += localIndices[pTriangle[cornerIdx]] == invalidIdx;
+				}
+
+				if (meshlet.vertexCount + numNewVertices > MaxVertices || meshlet.triangleCount + 1 > MaxTriangles)
+				{
+					finishMeshlet();
+				}
+
+				for (uint32_t cornerIdx{}; cornerIdx < 3; ++cornerIdx)
+				{
+					uint8_t& localIdx{ localIndices[pTriangle[cornerIdx]] };
+					if (localIdx == invalidIdx)
+					{
+						localIdx = static_cast<uint8_t>(meshlet.vertexCount++);
+						meshletVertices.push_back(pTriangle[cornerIdx]);
+					}
+					meshletTriangles.push_back(localIdx);
+				}
+				++meshlet.triangleCount;
+			}
+			finishMeshlet();
+		}
+
+		bool IsConeCulled(const Vector3& center, float radius, const Vector3& coneAxis, float coneCutoff,
+			const Vector3& cameraOrigin, CullMode cullMode)
+		{
+			//Conservative test: the whole bounding sphere has to be inside the region where every face is culled
+			const Vector3 toCenter{ center - cameraOrigin };
+			const float distance{ toCenter.Magnitude() };
+
+			switch (cullMode)
+			{
+			case CullMode::Back:
+				return Vector3::Dot(toCenter, coneAxis) >= coneCutoff * distance + radius;
+			case CullMode::Front:
+				return Vector3::Dot(toCenter, -coneAxis) >= coneCutoff * distance + radius;
+			default:
+				return false;
+			}
+		}
+	}
+}
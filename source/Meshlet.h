@@ -0,0 +1,41 @@
+#pragma once
+#include "DataTypes.h"
+#include <span>
+
+namespace dae
+{
+	//Small cluster of triangles that is culled and rasterized as a whole.
+	//Triangles index into the meshlet's own vertex range, which keeps the indices 8 bit.
+	struct Meshlet
+	{
+		uint32_t vertexOffset{};
+		uint32_t triangleOffset{};
+		uint32_t vertexCount{};
+		uint32_t triangleCount{};
+
+		//Bounding sphere in object space
+		Vector3 center{};
+		float radius{};
+
+		//Normal cone in object space, a cutoff of 1 means the cone can never be culled
+		Vector3 coneAxis{};
+		float coneCutoff{ 1.f };
+	};
+
+	namespace MeshletUtils
+	{
+		//Limits keep the local indices in a byte and give about 64 to 128 triangles per meshlet
+		constexpr uint32_t MaxVertices{ 192 };
+		constexpr uint32_t MaxTriangles{ 128 };
+
+		//Splits a triangle list in meshlets. meshletVertices maps the local vertices of each meshlet to the mesh vertices,
+		//meshletTriangles holds three local indices per triangle
+		void BuildMeshlets(std::span<const Vertex> vertices, const std::vector<uint32_t>& indices,
+			std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletTriangles);
+
+		//Returns true when every triangle of the meshlet faces away from the camera for the given cullmode.
+		//All parameters are in world space
+		bool IsConeCulled(const Vector3& center, float radius, const Vector3& coneAxis, float coneCutoff,
+			const Vector3& cameraOrigin, CullMode cullMode);
+	}
+}
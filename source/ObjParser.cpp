@@ -0,0 +1,643 @@
+#include "pch.h"
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <ppl.h>
+
+namespace dae
+{
+	namespace ObjParser
+	{
+		namespace
+		{
+			enum class LineType
+			{
+				Other,
+				Position,
+				UV,
+				Normal,
+				Face,
+				UseMaterial,
+				MaterialLibrary
+			};
+
+			struct ElementCounts
+			{
+				size_t numPositions{};
+				size_t numUVs{};
+				size_t numNormals{};
+				size_t numFaces{};
+				size_t numCorners{};
+			};
+
+			//Face indices of a chunk are stored zero based. A negative index in the file counts back from the last element read,
+			//which can lie in an earlier chunk, so it is stored relative to the first element of the chunk, shifted by
+			//RelativeIndexBase, and resolved once the offsets of the chunks are known
+			constexpr int64_t MissingIndex{ -1 };
+			constexpr int64_t RelativeIndexBase{ INT64_MIN / 2 };
+			constexpr int64_t MaxRelativeIndex{ int64_t{ 1 } << 40 };
+
+			//Files are split in chunks of about this size, at line boundaries
+			constexpr size_t ChunkBytes{ 512 * 1024 };
+
+			constexpr uint32_t NoMaterial{ UINT32_MAX };
+
+			struct Corner
+			{
+				int64_t position{ MissingIndex };
+				int64_t uv{ MissingIndex };
+				int64_t normal{ MissingIndex };
+			};
+
+			//A usemtl line, the triangles from firstTriangle on use the material
+			struct MaterialSwitch
+			{
+				size_t firstTriangle{};
+				std::string name{};
+			};
+
+			//Triangles [firstTriangle, endTriangle) of a chunk that use the same material
+			struct MaterialRun
+			{
+				size_t firstTriangle{};
+				size_t endTriangle{};
+				uint32_t materialIdx{};
+			};
+
+			//Lines of the file that are parsed by one task. Faces never cross a chunk, so the vertices and indices
+			//of a chunk are a contiguous range of the output
+			struct Chunk
+			{
+				const char* pBegin{ nullptr };
+				const char* pEnd{ nullptr };
+
+				std::vector<Vector3> positions{};
+				std::vector<Vector2> uvs{};
+				std::vector<Vector3> normals{};
+				std::vector<Corner> corners{};
+				std::vector<uint32_t> faceSizes{};
+				size_t numTriangles{};
+
+				//Triangles before the first switch use the material of the end of the previous chunk
+				std::vector<MaterialSwitch> materialSwitches{};
+				std::vector<std::string> materialLibraries{};
+				std::vector<MaterialRun> materialRuns{};
+				//Per material, the first triangle of the chunk in the sorted triangles
+				std::vector<size_t> materialOffsets{};
+
+				//Offsets in the merged arrays, the sums of the counts of the chunks before this one
+				size_t firstPosition{};
+				size_t firstUV{};
+				size_t firstNormal{};
+				size_t firstVertex{};
+				size_t firstIndex{};
+			};
+
+			bool IsBlank(char c)
+			{
+				return c == ' ' || c == '\t' || c == '\r';
+			}
+
+			const char* SkipBlanks(const char* pCur, const char* pEnd)
+			{
+				while (pCur < pEnd && IsBlank(*pCur)) ++pCur;
+				return pCur;
+			}
+
+			const char* FindLineEnd(const char* pCur, const char* pEnd)
+			{
+				const void* pNewline{ std::memchr(pCur, '\n', static_cast<size_t>(pEnd - pCur)) };
+				return pNewline ? static_cast<const char*>(pNewline) : pEnd;
+			}
+
+			//Returns true and moves pCur past the keyword when the line starts with it, followed by a blank
+			bool ReadKeyword(const char*& pCur, const char* pLineEnd, std::string_view keyword)
+			{
+				if (static_cast<size_t>(pLineEnd - pCur) <= keyword.size()) return false;
+				if (std::string_view{ pCur, keyword.size() } != keyword || !IsBlank(pCur[keyword.size()])) return false;
+
+				pCur += keyword.size() + 1;
+				return true;
+			}
+
+			//Reads the next run of non blank characters, names and paths cannot contain blanks
+			std::string_view ReadWord(const char*& pCur, const char* pLineEnd)
+			{
+				pCur = SkipBlanks(pCur, pLineEnd);
+				const char* pWordBegin{ pCur };
+				while (pCur < pLineEnd && !IsBlank(*pCur)) ++pCur;
+				return std::string_view{ pWordBegin, static_cast<size_t>(pCur - pWordBegin) };
+			}
+
+			//The last word of the line, map lines put their options in front of the file name
+			std::string_view ReadLastWord(const char* pCur, const char* pLineEnd)
+			{
+				std::string_view lastWord{};
+				for (std::string_view word{ ReadWord(pCur, pLineEnd) }; !word.empty(); word = ReadWord(pCur, pLineEnd))
+				{
+					lastWord = word;
+				}
+				return lastWord;
+			}
+
+			//Paths in a file are relative to the directory of that file
+			std::string GetRelativePath(const std::string& filePath, std::string_view path)
+			{
+				return (std::filesystem::path{ filePath }.parent_path() / std::filesystem::path{ path }).string();
+			}
+
+			//Reads the keyword at the start of the line and moves pCur past it
+			LineType ReadLineType(const char*& pCur, const char* pLineEnd)
+			{
+				pCur = SkipBlanks(pCur, pLineEnd);
+				const ptrdiff_t length{ pLineEnd - pCur };
+				if (length < 2) return LineType::Other;
+
+				if (pCur[0] == 'f' && IsBlank(pCur[1]))
+				{
+					pCur += 2;
+					return LineType::Face;
+				}
+				if (pCur[0] != 'v')
+				{
+					if (ReadKeyword(pCur, pLineEnd, "usemtl")) return LineType::UseMaterial;
+					if (ReadKeyword(pCur, pLineEnd, "mtllib")) return LineType::MaterialLibrary;
+					return LineType::Other;
+				}
+
+				if (IsBlank(pCur[1]))
+				{
+					pCur += 2;
+					return LineType::Position;
+				}
+				if (length < 3 || !IsBlank(pCur[2])) return LineType::Other;
+
+				const char type{ pCur[1] };
+				pCur += 3;
+				if (type == 't') return LineType::UV;
+				if (type == 'n') return LineType::Normal;
+				return LineType::Other;
+			}
+
+			const char* ParseFloat(const char* pCur, const char* pEnd, float& value)
+			{
+				pCur = SkipBlanks(pCur, pEnd);
+				//from_chars does not accept the leading plus some exporters write
+				if (pCur < pEnd && *pCur == '+') ++pCur;
+
+				value = 0.f;
+				return std::from_chars(pCur, pEnd, value).ptr;
+			}
+
+			//Parses one index of a corner and converts it to the way it is stored in a chunk, see RelativeIndexBase
+			const char* ParseIndex(const char* pCur, const char* pEnd, size_t numElementsInChunk, int64_t& index)
+			{
+				int64_t objIndex{};
+				const std::from_chars_result result{ std::from_chars(pCur, pEnd, objIndex) };
+
+				if (objIndex > 0) index = objIndex - 1;
+				else if (objIndex < 0 && objIndex >= -MaxRelativeIndex) index = RelativeIndexBase + static_cast<int64_t>(numElementsInChunk) + objIndex;
+				else index = MissingIndex;
+				return result.ptr;
+			}
+
+			//Parses a corner written as p, p/t, p//n or p/t/n. Returns nullptr when there are no corners left on the line
+			const char* ParseCorner(const char* pCur, const char* pEnd, const Chunk& chunk, Corner& corner)
+			{
+				pCur = SkipBlanks(pCur, pEnd);
+				corner = Corner{};
+
+				//A corner always starts with its position
+				if (pCur == pEnd || !(*pCur == '-' || (*pCur >= '0' && *pCur <= '9'))) return nullptr;
+				const char* pNext{ ParseIndex(pCur, pEnd, chunk.positions.size(), corner.position) };
+				if (pNext == pCur) return nullptr;
+				pCur = pNext;
+
+				if (pCur < pEnd && *pCur == '/')
+				{
+					++pCur;
+					if (pCur < pEnd && *pCur != '/') pCur = ParseIndex(pCur, pEnd, chunk.uvs.size(), corner.uv);
+					if (pCur < pEnd && *pCur == '/') pCur = ParseIndex(pCur + 1, pEnd, chunk.normals.size(), corner.normal);
+				}
+				return pCur;
+			}
+
+			//Returns false for a missing or out of range index
+			bool ResolveIndex(int64_t storedIndex, size_t firstInChunk, size_t count, size_t& index)
+			{
+				if (storedIndex == MissingIndex) return false;
+				if (storedIndex >= 0)
+				{
+					index = static_cast<size_t>(storedIndex);
+				}
+				else
+				{
+					const int64_t absoluteIndex{ static_cast<int64_t>(firstInChunk) + (storedIndex - RelativeIndexBase) };
+					if (absoluteIndex < 0) return false;
+					index = static_cast<size_t>(absoluteIndex);
+				}
+				return index < count;
+			}
+
+			ElementCounts CountElements(const char* pBegin, const char* pEnd)
+			{
+				ElementCounts counts{};
+				for (const char* pLine{ pBegin }; pLine < pEnd;)
+				{
+					const char* pLineEnd{ FindLineEnd(pLine, pEnd) };
+					const char* pCur{ pLine };
+
+					switch (ReadLineType(pCur, pLineEnd))
+					{
+					case LineType::Position: ++counts.numPositions; break;
+					case LineType::UV: ++counts.numUVs; break;
+					case LineType::Normal: ++counts.numNormals; break;
+					case LineType::Face:
+					{
+						//Every run of non blank characters can be a corner, only used to reserve
+						size_t numCorners{};
+						for (bool isInCorner{ false }; pCur < pLineEnd; ++pCur)
+						{
+							const bool isBlank{ IsBlank(*pCur) };
+							if (!isBlank && !isInCorner) ++numCorners;
+							isInCorner = !isBlank;
+						}
+						++counts.numFaces;
+						counts.numCorners += numCorners;
+						break;
+					}
+					default: break;
+					}
+
+					pLine = pLineEnd + 1;
+				}
+				return counts;
+			}
+
+			//The indices refer to the whole mesh, all of their vertices lie in the range that starts at firstVertex
+			void GenerateTangents(std::span<Vertex> vertices, std::span<const uint32_t> indices, size_t firstVertex)
+			{
+				//Cheap Tangent Calculations
+				for (size_t i{}; i < indices.size(); i += 3)
+				{
+					Vertex& v0{ vertices[indices[i] - firstVertex] };
+					Vertex& v1{ vertices[indices[i + 1] - firstVertex] };
+					Vertex& v2{ vertices[indices[i + 2] - firstVertex] };
+
+					const Vector3 edge0{ v1.position - v0.position };
+					const Vector3 edge1{ v2.position - v0.position };
+					const Vector2 diffX{ v1.uv.x - v0.uv.x, v2.uv.x - v0.uv.x };
+					const Vector2 diffY{ v1.uv.y - v0.uv.y, v2.uv.y - v0.uv.y };
+					const float r{ 1.f / Vector2::Cross(diffX, diffY) };
+
+					const Vector3 tangent{ (edge0 * diffY.y - edge1 * diffY.x) * r };
+					v0.tangent += tangent;
+					v1.tangent += tangent;
+					v2.tangent += tangent;
+				}
+
+				//Create the Tangents (reject)
+				for (Vertex& vertex : vertices)
+				{
+					vertex.tangent = Vector3::Reject(vertex.tangent, vertex.normal).Normalized();
+				}
+			}
+
+			//Moves the triangles of every material together, in the order of the file. Every chunk knows where its triangles
+			//of a material start in the sorted indices, so the chunks are moved in parallel
+			void SortByMaterial(std::vector<Chunk>& chunks, uint32_t numMaterials, std::vector<uint32_t>& indices, std::vector<Submesh>& submeshes)
+			{
+				size_t numSortedTriangles{};
+				for (uint32_t materialIdx{}; materialIdx < numMaterials; ++materialIdx)
+				{
+					const size_t firstTriangle{ numSortedTriangles };
+					for (Chunk& chunk : chunks)
+					{
+						chunk.materialOffsets.resize(numMaterials);
+						chunk.materialOffsets[materialIdx] = numSortedTriangles;
+						for (const MaterialRun& run : chunk.materialRuns)
+						{
+							if (run.materialIdx == materialIdx) numSortedTriangles += run.endTriangle - run.firstTriangle;
+						}
+					}
+
+					//Materials that are selected but never used get no submesh
+					if (numSortedTriangles == firstTriangle) continue;
+					submeshes.push_back(Submesh{ static_cast<uint32_t>(firstTriangle * 3), static_cast<uint32_t>((numSortedTriangles - firstTriangle) * 3), materialIdx });
+				}
+
+				std::vector<uint32_t> sortedIndices(indices.size());
+				concurrency::parallel_for(size_t{}, chunks.size(), [&](size_t chunkIdx)
+				{
+					const Chunk& chunk{ chunks[chunkIdx] };
+					std::vector<size_t> nextTriangles{ chunk.materialOffsets };
+					for (const MaterialRun& run : chunk.materialRuns)
+					{
+						const size_t numRunIndices{ (run.endTriangle - run.firstTriangle) * 3 };
+						const auto runBegin{ indices.begin() + chunk.firstIndex + run.firstTriangle * 3 };
+						std::copy(runBegin, runBegin + numRunIndices, sortedIndices.begin() + nextTriangles[run.materialIdx] * 3);
+						nextTriangles[run.materialIdx] += run.endTriangle - run.firstTriangle;
+					}
+				});
+				indices = std::move(sortedIndices);
+			}
+
+			std::vector<Chunk> SplitInChunks(const char* pBegin, const char* pEnd)
+			{
+				std::vector<Chunk> chunks{};
+				chunks.reserve(static_cast<size_t>(pEnd - pBegin) / ChunkBytes + 1);
+
+				for (const char* pChunkBegin{ pBegin }; pChunkBegin < pEnd;)
+				{
+					const char* pChunkEnd{ pEnd };
+					if (static_cast<size_t>(pEnd - pChunkBegin) > ChunkBytes)
+					{
+						pChunkEnd = FindLineEnd(pChunkBegin + ChunkBytes, pEnd);
+						if (pChunkEnd < pEnd) ++pChunkEnd;
+					}
+
+					Chunk& chunk{ chunks.emplace_back() };
+					chunk.pBegin = pChunkBegin;
+					chunk.pEnd = pChunkEnd;
+					pChunkBegin = pChunkEnd;
+				}
+				return chunks;
+			}
+
+			void ParseChunk(Chunk& chunk)
+			{
+				//1. Count the elements, so nothing is reallocated while parsing
+				const ElementCounts counts{ CountElements(chunk.pBegin, chunk.pEnd) };
+				chunk.positions.reserve(counts.numPositions);
+				chunk.uvs.reserve(counts.numUVs);
+				chunk.normals.reserve(counts.numNormals);
+				chunk.corners.reserve(counts.numCorners);
+				chunk.faceSizes.reserve(counts.numFaces);
+
+				//2. Parse, faces are only stored, their indices can refer to other chunks
+				size_t numTriangles{};
+				for (const char* pLine{ chunk.pBegin }; pLine < chunk.pEnd;)
+				{
+					const char* pLineEnd{ FindLineEnd(pLine, chunk.pEnd) };
+					const char* pCur{ pLine };
+
+					switch (ReadLineType(pCur, pLineEnd))
+					{
+					case LineType::Position:
+					{
+						Vector3& position{ chunk.positions.emplace_back() };
+						pCur = ParseFloat(pCur, pLineEnd, position.x);
+						pCur = ParseFloat(pCur, pLineEnd, position.y);
+						ParseFloat(pCur, pLineEnd, position.z);
+						break;
+					}
+					case LineType::UV:
+					{
+						float u{}, v{};
+						pCur = ParseFloat(pCur, pLineEnd, u);
+						ParseFloat(pCur, pLineEnd, v);
+						chunk.uvs.emplace_back(u, 1 - v);
+						break;
+					}
+					case LineType::Normal:
+					{
+						Vector3& normal{ chunk.normals.emplace_back() };
+						pCur = ParseFloat(pCur, pLineEnd, normal.x);
+						pCur = ParseFloat(pCur, pLineEnd, normal.y);
+						ParseFloat(pCur, pLineEnd, normal.z);
+						break;
+					}
+					case LineType::Face:
+					{
+						uint32_t faceSize{};
+						Corner corner{};
+						for (pCur = ParseCorner(pCur, pLineEnd, chunk, corner); pCur; pCur = ParseCorner(pCur, pLineEnd, chunk, corner))
+						{
+							chunk.corners.push_back(corner);
+							++faceSize;
+						}
+						if (faceSize > 0) chunk.faceSizes.push_back(faceSize);
+						//The counts are an upper bound, parsing stops at the first token of a line that is not a corner
+						if (faceSize >= 3) numTriangles += faceSize - 2;
+						break;
+					}
+					case LineType::UseMaterial:
+						chunk.materialSwitches.push_back(MaterialSwitch{ numTriangles, std::string{ ReadWord(pCur, pLineEnd) } });
+						break;
+					case LineType::MaterialLibrary:
+						for (std::string_view library{ ReadWord(pCur, pLineEnd) }; !library.empty(); library = ReadWord(pCur, pLineEnd))
+						{
+							chunk.materialLibraries.emplace_back(library);
+						}
+						break;
+					default: break;
+					}
+
+					pLine = pLineEnd + 1;
+				}
+				chunk.numTriangles = numTriangles;
+			}
+
+			//Creates the vertices and indices of the faces of the chunk, in its own range of the output
+			void ResolveChunk(const Chunk& chunk, const std::vector<Vector3>& positions, const std::vector<Vector2>& uvs, const std::vector<Vector3>& normals,
+				std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding)
+			{
+				size_t vertexIdx{ chunk.firstVertex };
+				size_t indexIdx{ chunk.firstIndex };
+				const Corner* pCorner{ chunk.corners.data() };
+
+				for (const uint32_t faceSize : chunk.faceSizes)
+				{
+					const uint32_t firstFaceVertex{ static_cast<uint32_t>(vertexIdx) };
+					for (uint32_t cornerIdx{}; cornerIdx < faceSize; ++cornerIdx, ++vertexIdx, ++pCorner)
+					{
+						Vertex& vertex{ vertices[vertexIdx] };
+						size_t index{};
+						if (ResolveIndex(pCorner->position, chunk.firstPosition, positions.size(), index)) vertex.position = positions[index];
+						if (ResolveIndex(pCorner->uv, chunk.firstUV, uvs.size(), index)) vertex.uv = uvs[index];
+						if (ResolveIndex(pCorner->normal, chunk.firstNormal, normals.size(), index)) vertex.normal = normals[index];
+
+						//Fan from the first corner, once there are three
+						if (cornerIdx < 2) continue;
+
+						const uint32_t currentVertex{ static_cast<uint32_t>(vertexIdx) };
+						indices[indexIdx++] = firstFaceVertex;
+						if (flipAxisAndWinding)
+						{
+							indices[indexIdx++] = currentVertex;
+							indices[indexIdx++] = currentVertex - 1;
+						}
+						else
+						{
+							indices[indexIdx++] = currentVertex - 1;
+							indices[indexIdx++] = currentVertex;
+						}
+					}
+				}
+
+				const std::span<Vertex> chunkVertices{ vertices.data() + chunk.firstVertex, chunk.corners.size() };
+				GenerateTangents(chunkVertices, std::span<const uint32_t>{ indices.data() + chunk.firstIndex, chunk.numTriangles * 3 }, chunk.firstVertex);
+
+				if (flipAxisAndWinding)
+				{
+					for (Vertex& vertex : chunkVertices)
+					{
+						vertex.position.z *= -1.f;
+						vertex.normal.z *= -1.f;
+						vertex.tangent.z *= -1.f;
+					}
+				}
+			}
+		}
+
+		bool Parse(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+			std::vector<Submesh>& submeshes, MeshMaterials& materials, bool flipAxisAndWinding)
+		{
+			submeshes.clear();
+			materials = MeshMaterials{};
+
+			const MappedFile file{ path };
+			if (!file.IsValid()) return false;
+
+			//1. Split the file at line boundaries and parse the chunks in parallel
+			std::vector<Chunk> chunks{ SplitInChunks(file.GetData(), file.GetData() + file.GetSize()) };
+			const size_t numChunks{ chunks.size() };
+			concurrency::parallel_for(size_t{}, numChunks, [&](size_t chunkIdx)
+			{
+				ParseChunk(chunks[chunkIdx]);
+			});
+
+			//2. Offsets of the chunks in the merged arrays and the material of every triangle. There is one chunk per half megabyte,
+			//so a sequential scan is cheaper than a parallel one even for files of several gigabytes
+			std::unordered_map<std::string, uint32_t> materialIndices{};
+			uint32_t currentMaterial{ NoMaterial };
+			const auto addMaterialRun{ [&](Chunk& chunk, size_t firstTriangle, size_t endTriangle)
+			{
+				if (endTriangle <= firstTriangle) return;
+				if (currentMaterial == NoMaterial)
+				{
+					currentMaterial = materialIndices.emplace("", static_cast<uint32_t>(materials.names.size())).first->second;
+					if (currentMaterial == materials.names.size()) materials.names.emplace_back();
+				}
+				chunk.materialRuns.push_back(MaterialRun{ firstTriangle, endTriangle, currentMaterial });
+			} };
+
+			size_t numPositions{}, numUVs{}, numNormals{}, numVertices{}, numIndices{};
+			for (Chunk& chunk : chunks)
+			{
+				chunk.firstPosition = numPositions;
+				chunk.firstUV = numUVs;
+				chunk.firstNormal = numNormals;
+				chunk.firstVertex = numVertices;
+				chunk.firstIndex = numIndices;
+
+				numPositions += chunk.positions.size();
+				numUVs += chunk.uvs.size();
+				numNormals += chunk.normals.size();
+				numVertices += chunk.corners.size();
+				numIndices += chunk.numTriangles * 3;
+
+				for (const std::string& library : chunk.materialLibraries)
+				{
+					std::string libraryPath{ GetRelativePath(path, library) };
+					if (std::find(materials.libraryPaths.begin(), materials.libraryPaths.end(), libraryPath) == materials.libraryPaths.end())
+					{
+						materials.libraryPaths.push_back(std::move(libraryPath));
+					}
+				}
+
+				size_t runStart{};
+				for (const MaterialSwitch& materialSwitch : chunk.materialSwitches)
+				{
+					addMaterialRun(chunk, runStart, materialSwitch.firstTriangle);
+					currentMaterial = materialIndices.emplace(materialSwitch.name, static_cast<uint32_t>(materials.names.size())).first->second;
+					if (currentMaterial == materials.names.size()) materials.names.push_back(materialSwitch.name);
+					runStart = materialSwitch.firstTriangle;
+				}
+				addMaterialRun(chunk, runStart, chunk.numTriangles);
+			}
+
+			//3. Merge the elements, faces can refer to those of any earlier chunk
+			std::vector<Vector3> positions(numPositions);
+			std::vector<Vector2> uvs(numUVs);
+			std::vector<Vector3> normals(numNormals);
+			concurrency::parallel_for(size_t{}, numChunks, [&](size_t chunkIdx)
+			{
+				Chunk& chunk{ chunks[chunkIdx] };
+				std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.firstPosition);
+				std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.firstUV);
+				std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.firstNormal);
+				chunk.positions = {};
+				chunk.uvs = {};
+				chunk.normals = {};
+			});
+
+			//4. Resolve the faces, every chunk writes its own range of vertices and indices
+			vertices.assign(numVertices, Vertex{});
+			indices.assign(numIndices, 0);
+			concurrency::parallel_for(size_t{}, numChunks, [&](size_t chunkIdx)
+			{
+				ResolveChunk(chunks[chunkIdx], positions, uvs, normals, vertices, indices, flipAxisAndWinding);
+			});
+
+			//5. Sort the triangles by material, so every material is one range of the indices
+			const uint32_t numMaterials{ static_cast<uint32_t>(materials.names.size()) };
+			if (numMaterials <= 1)
+			{
+				if (numIndices > 0) submeshes.push_back(Submesh{ 0, static_cast<uint32_t>(numIndices), 0 });
+				return true;
+			}
+
+			SortByMaterial(chunks, numMaterials, indices, submeshes);
+			return true;
+		}
+
+		bool ParseMaterials(const std::string& path, std::vector<Material>& materials)
+		{
+			const MappedFile file{ path };
+			if (!file.IsValid()) return false;
+
+			const char* pEnd{ file.GetData() + file.GetSize() };
+			Material* pMaterial{ nullptr };
+			for (const char* pLine{ file.GetData() }; pLine < pEnd;)
+			{
+				const char* pLineEnd{ FindLineEnd(pLine, pEnd) };
+				const char* pCur{ SkipBlanks(pLine, pLineEnd) };
+				pLine = pLineEnd + 1;
+
+				if (ReadKeyword(pCur, pLineEnd, "newmtl"))
+				{
+					pMaterial = &materials.emplace_back();
+					pMaterial->name = ReadWord(pCur, pLineEnd);
+					continue;
+				}
+				//Everything before the first material is ignored
+				if (!pMaterial) continue;
+
+				if (ReadKeyword(pCur, pLineEnd, "map_Kd")) pMaterial->diffuseMap = GetRelativePath(path, ReadLastWord(pCur, pLineEnd));
+				else if (ReadKeyword(pCur, pLineEnd, "map_Bump") || ReadKeyword(pCur, pLineEnd, "map_bump")
+					|| ReadKeyword(pCur, pLineEnd, "bump") || ReadKeyword(pCur, pLineEnd, "norm"))
+				{
+					pMaterial->normalMap = GetRelativePath(path, ReadLastWord(pCur, pLineEnd));
+				}
+				else if (ReadKeyword(pCur, pLineEnd, "map_Ks")) pMaterial->specularMap = GetRelativePath(path, ReadLastWord(pCur, pLineEnd));
+				else if (ReadKeyword(pCur, pLineEnd, "map_Ns")) pMaterial->glossinessMap = GetRelativePath(path, ReadLastWord(pCur, pLineEnd));
+				else if (ReadKeyword(pCur, pLineEnd, "map_d")) pMaterial->opacityMap = GetRelativePath(path, ReadLastWord(pCur, pLineEnd));
+				else if (ReadKeyword(pCur, pLineEnd, "d")) ParseFloat(pCur, pLineEnd, pMaterial->opacity);
+				else if (ReadKeyword(pCur, pLineEnd, "Tr"))
+				{
+					//Transparency is the inverse of d
+					float transparency{};
+					ParseFloat(pCur, pLineEnd, transparency);
+					pMaterial->opacity = 1.f - transparency;
+				}
+			}
+			return true;
+		}
+	}
+}
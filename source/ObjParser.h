@@ -0,0 +1,36 @@
+#pragma once
+#include "DataTypes.h"
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	//Wavefront OBJ parser. The file is memory mapped and scanned twice: the first pass only counts lines and face corners,
+	//so every array is allocated once, the second pass parses them with std::from_chars
+	namespace ObjParser
+	{
+		//Material of an MTL file. The maps are relative to the working directory and empty when the material has none
+		struct Material
+		{
+			std::string name{};
+			std::string diffuseMap{};
+			std::string normalMap{};
+			std::string specularMap{};
+			std::string glossinessMap{};
+			std::string opacityMap{};
+			float opacity{ 1.f };
+		};
+
+		//Reads positions, uvs, normals and faces, every face corner becomes its own vertex and faces with more than
+		//three corners are split in a fan. Tangents are generated from the uvs.
+		//The triangles are sorted by the material usemtl assigns them, with one submesh per material. Materials are numbered
+		//in the order they are first used, faces before the first usemtl get a material without a name.
+		//The paths of the mtllib lines are made relative to the working directory.
+		//flipAxisAndWinding negates z and reverses the winding, to go from the right handed space of the file to ours
+		bool Parse(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+			std::vector<Submesh>& submeshes, MeshMaterials& materials, bool flipAxisAndWinding = true);
+
+		//Appends the materials of an MTL file, the options in front of the file name of a map are skipped
+		bool ParseMaterials(const std::string& path, std::vector<Material>& materials);
+	}
+}
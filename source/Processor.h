@@ -18,7 +18,8 @@ namespace dae
 		Processor& operator=(const Processor& processor) = delete;
 		Processor& operator=(Processor&& processor) noexcept = delete;
 
-		virtual void Render(std::vector<Mesh*>& meshes, const Camera* camera) = 0;
+		//meshes are the meshes in view, shadowCasters all meshes of the scene since casters outside of the view still cast shadows into it
+		virtual void Render(std::vector<Mesh*>& meshes, const std::vector<Mesh*>& shadowCasters, const std::vector<Light>& lights, const Camera* camera) = 0;
 		virtual void ToggleBackgroundColor(bool useUniformBg) = 0;
 
 	protected:
@@ -2,6 +2,8 @@
 #include "ProcessorCPU.h"
 #include "Utils.h"
 #include "Camera.h"
+#include "DepthRasterizer.h"
+#include "Effect.h"
 
 
 //Multithreading includes
@@ -12,6 +14,7 @@ namespace dae
 {
 	ProcessorCPU::ProcessorCPU(SDL_Window* pWindow)
 		:Processor{ pWindow }
+		,m_FrameArena{ m_FrameArenaCapacity, true }
 	{
 		//Create Buffers
 		m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
@@ -21,8 +24,13 @@ namespace dae
 		const int nrPixels{ m_Width * m_Height };
 		m_pDepthBufferPixels = new float[nrPixels];
 		std::fill_n(m_pDepthBufferPixels, nrPixels, 1.f);
+		m_pShadowMapPixels = new float[m_ShadowMapSize * m_ShadowMapSize];
 
 		m_BackgroundColor = m_SoftwareColor * 255.f; //Multiply color to fit the FillRect function
+
+		//Light tiles cover the whole screen, the last row and column can be partial
+		m_NumLightTilesX = (m_Width + m_LightTileSize - 1) / m_LightTileSize;
+		m_NumLightTilesY = (m_Height + m_LightTileSize - 1) / m_LightTileSize;
 	}
 
 	ProcessorCPU::~ProcessorCPU()
@@ -30,9 +38,12 @@ namespace dae
 		//Free resources
 		delete[] m_pDepthBufferPixels;
 		m_pDepthBufferPixels = nullptr;
+
+		delete[] m_pShadowMapPixels;
+		m_pShadowMapPixels = nullptr;
 	}
 
-	void ProcessorCPU::Render(std::vector<Mesh*>& meshes, const Camera* camera)
+	void ProcessorCPU::Render(std::vector<Mesh*>& meshes, const std::vector<Mesh*>& shadowCasters, const std::vector<Light>& lights, const Camera* camera)
 	{
 		//Lock Backbuffer
 		SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, 
@@ -44,9 +55,17 @@ namespace dae
 		std::fill_n(m_pDepthBufferPixels, nrPixels, 1.f);
 		SDL_LockSurface(m_pBackBuffer);
 
+		//Lights are read by the light culling and the pixel shading stage
+		m_pLights = &lights;
+		m_CameraOrigin = camera->origin;
+		RenderShadowMap(shadowCasters, lights);
+
 		//Projection Stage
 		ProjectMesh(meshes, camera);
 
+		//Release all transient data of this frame
+		m_FrameArena.Reset();
+
 		//Update SDL Surface
 		SDL_UnlockSurface(m_pBackBuffer);
 		SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
@@ -108,34 +127,177 @@ namespace dae
 	}
 
 
-	void ProcessorCPU::VertexTransformationFunction(Mesh* pMesh, const Camera* camera) const
+	inline void ProcessorCPU::TransformVertex(const Vertex& vertexIn, VertexOut& vertexOut, Vector2& screenVertex,
+		const Matrix& worldViewProjectionMatrix, const Matrix& worldMatrix, const Vector3& cameraOrigin) const
+	{
+		//Transform position based on worldviewproj matrix
+		vertexOut.position = worldViewProjectionMatrix.TransformPoint(Vector4{ vertexIn.position, 1.f });
+
+		//Perspective Divide
+		const float perspectiveDiv{ 1.f / vertexOut.position.w };
+		vertexOut.position.x *= perspectiveDiv;
+		vertexOut.position.y *= perspectiveDiv;
+		vertexOut.position.z *= perspectiveDiv;
+
+		//Transform properties based on the mesh worldmatrix
+		vertexOut.uv = vertexIn.uv;
+		vertexOut.normal = worldMatrix.TransformVector(vertexIn.normal);
+		vertexOut.tangent = worldMatrix.TransformVector(vertexIn.tangent);
+		vertexOut.viewDirection = (worldMatrix.TransformPoint(vertexIn.position) - cameraOrigin);
+
+		//Convert to screen space in the same pass
+		screenVertex = Vector2{
+			(vertexOut.position.x + 1) * 0.5f * m_Width,
+			(1 - vertexOut.position.y) * 0.5f * m_Height
+		};
+	}
+
+	inline void ProcessorCPU::TransformVertex(const QuantizedVertex& vertexIn, VertexOut& vertexOut, Vector2& screenVertex,
+		const Matrix& positionWorldViewProjectionMatrix, const Matrix& positionWorldMatrix, const Matrix& worldMatrix, const Vector3& cameraOrigin) const
+	{
+		//Transform the stored position, the matrix decodes it on the way
+		const Vector3 position{ VertexQuantization::LoadPosition(vertexIn) };
+		vertexOut.position = positionWorldViewProjectionMatrix.TransformPoint(Vector4{ position, 1.f });
+
+		//Perspective Divide
+		const float perspectiveDiv{ 1.f / vertexOut.position.w };
+		vertexOut.position.x *= perspectiveDiv;
+		vertexOut.position.y *= perspectiveDiv;
+		vertexOut.position.z *= perspectiveDiv;
+
+		//Decode the properties and transform them based on the mesh worldmatrix
+		vertexOut.uv = VertexQuantization::DecodeUV(vertexIn);
+		vertexOut.normal = worldMatrix.TransformVector(VertexQuantization::DecodeDirection(vertexIn.normal));
+		vertexOut.tangent = worldMatrix.TransformVector(VertexQuantization::DecodeDirection(vertexIn.tangent));
+		vertexOut.viewDirection = (positionWorldMatrix.TransformPoint(position) - cameraOrigin);
+
+		//Convert to screen space in the same pass
+		screenVertex = Vector2{
+			(vertexOut.position.x + 1) * 0.5f * m_Width,
+			(1 - vertexOut.position.y) * 0.5f * m_Height
+		};
+	}
+
+	uint32_t ProcessorCPU::SelectLod(const Mesh* pMesh, uint32_t instanceIdx, const Camera* camera) const
+	{
+		const std::vector<MeshLod>& lods{ pMesh->GetLods() };
+		if (lods.size() <= 1) return 0;
+
+		//Distance from the camera to the bounding sphere of the instance
+		const BoundingBox& bounds{ pMesh->GetInstanceBounds()[instanceIdx] };
+		const float distance{ std::max((bounds.GetCenter() - camera->origin).Magnitude() - bounds.GetExtent().Magnitude(), camera->nearPlane) };
+
+		//Number of pixels an object space unit covers at that distance
+		const float worldScale{ GeometryUtils::GetMaxScale(pMesh->GetInstanceWorldMatrices()[instanceIdx]) };
+		const float pixelsPerUnit{ worldScale * camera->GetProjectionMatrix()[1].y * m_Height * 0.5f / distance };
+
+		//Pick the coarsest level whose error stays below the threshold on screen
+		uint32_t lodIdx{};
+		while (lodIdx + 1 < lods.size() && lods[lodIdx + 1].error * pixelsPerUnit < m_LodPixelError) ++lodIdx;
+		return lodIdx;
+	}
+
+	ProcessorCPU::ProjectedMesh ProcessorCPU::VertexTransformationFunction(Mesh* pMesh, uint32_t instanceIdx, uint32_t lodIdx, 
+		const Camera* camera, const Frustum& frustum)
 	{
-		pMesh->GetVerticesOut().clear();
-		pMesh->GetVerticesOut().reserve(pMesh->GetVertices().size());
-		const Matrix worldViewProjectionMatrix{ pMesh->GetWorldMatrix() * camera->GetViewMatrix() * camera->GetProjectionMatrix()};
-		
-		for (const auto& vertexIn : pMesh->GetVertices())
+		const std::span<const Vertex> vertices{ pMesh->GetVertices() };
+		const Matrix& worldMatrix{ pMesh->GetInstanceWorldMatrices()[instanceIdx] };
+		const ColorRGB& tint{ pMesh->GetInstances()[instanceIdx].tint };
+		const Matrix worldViewProjectionMatrix{ worldMatrix * camera->GetViewMatrix() * camera->GetProjectionMatrix()};
+
+		//Quantized vertices are decoded while they are transformed, the decoding of the positions is folded in the matrices
+		const bool isQuantized{ pMesh->GetVertexFormat() == VertexFormat::Quantized };
+		const std::span<const QuantizedVertex> quantizedVertices{ pMesh->GetQuantizedVertices() };
+		const Matrix positionWorldMatrix{ pMesh->GetPositionDecodeMatrix() * worldMatrix };
+		const Matrix positionWorldViewProjectionMatrix{ pMesh->GetPositionDecodeMatrix() * worldViewProjectionMatrix };
+		const auto transformVertex{ [&](uint32_t vertexIdx, VertexOut& vertexOut, Vector2& screenVertex)
 		{
-			VertexOut vertexOut{ Vector4{ vertexIn.position, 1.f}, vertexIn.uv, vertexIn.normal, 
-				vertexIn.tangent, vertexIn.viewDirection };
+			if (isQuantized)
+			{
+				TransformVertex(quantizedVertices[vertexIdx], vertexOut, screenVertex,
+					positionWorldViewProjectionMatrix, positionWorldMatrix, worldMatrix, camera->origin);
+			}
+			else
+			{
+				TransformVertex(vertices[vertexIdx], vertexOut, screenVertex, worldViewProjectionMatrix, worldMatrix, camera->origin);
+			}
+		} };
 
-			//Transform position based on worldviewproj matrix
-			vertexOut.position = worldViewProjectionMatrix.TransformPoint(vertexOut.position);
+		//Triangle lists are split in meshlets, only the vertices of the meshlets that survive culling are transformed
+		const std::vector<MeshLod>& lods{ pMesh->GetLods() };
+		if (pMesh->GetPrimitiveTopology() == PrimitiveTopology::TriangleList && lodIdx < lods.size())
+		{
+			const MeshLod& lod{ lods[lodIdx] };
+			const std::span<const Meshlet> meshlets{ lod.meshlets };
+			const std::span<const uint32_t> meshletVertices{ lod.meshletVertices };
+			const std::span<uint32_t> visibleMeshlets{ m_FrameArena.Allocate<uint32_t>(meshlets.size()) };
+			uint32_t numVisibleMeshlets{};
+
+			//Bounding spheres grow with the largest scale of the world matrix
+			const float worldScale{ GeometryUtils::GetMaxScale(worldMatrix) };
+
+			//The normal cones only keep their angle when the scale is uniform, other instances skip cone culling.
+			//Mirroring flips the winding, so the faces culled by the rasterizer look along the opposite axis
+			const bool useConeCulling{ GeometryUtils::IsUniformScale(worldMatrix) };
+			const float coneAxisSign{ Vector3::Dot(Vector3::Cross(worldMatrix.GetAxisX(), worldMatrix.GetAxisY()), worldMatrix.GetAxisZ()) < 0.f ? -1.f : 1.f };
+
+			//Cluster culling: reject meshlets outside of the frustum or facing away from the camera.
+			//Every submesh culls with the cull mode of its own effect, the visible meshlets stay in ascending order
+			const std::span<const uint32_t> submeshMeshlets{ lod.submeshMeshlets };
+			for (uint32_t submeshIdx{}; submeshIdx + 1 < submeshMeshlets.size(); ++submeshIdx)
+			{
+				const CullMode cullMode{ pMesh->GetSubmeshEffect(submeshIdx)->GetCullMode() };
+
+				for (uint32_t meshletIdx{ submeshMeshlets[submeshIdx] }; meshletIdx < submeshMeshlets[submeshIdx + 1]; ++meshletIdx)
+				{
+					const Meshlet& meshlet{ meshlets[meshletIdx] };
+					const Vector3 center{ worldMatrix.TransformPoint(meshlet.center) };
+					const float radius{ meshlet.radius * worldScale };
 
-			//Perspective Divide
-			const float perspectiveDiv{ 1.f / vertexOut.position.w };
-			vertexOut.position.x *= perspectiveDiv;
-			vertexOut.position.y *= perspectiveDiv;
-			vertexOut.position.z *= perspectiveDiv;
+					if (!GeometryUtils::IsSphereInFrustum(frustum, center, radius)) continue;
+					if (useConeCulling && meshlet.coneCutoff < 1.f && MeshletUtils::IsConeCulled(center, radius,
+						worldMatrix.TransformVector(meshlet.coneAxis).Normalized() * coneAxisSign, meshlet.coneCutoff, camera->origin, cullMode)) continue;
 
-			//Transform properties based on the mesh worldmatrix
-			vertexOut.normal = pMesh->GetWorldMatrix().TransformVector(vertexIn.normal);
-			vertexOut.tangent = pMesh->GetWorldMatrix().TransformVector(vertexIn.tangent);
-			vertexOut.viewDirection = (pMesh->GetWorldMatrix().TransformPoint(vertexIn.position) - camera->origin);
+					visibleMeshlets[numVisibleMeshlets++] = meshletIdx;
+				}
+			}
 
-			//Add the vertex to the output
-			pMesh->GetVerticesOut().emplace_back(vertexOut);
+			//Every meshlet owns a range of the output arrays, so meshlets can be transformed in parallel
+			const std::span<VertexOut> verticesOut{ m_FrameArena.Allocate<VertexOut>(meshletVertices.size()) };
+			const std::span<Vector2> screenVertices{ m_FrameArena.Allocate<Vector2>(meshletVertices.size()) };
+
+			concurrency::parallel_for(0u, numVisibleMeshlets, [&](uint32_t visibleIdx)
+			{
+				const Meshlet& meshlet{ meshlets[visibleMeshlets[visibleIdx]] };
+				for (uint32_t vertIdx{ meshlet.vertexOffset }; vertIdx < meshlet.vertexOffset + meshlet.vertexCount; ++vertIdx)
+				{
+					transformVertex(meshletVertices[vertIdx], verticesOut[vertIdx], screenVertices[vertIdx]);
+				}
+			});
+
+			return ProjectedMesh{ verticesOut, screenVertices, visibleMeshlets.first(numVisibleMeshlets), &lod, tint };
 		}
+
+		const uint32_t numVertices{ static_cast<uint32_t>(isQuantized ? quantizedVertices.size() : vertices.size()) };
+
+		//Allocate the output arrays up front so every chunk can write to its own range
+		const std::span<VertexOut> verticesOut{ m_FrameArena.Allocate<VertexOut>(numVertices) };
+		const std::span<Vector2> screenVertices{ m_FrameArena.Allocate<Vector2>(numVertices) };
+
+		//Split the vertices in chunks that are transformed in parallel
+		const uint32_t numChunks{ (numVertices + m_VertexChunkSize - 1) / m_VertexChunkSize };
+		concurrency::parallel_for(0u, numChunks, [&](uint32_t chunkIdx)
+		{
+			const uint32_t chunkStart{ chunkIdx * m_VertexChunkSize };
+			const uint32_t chunkEnd{ std::min(chunkStart + m_VertexChunkSize, numVertices) };
+
+			for (uint32_t vertIdx{ chunkStart }; vertIdx < chunkEnd; ++vertIdx)
+			{
+				transformVertex(vertIdx, verticesOut[vertIdx], screenVertices[vertIdx]);
+			}
+		});
+
+		return ProjectedMesh{ verticesOut, screenVertices, {}, nullptr, tint };
 	}
 
 	inline bool ProcessorCPU::IsValidPixelForCullMode(CullMode mode, float areaV0V1, float areaV1V2, float areaV2V0) const
@@ -160,72 +322,324 @@ namespace dae
 
 	void ProcessorCPU::ProjectMesh(std::vector<Mesh*>& meshes, const Camera* camera)
 	{
-		for (Mesh* pMesh : meshes)
+		//Frustum planes in world space, used to cull instances and meshlets before their vertices are transformed
+		const Frustum frustum{ GeometryUtils::ExtractFrustum(camera->GetViewMatrix() * camera->GetProjectionMatrix()) };
+
+		//Every instance of every mesh is a job for the vertex stage, in the order they have to be rasterized
+		uint32_t numInstances{};
+		for (const Mesh* pMesh : meshes)
 		{
 			//Used to not render the fireFX when turned off
-			if (!pMesh->ShouldRender()) continue;
-			
-			//Transform the mesh vertices
-			VertexTransformationFunction(pMesh, camera);
+			if (pMesh->ShouldRender()) numInstances += static_cast<uint32_t>(pMesh->GetInstances().size());
+		}
 
-			//Create the screen
-			std::vector<Vector2> screenVertices;
-			screenVertices.reserve(pMesh->GetVerticesOut().size());
-			for (const auto& vertexNdc : pMesh->GetVerticesOut())
+		const std::span<InstanceRef> instances{ m_FrameArena.Allocate<InstanceRef>(numInstances) };
+		uint32_t instanceRefIdx{};
+		for (uint32_t meshIdx{}; meshIdx < meshes.size(); ++meshIdx)
+		{
+			if (!meshes[meshIdx]->ShouldRender()) continue;
+
+			const uint32_t numMeshInstances{ static_cast<uint32_t>(meshes[meshIdx]->GetInstances().size()) };
+			for (uint32_t instanceIdx{}; instanceIdx < numMeshInstances; ++instanceIdx)
 			{
-				screenVertices.emplace_back(
-					Vector2{
-						(vertexNdc.position.x + 1) * 0.5f * m_Width,
-						(1 - vertexNdc.position.y) * 0.5f * m_Height
+				instances[instanceRefIdx++] = InstanceRef{ meshIdx, instanceIdx };
+			}
+		}
+
+		//Vertex stage: all instances are culled and transformed at the same time, each instance splits its own vertices in parallel as well.
+		//The results are kept for the whole frame, so the depth prepass and the color pass rasterize the same projected vertices
+		const std::span<ProjectedMesh> projectedMeshes{ m_FrameArena.Allocate<ProjectedMesh>(numInstances) };
+		concurrency::parallel_for(0u, numInstances, [&](uint32_t jobIdx)
+		{
+			const InstanceRef& instance{ instances[jobIdx] };
+			Mesh* pMesh{ meshes[instance.meshIdx] };
+
+			projectedMeshes[jobIdx] = ProjectedMesh{};
+			if (!GeometryUtils::IsBoxInFrustum(frustum, pMesh->GetInstanceBounds()[instance.instanceIdx])) return;
+			//Distant instances use a simplified version of the mesh
+			const uint32_t lodIdx{ SelectLod(pMesh, instance.instanceIdx, camera) };
+			projectedMeshes[jobIdx] = VertexTransformationFunction(pMesh, instance.instanceIdx, lodIdx, camera, frustum);
+		});
+
+		//Depth prepass: the meshes that write depth fill the depth buffer first. 
+		//This gives every tile its depth range for the light culling and the color pass only shades the visible opaque pixels
+		RasterizeInstances(meshes, instances, projectedMeshes, RenderPass::DepthPrepass);
+
+		//The depth visualization only needs the prepass
+		if (m_RenderMode == RenderMode::DepthBuffer && !m_ShouldRenderBoundingBoxes)
+		{
+			WriteDepthView();
+			return;
+		}
+
+		//The transparent submeshes of all meshes blend on top of the opaque ones, they do not write depth
+		CullLights(camera);
+		RasterizeInstances(meshes, instances, projectedMeshes, RenderPass::Opaque);
+		RasterizeInstances(meshes, instances, projectedMeshes, RenderPass::Transparent);
+	}
+
+	void ProcessorCPU::RasterizeInstances(std::vector<Mesh*>& meshes, std::span<const InstanceRef> instances, std::span<const ProjectedMesh> projectedMeshes,
+		RenderPass pass)
+	{
+		//Instances are rasterized in order, so the transparent submeshes of an instance blend on top of those of the instances before it
+		for (uint32_t instanceRefIdx{}; instanceRefIdx < instances.size(); ++instanceRefIdx)
+		{
+			//Culled instances have no projected vertices
+			if (projectedMeshes[instanceRefIdx].verticesOut.empty()) continue;
+			RasterizeMesh(meshes[instances[instanceRefIdx].meshIdx], projectedMeshes[instanceRefIdx], pass);
+		}
+	}
+
+	void ProcessorCPU::RenderShadowMap(const std::vector<Mesh*>& shadowCasters, const std::vector<Light>& lights)
+	{
+		//The first directional light that casts shadows gets the shadow map
+		m_HasShadowMap = false;
+		if (m_RenderMode != RenderMode::FinalColor) return;
+
+		const auto shadowLightIt{ std::find_if(lights.begin(), lights.end(), [](const Light& light)
+		{
+			return light.type == LightType::Directional && light.castsShadows;
+		}) };
+		if (shadowLightIt == lights.end()) return;
+
+		//Fit the light frustum around the bounding sphere of all meshes that write depth, so it does not change with the view
+		BoundingBox casterBounds{};
+		for (const Mesh* pMesh : shadowCasters)
+		{
+			if (!pMesh->ShouldRender() || !pMesh->UseDepthBuffer()) continue;
+			for (const BoundingBox& instanceBounds : pMesh->GetInstanceBounds())
+			{
+				casterBounds.Grow(instanceBounds);
+			}
+		}
+		if (casterBounds.min.x > casterBounds.max.x) return;
+
+		const Vector3 center{ casterBounds.GetCenter() };
+		const float radius{ casterBounds.GetExtent().Magnitude() };
+		const Vector3 lightDirection{ shadowLightIt->direction.Normalized() };
+		const Vector3 up{ std::abs(lightDirection.y) < 0.99f ? Vector3::UnitY : Vector3::UnitZ };
+
+		const Matrix viewMatrix{ Matrix::CreateLookAtLH(center - lightDirection * radius, lightDirection, up) };
+		const Matrix projectionMatrix{ Matrix::CreateOrthographicLH(2.f * radius, 2.f * radius, 0.f, 2.f * radius) };
+
+		m_ShadowMap.target = DepthTarget{ m_pShadowMapPixels, m_ShadowMapSize, m_ShadowMapSize };
+		m_ShadowMap.viewProjection = viewMatrix * projectionMatrix;
+		m_ShadowMap.lightIdx = static_cast<uint32_t>(shadowLightIt - lights.begin());
+		m_ShadowMap.normalOffset = 1.5f * 2.f * radius / m_ShadowMapSize;
+		m_ShadowMap.depthBias = 0.5f / m_ShadowMapSize;
+
+		DepthRasterizer::Clear(m_ShadowMap.target);
+		DepthRasterizer::RenderMeshes(shadowCasters, m_ShadowMap.viewProjection, m_ShadowMap.target, m_FrameArena);
+		m_HasShadowMap = true;
+	}
+
+	void ProcessorCPU::CullLights(const Camera* camera)
+	{
+		const std::vector<Light>& lights{ *m_pLights };
+		const uint32_t numLights{ static_cast<uint32_t>(lights.size()) };
+		const uint32_t numTiles{ static_cast<uint32_t>(m_NumLightTilesX * m_NumLightTilesY) };
+
+		//Every tile can hold all lights, so the tiles are culled in parallel without sharing a list
+		m_TileLightStride = numLights;
+		m_TileLightIndices = m_FrameArena.Allocate<uint32_t>(numTiles * numLights);
+		m_TileLightCounts = m_FrameArena.Allocate<uint32_t>(numTiles);
+
+		//Point and spot lights are culled as spheres in view space, directional lights reach every tile
+		const Matrix& viewMatrix{ camera->GetViewMatrix() };
+		const std::span<Vector3> viewPositions{ m_FrameArena.Allocate<Vector3>(numLights) };
+		for (uint32_t lightIdx{}; lightIdx < numLights; ++lightIdx)
+		{
+			viewPositions[lightIdx] = viewMatrix.TransformPoint(lights[lightIdx].position);
+		}
+
+		//Undoes the projection of the depth buffer, z = near * far / (far - depth * (far - near))
+		const float nearPlane{ camera->nearPlane };
+		const float farPlane{ camera->farPlane };
+		const auto toViewDepth = [nearPlane, farPlane](float depth)
+		{
+			return nearPlane * farPlane / (farPlane - depth * (farPlane - nearPlane));
+		};
+
+		//Slope of the view rays through the edges of the screen, x = ndcX * z / xScale
+		const Matrix& projectionMatrix{ camera->GetProjectionMatrix() };
+		const float invScaleX{ 1.f / projectionMatrix[0].x };
+		const float invScaleY{ 1.f / projectionMatrix[1].y };
+
+		concurrency::parallel_for(0u, numTiles, [&](uint32_t tileIdx)
+		{
+			const int tileX{ static_cast<int>(tileIdx) % m_NumLightTilesX };
+			const int tileY{ static_cast<int>(tileIdx) / m_NumLightTilesX };
+			const int pixelMinX{ tileX * m_LightTileSize };
+			const int pixelMinY{ tileY * m_LightTileSize };
+			const int pixelMaxX{ std::min(pixelMinX + m_LightTileSize, m_Width) };
+			const int pixelMaxY{ std::min(pixelMinY + m_LightTileSize, m_Height) };
+
+			//Depth range of the prepass, cleared pixels are not covered by any opaque mesh
+			float minDepth{ 1.f };
+			float maxDepth{ 0.f };
+			for (int py{ pixelMinY }; py < pixelMaxY; ++py)
+			{
+				for (int px{ pixelMinX }; px < pixelMaxX; ++px)
+				{
+					const float depth{ m_pDepthBufferPixels[px + py * m_Width] };
+					if (depth >= 1.f) continue;
+					minDepth = std::min(minDepth, depth);
+					maxDepth = std::max(maxDepth, depth);
+				}
+			}
+			const bool hasGeometry{ minDepth <= maxDepth };
+			const float minViewDepth{ hasGeometry ? toViewDepth(minDepth) : 0.f };
+			const float maxViewDepth{ hasGeometry ? toViewDepth(maxDepth) : 0.f };
+
+			//Side planes of the tile frustum through the camera, the normals point inwards
+			const float left{ (2.f * pixelMinX / m_Width - 1.f) * invScaleX };
+			const float right{ (2.f * pixelMaxX / m_Width - 1.f) * invScaleX };
+			const float top{ (1.f - 2.f * pixelMinY / m_Height) * invScaleY };
+			const float bottom{ (1.f - 2.f * pixelMaxY / m_Height) * invScaleY };
+			const Vector3 planeNormals[4]
+			{
+				Vector3{ 1.f, 0.f, -left }.Normalized(),
+				Vector3{ -1.f, 0.f, right }.Normalized(),
+				Vector3{ 0.f, -1.f, top }.Normalized(),
+				Vector3{ 0.f, 1.f, -bottom }.Normalized()
+			};
+
+			uint32_t* pTileLights{ m_TileLightIndices.data() + tileIdx * m_TileLightStride };
+			uint32_t numTileLights{};
+			for (uint32_t lightIdx{}; lightIdx < numLights; ++lightIdx)
+			{
+				const Light& light{ lights[lightIdx] };
+				if (light.type != LightType::Directional)
+				{
+					//Spot lights are culled with the sphere around their full range
+					if (!hasGeometry) continue;
+
+					const Vector3& center{ viewPositions[lightIdx] };
+					if (center.z + light.range < minViewDepth || center.z - light.range > maxViewDepth) continue;
+
+					bool isOutside{ false };
+					for (const Vector3& planeNormal : planeNormals)
+					{
+						if (Vector3::Dot(planeNormal, center) < -light.range)
+						{
+							isOutside = true;
+							break;
+						}
 					}
-				);
+					if (isOutside) continue;
+				}
+
+				pTileLights[numTileLights++] = lightIdx;
+			}
+			m_TileLightCounts[tileIdx] = numTileLights;
+		});
+	}
+
+	ProcessorCPU::RasterizeTriangleFunction ProcessorCPU::SelectRasterizeTriangle(const Effect* pEffect) const
+	{
+		//One instantiation per combination of the options, the index of a permutation is
+		//renderBoundingBoxes + 2 * (useDepthBuffer + 2 * cullMode)
+		constexpr size_t numPermutations{ 2 * 2 * static_cast<size_t>(CullMode::COUNT) };
+
+		static constexpr std::array<RasterizeTriangleFunction, numPermutations> rasterizeTrianglePermutations
+		{
+			[]<size_t... permutationIdx>(std::index_sequence<permutationIdx...>)
+			{
+				return std::array<RasterizeTriangleFunction, numPermutations>
+				{
+					&ProcessorCPU::RasterizeTriangle<
+						permutationIdx % 2 == 1,
+						permutationIdx / 2 % 2 == 1,
+						static_cast<CullMode>(permutationIdx / 4)>...
+				};
+			}(std::make_index_sequence<numPermutations>{})
+		};
+
+		const size_t permutationIdx
+		{
+			static_cast<size_t>(m_ShouldRenderBoundingBoxes) +
+			2 * (static_cast<size_t>(pEffect->UseDepthBuffer()) +
+			2 * static_cast<size_t>(pEffect->GetCullMode()))
+		};
+		return rasterizeTrianglePermutations[permutationIdx];
+	}
+
+	void ProcessorCPU::RasterizeMesh(Mesh* pMesh, const ProjectedMesh& projectedMesh, RenderPass pass)
+	{
+		const std::span<const Submesh> submeshes{ pMesh->GetSubmeshes() };
+		for (uint32_t submeshIdx{}; submeshIdx < submeshes.size(); ++submeshIdx)
+		{
+			if (!pMesh->IsSubmeshInPass(submeshIdx, pass)) continue;
+			if (pass == RenderPass::DepthPrepass)
+			{
+				RasterizeSubmeshDepth(pMesh, projectedMesh, submeshIdx);
+				continue;
 			}
 
+			//Every submesh is rasterized with the effect of its material
+			Effect* pEffect{ pMesh->GetSubmeshEffect(submeshIdx) };
+
+			//The options can only change between frames, so the permutations are picked once for the whole submesh.
+			//The shading kernel is passed down with the triangles, other meshes can use the same effect at the same time
+			const RasterizeTriangleFunction rasterizeTriangle{ SelectRasterizeTriangle(pEffect) };
+			const SubmeshShading shading{ pEffect, pEffect->SelectShadeBatch(m_ShadingMode, m_ShouldRenderNormals) };
+
 			//Check the mesh topology
 			switch (pMesh->GetPrimitiveTopology())
 			{
 				case PrimitiveTopology::TriangleStrip:
 				{
-					//Check if the mesh wants to use multithreading
+					const std::span<const uint32_t> indices{ pMesh->GetIndices().subspan(submeshes[submeshIdx].indexOffset, submeshes[submeshIdx].indexCount) };
+					const auto rasterizeStripTriangle = [&, this](uint32_t vertIdx)
+					{
+						//The vertices are swapped when vertIdx is uneven to keep the winding order of the strip
+						const bool swapVertices{ (vertIdx & 1) == 1 };
+						(this->*rasterizeTriangle)(shading, projectedMesh.verticesOut.data(), projectedMesh.screenVertices.data(), projectedMesh.tint,
+							indices[vertIdx + swapVertices * 2], indices[vertIdx + 1], indices[vertIdx + !swapVertices * 2]);
+					};
+
+					//Check if the effect wants to use multithreading
 					//Cannot be used with transparent objects due to variable processing time
-					if (pMesh->UseMultiThreading())
+					const uint32_t numIndices{ static_cast<uint32_t>(indices.size() < 2 ? 0 : indices.size() - 2) };
+					if (pEffect->UseMultiThreading())
 					{
-						const uint32_t numIndices{ static_cast<uint32_t>(pMesh->GetIndices().size() - 2) };
 						//Go over the indices one by one for the strip topology
-						concurrency::parallel_for(0u, numIndices, [=, this](uint32_t vertIdx)
-						{
-							RasterizeTriangle(pMesh, screenVertices, vertIdx, vertIdx & 1);
-						});
+						concurrency::parallel_for(0u, numIndices, rasterizeStripTriangle);
 					}
 					else
 					{
 						//Go over the indices one by one for the strip topology
-						for (uint32_t vertIdx{}; vertIdx < pMesh->GetIndices().size() - 2; ++vertIdx)
+						for (uint32_t vertIdx{}; vertIdx < numIndices; ++vertIdx)
 						{
-							RasterizeTriangle(pMesh, screenVertices, vertIdx, vertIdx % 2);
+							rasterizeStripTriangle(vertIdx);
 						}
 					}
 					break;
 				}
 				case PrimitiveTopology::TriangleList:
 				{
-					//Check if the mesh wants to use multithreading
+					//Meshlets that survived culling are the unit of parallel work, those of the submesh are a range of them
+					if (!projectedMesh.pLod) break;
+					const std::span<const uint32_t> submeshMeshlets{ projectedMesh.pLod->submeshMeshlets };
+					const auto visibleBegin{ std::lower_bound(projectedMesh.visibleMeshlets.begin(), projectedMesh.visibleMeshlets.end(), submeshMeshlets[submeshIdx]) };
+					const auto visibleEnd{ std::lower_bound(visibleBegin, projectedMesh.visibleMeshlets.end(), submeshMeshlets[submeshIdx + 1]) };
+					const std::span<const uint32_t> visibleMeshlets{ visibleBegin, visibleEnd };
+					const uint32_t numVisibleMeshlets{ static_cast<uint32_t>(visibleMeshlets.size()) };
+
+					//Check if the effect wants to use multithreading
 					//Cannot be used with transparent objects due to variable processing time
-					if (pMesh->UseMultiThreading())
+					if (pEffect->UseMultiThreading())
 					{
-						//Go over the indices in steps of 3 for the list topology
-						const uint32_t numTriangles{ static_cast<uint32_t>(pMesh->GetIndices().size() - 2) / 3 };
-						concurrency::parallel_for(0u, numTriangles, [=, this](uint32_t vertIdx)
+						concurrency::parallel_for(0u, numVisibleMeshlets, [&, this](uint32_t visibleIdx)
 						{
-								RasterizeTriangle(pMesh, screenVertices, vertIdx * 3);
+							RasterizeMeshlet(shading, projectedMesh, visibleMeshlets[visibleIdx], rasterizeTriangle);
 						});
 					}
 					else
 					{
-						//Go over the indices in steps of 3 for the list topology
-						for (uint32_t vertIdx{}; vertIdx < pMesh->GetIndices().size() - 2; vertIdx += 3)
+						for (uint32_t visibleIdx{}; visibleIdx < numVisibleMeshlets; ++visibleIdx)
 						{
-							RasterizeTriangle(pMesh, screenVertices, vertIdx);
+							RasterizeMeshlet(shading, projectedMesh, visibleMeshlets[visibleIdx], rasterizeTriangle);
 						}
 					}
 					break;
@@ -235,28 +649,113 @@ namespace dae
 		}
 	}
 
-	void ProcessorCPU::RasterizeTriangle(Mesh* pMesh, const std::vector<Vector2>& screenVertices, uint32_t vertIdx, bool swapVertices)
+	void ProcessorCPU::RasterizeMeshlet(const SubmeshShading& shading, const ProjectedMesh& projectedMesh, uint32_t meshletIdx, RasterizeTriangleFunction rasterizeTriangle)
 	{
-		//Get vertex from the index vector.
-		//The vertices will be swapped when vertIdx is uneven and the TriangleStrip primitive topology is set
-		const uint32_t vertIdx0{ pMesh->GetIndices()[vertIdx + swapVertices * 2] };
-		const uint32_t vertIdx1{ pMesh->GetIndices()[vertIdx + 1] };
-		const uint32_t vertIdx2{ pMesh->GetIndices()[vertIdx + !swapVertices * 2] };
+		const Meshlet& meshlet{ projectedMesh.pLod->meshlets[meshletIdx] };
+		const uint8_t* pTriangles{ projectedMesh.pLod->meshletTriangles.data() + meshlet.triangleOffset * 3 };
+
+		//The local indices of the meshlet point into its own range of the projected vertices
+		const VertexOut* pVerticesOut{ projectedMesh.verticesOut.data() + meshlet.vertexOffset };
+		const Vector2* pScreenVertices{ projectedMesh.screenVertices.data() + meshlet.vertexOffset };
+
+		for (uint32_t triangleIdx{}; triangleIdx < meshlet.triangleCount; ++triangleIdx)
+		{
+			(this->*rasterizeTriangle)(shading, pVerticesOut, pScreenVertices, projectedMesh.tint,
+				pTriangles[triangleIdx * 3], pTriangles[triangleIdx * 3 + 1], pTriangles[triangleIdx * 3 + 2]);
+		}
+	}
 
+	void ProcessorCPU::RasterizeSubmeshDepth(Mesh* pMesh, const ProjectedMesh& projectedMesh, uint32_t submeshIdx)
+	{
+		const CullMode cullMode{ pMesh->GetSubmeshEffect(submeshIdx)->GetCullMode() };
+		const int numBands{ (m_Height + DepthRasterizer::BandHeight - 1) / DepthRasterizer::BandHeight };
+
+		//Every band owns its rows of the depth buffer, so bands do not race on the depth
+		concurrency::parallel_for(0, numBands, [&, this](int bandIdx)
+		{
+			const int bandMinY{ bandIdx * DepthRasterizer::BandHeight };
+			const int bandMaxY{ std::min(bandMinY + DepthRasterizer::BandHeight, m_Height) };
+
+			switch (pMesh->GetPrimitiveTopology())
+			{
+				case PrimitiveTopology::TriangleStrip:
+				{
+					const Submesh& submesh{ pMesh->GetSubmeshes()[submeshIdx] };
+					const std::span<const uint32_t> indices{ pMesh->GetIndices().subspan(submesh.indexOffset, submesh.indexCount) };
+					const uint32_t numIndices{ static_cast<uint32_t>(indices.size() < 2 ? 0 : indices.size() - 2) };
+					for (uint32_t vertIdx{}; vertIdx < numIndices; ++vertIdx)
+					{
+						//The vertices are swapped when vertIdx is uneven to keep the winding order of the strip
+						const bool swapVertices{ (vertIdx & 1) == 1 };
+						RasterizeTriangleDepth(projectedMesh.verticesOut.data(), projectedMesh.screenVertices.data(), cullMode,
+							indices[vertIdx + swapVertices * 2], indices[vertIdx + 1], indices[vertIdx + !swapVertices * 2], bandMinY, bandMaxY);
+					}
+					break;
+				}
+				case PrimitiveTopology::TriangleList:
+				{
+					if (!projectedMesh.pLod) break;
+					const std::span<const uint32_t> submeshMeshlets{ projectedMesh.pLod->submeshMeshlets };
+					const auto visibleBegin{ std::lower_bound(projectedMesh.visibleMeshlets.begin(), projectedMesh.visibleMeshlets.end(), submeshMeshlets[submeshIdx]) };
+					const auto visibleEnd{ std::lower_bound(visibleBegin, projectedMesh.visibleMeshlets.end(), submeshMeshlets[submeshIdx + 1]) };
+					for (auto visibleIt{ visibleBegin }; visibleIt != visibleEnd; ++visibleIt)
+					{
+						const Meshlet& meshlet{ projectedMesh.pLod->meshlets[*visibleIt] };
+						const uint8_t* pTriangles{ projectedMesh.pLod->meshletTriangles.data() + meshlet.triangleOffset * 3 };
+						const VertexOut* pVerticesOut{ projectedMesh.verticesOut.data() + meshlet.vertexOffset };
+						const Vector2* pScreenVertices{ projectedMesh.screenVertices.data() + meshlet.vertexOffset };
+
+						for (uint32_t triangleIdx{}; triangleIdx < meshlet.triangleCount; ++triangleIdx)
+						{
+							RasterizeTriangleDepth(pVerticesOut, pScreenVertices, cullMode,
+								pTriangles[triangleIdx * 3], pTriangles[triangleIdx * 3 + 1], pTriangles[triangleIdx * 3 + 2], bandMinY, bandMaxY);
+						}
+					}
+					break;
+				}
+			}
+		});
+	}
+
+	void ProcessorCPU::RasterizeTriangleDepth(const VertexOut* verticesOut, const Vector2* screenVertices, CullMode cullMode,
+		uint32_t vertIdx0, uint32_t vertIdx1, uint32_t vertIdx2, int bandMinY, int bandMaxY)
+	{
+		//Same triangle rejection as RasterizeTriangle, the depth rasterizer writes the exact depth the color pass computes
+		if (vertIdx0 == vertIdx1 || vertIdx1 == vertIdx2 || vertIdx2 == vertIdx0) return;
+
+		//Skip triangles outside of the band before the frustum test and the edge setup
+		const float minY{ std::min(screenVertices[vertIdx0].y, std::min(screenVertices[vertIdx1].y, screenVertices[vertIdx2].y)) };
+		const float maxY{ std::max(screenVertices[vertIdx0].y, std::max(screenVertices[vertIdx1].y, screenVertices[vertIdx2].y)) };
+		if (maxY < bandMinY || minY >= bandMaxY) return;
+
+		if (!GeometryUtils::IsVertexInFrustrum(verticesOut[vertIdx0].position)
+			|| !GeometryUtils::IsVertexInFrustrum(verticesOut[vertIdx1].position)
+			|| !GeometryUtils::IsVertexInFrustrum(verticesOut[vertIdx2].position))
+		{
+			return;
+		}
+
+		DepthRasterizer::RasterizeTriangle(DepthTarget{ m_pDepthBufferPixels, m_Width, m_Height },
+			screenVertices[vertIdx0], screenVertices[vertIdx1], screenVertices[vertIdx2],
+			verticesOut[vertIdx0].position.z, verticesOut[vertIdx1].position.z, verticesOut[vertIdx2].position.z,
+			cullMode, bandMinY, bandMaxY);
+	}
+
+	template<bool renderBoundingBoxes, bool useDepthBuffer, CullMode cullMode>
+	void ProcessorCPU::RasterizeTriangle(const SubmeshShading& shading, const VertexOut* verticesOut, const Vector2* screenVertices, const ColorRGB& tint,
+		uint32_t vertIdx0, uint32_t vertIdx1, uint32_t vertIdx2)
+	{
 		//Check If the same vertex is retrieved twice. This is used for the TriangleStrip topology.
 		if (vertIdx0 == vertIdx1 || vertIdx1 == vertIdx2 || vertIdx2 == vertIdx0) return;
 
 		//Check if all of the retrieved vertices are within the frustrum.
-		if (!GeometryUtils::IsVertexInFrustrum(pMesh->GetVerticesOut()[vertIdx0].position)
-			|| !GeometryUtils::IsVertexInFrustrum(pMesh->GetVerticesOut()[vertIdx1].position)
-			|| !GeometryUtils::IsVertexInFrustrum(pMesh->GetVerticesOut()[vertIdx2].position))
+		if (!GeometryUtils::IsVertexInFrustrum(verticesOut[vertIdx0].position)
+			|| !GeometryUtils::IsVertexInFrustrum(verticesOut[vertIdx1].position)
+			|| !GeometryUtils::IsVertexInFrustrum(verticesOut[vertIdx2].position))
 		{
 			return;
 		}
 
-		//Cache cull mode
-		CullMode meshCullMode{ pMesh->GetCullMode() };
-
 		//Create boundingbox around triangle
 		Vector2 boundingBoxMin{ Vector2::Min(screenVertices[vertIdx0], Vector2::Min(screenVertices[vertIdx1], screenVertices[vertIdx2])) };
 		Vector2 boundingBoxMax{ Vector2::Max(screenVertices[vertIdx0], Vector2::Max(screenVertices[vertIdx1], screenVertices[vertIdx2])) };
@@ -266,14 +765,48 @@ namespace dae
 		boundingBoxMin = Vector2::Max(Vector2::Zero, Vector2::Min(boundingBoxMin, screenVector));
 		boundingBoxMax = Vector2::Max(Vector2::Zero, Vector2::Min(boundingBoxMax, screenVector));
 
-		//Loop over the pixels in the area defined by the boundingbox
-		for (int px{ static_cast<int>(boundingBoxMin.x) }; px < boundingBoxMax.x; ++px)
+		//The barycentric weights change linearly over the screen, so their derivatives are constant over the triangle.
+		//From them follow the derivatives of uv/w and 1/w, which give the exact uv derivatives of every pixel
+		const float invTriangleArea{ 1.f / Vector2::Cross(screenVertices[vertIdx1] - screenVertices[vertIdx0],
+			screenVertices[vertIdx2] - screenVertices[vertIdx0]) };
+		const Vector2 edgeV1V2{ screenVertices[vertIdx2] - screenVertices[vertIdx1] };
+		const Vector2 edgeV2V0{ screenVertices[vertIdx0] - screenVertices[vertIdx2] };
+		const Vector2 edgeV0V1{ screenVertices[vertIdx1] - screenVertices[vertIdx0] };
+		const Vector2 weightV0Derivative{ Vector2{ -edgeV1V2.y, edgeV1V2.x } * invTriangleArea };
+		const Vector2 weightV1Derivative{ Vector2{ -edgeV2V0.y, edgeV2V0.x } * invTriangleArea };
+		const Vector2 weightV2Derivative{ Vector2{ -edgeV0V1.y, edgeV0V1.x } * invTriangleArea };
+
+		const Vector2 uvOverW0{ verticesOut[vertIdx0].uv / verticesOut[vertIdx0].position.w };
+		const Vector2 uvOverW1{ verticesOut[vertIdx1].uv / verticesOut[vertIdx1].position.w };
+		const Vector2 uvOverW2{ verticesOut[vertIdx2].uv / verticesOut[vertIdx2].position.w };
+		const Vector2 invWDerivative
+		{
+			weightV0Derivative / verticesOut[vertIdx0].position.w +
+			weightV1Derivative / verticesOut[vertIdx1].position.w +
+			weightV2Derivative / verticesOut[vertIdx2].position.w
+		};
+		const Vector2 uvOverWDdx{ uvOverW0 * weightV0Derivative.x + uvOverW1 * weightV1Derivative.x + uvOverW2 * weightV2Derivative.x };
+		const Vector2 uvOverWDdy{ uvOverW0 * weightV0Derivative.y + uvOverW1 * weightV1Derivative.y + uvOverW2 * weightV2Derivative.y };
+
+		//Inverse w of the vertices for perspective correct interpolation
+		const float inv0PosW{ 1.f / verticesOut[vertIdx0].position.w };
+		const float inv1PosW{ 1.f / verticesOut[vertIdx1].position.w };
+		const float inv2PosW{ 1.f / verticesOut[vertIdx2].position.w };
+
+		//Fragments that pass the depth test are collected and shaded a batch at a time
+		FragmentBatch batch{};
+		int batchPixelIndices[FragmentBatch::Size]{};
+		uint32_t numBatchFragments{};
+		int batchTileIdx{};
+
+		//Loop over the pixels in the area defined by the boundingbox, row by row
+		for (int py{ static_cast<int>(boundingBoxMin.y) }; py < boundingBoxMax.y; ++py)
 		{
-			for (int py{ static_cast<int>(boundingBoxMin.y) }; py < boundingBoxMax.y; ++py)
+			for (int px{ static_cast<int>(boundingBoxMin.x) }; px < boundingBoxMax.x; ++px)
 			{
 				//Check if the bounding box should be rendered. 
 				//If so, skip the rest of code in the loop and continue to the next
-				if (m_ShouldRenderBoundingBoxes)
+				if constexpr (renderBoundingBoxes)
 				{
 					m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
 						static_cast<uint8_t>(255),
@@ -286,128 +819,163 @@ namespace dae
 				const Vector2 pixelCoordinates{ static_cast<float>(px), static_cast<float>(py) };
 				float signedAreaV0V1, signedAreaV1V2, signedAreaV2V0;
 
-				if (GeometryUtils::IsPointInTriangle(screenVertices[vertIdx0], screenVertices[vertIdx1],
-					screenVertices[vertIdx2], pixelCoordinates, signedAreaV0V1, signedAreaV1V2, signedAreaV2V0))
-				{
-					//Check if the pixel can be rendered in the current cullmode
-					if (!IsValidPixelForCullMode(meshCullMode, signedAreaV0V1, signedAreaV1V2, signedAreaV2V0)) continue;
-					
+				if (!GeometryUtils::IsPointInTriangle(screenVertices[vertIdx0], screenVertices[vertIdx1],
+					screenVertices[vertIdx2], pixelCoordinates, signedAreaV0V1, signedAreaV1V2, signedAreaV2V0)) continue;
 
-					//Calculate interpolated depth
-					const float triangleArea{ 1.f / (Vector2::Cross(screenVertices[vertIdx1] - screenVertices[vertIdx0],
-						screenVertices[vertIdx2] - screenVertices[vertIdx0])) };
+				//Check if the pixel can be rendered in the current cullmode
+				if (!IsValidPixelForCullMode(cullMode, signedAreaV0V1, signedAreaV1V2, signedAreaV2V0)) continue;
 
-					const float weightV0{ signedAreaV1V2 * triangleArea };
-					const float weightV1{ signedAreaV2V0 * triangleArea };
-					const float weightV2{ signedAreaV0V1 * triangleArea };
+				const float weightV0{ signedAreaV1V2 * invTriangleArea };
+				const float weightV1{ signedAreaV2V0 * invTriangleArea };
+				const float weightV2{ signedAreaV0V1 * invTriangleArea };
 
-					//Calculate z depth interpolated
-					const float depthInterpolated
-					{
-						1.f / (weightV0 / pMesh->GetVerticesOut()[vertIdx0].position.z +
-						weightV1 / pMesh->GetVerticesOut()[vertIdx1].position.z +
-						weightV2 / pMesh->GetVerticesOut()[vertIdx2].position.z )
-					};
+				//Calculate z depth interpolated
+				const float depthInterpolated
+				{
+					1.f / (weightV0 / verticesOut[vertIdx0].position.z +
+					weightV1 / verticesOut[vertIdx1].position.z +
+					weightV2 / verticesOut[vertIdx2].position.z )
+				};
+
+				//Compare calculated depth to the depth already stored in the depthbuffer. 
+				//Meshes that use the depth buffer wrote their depth in the prepass, only the closest fragment has the same depth.
+				//Other meshes pass the depthtest when the calculated depth is smaller.
+				const int pixelIdx{ px + py * m_Width };
+				if (depthInterpolated < 0.f || depthInterpolated > 1.f) continue;
+				if constexpr (useDepthBuffer)
+				{
+					if (m_pDepthBufferPixels[pixelIdx] < depthInterpolated) continue;
+				}
+				else
+				{
+					if (m_pDepthBufferPixels[pixelIdx] <= depthInterpolated) continue;
+				}
 
-					//Compare calculated depth to the depth already stored in the depthbuffer. 
-					//The depthtest is passed when the calculated depth is smaller.
-					const int pixelIdx{ px + py * m_Width };
-					if (m_pDepthBufferPixels[pixelIdx] <= depthInterpolated || depthInterpolated < 0.f || depthInterpolated > 1.f) continue;
-					if (pMesh->UseDepthBuffer()) m_pDepthBufferPixels[pixelIdx] = depthInterpolated;
+				//Calculate w depth interpolated
+				const float viewDepthInterpolated
+				{
+					1.f / (inv0PosW * weightV0 +
+					inv1PosW * weightV1 +
+					inv2PosW * weightV2)
+				};
 
+				//Perspective correct weights, the attributes of the vertices are blended with these
+				const float correctedWeightV0{ inv0PosW * weightV0 * viewDepthInterpolated };
+				const float correctedWeightV1{ inv1PosW * weightV1 * viewDepthInterpolated };
+				const float correctedWeightV2{ inv2PosW * weightV2 * viewDepthInterpolated };
 
-					ColorRGB finalColor{};
+				const Vector2 pixelUV
+				{
+					verticesOut[vertIdx0].uv * correctedWeightV0 +
+					verticesOut[vertIdx1].uv * correctedWeightV1 +
+					verticesOut[vertIdx2].uv * correctedWeightV2
+				};
 
-					//Calculate final color based on the rendermode
-					switch (m_RenderMode)
-					{
-					default:
-					case RenderMode::FinalColor:
-					{
-						//Calculate w depth interpolated
-						const float inv0PosW{ 1.f / pMesh->GetVerticesOut()[vertIdx0].position.w };
-						const float inv1PosW{ 1.f / pMesh->GetVerticesOut()[vertIdx1].position.w };
-						const float inv2PosW{ 1.f / pMesh->GetVerticesOut()[vertIdx2].position.w };
+				//Quotient rule on uv = (uv/w) / (1/w), selects the mip level of the textures
+				const Vector2 uvDdx{ (uvOverWDdx - pixelUV * invWDerivative.x) * viewDepthInterpolated };
+				const Vector2 uvDdy{ (uvOverWDdy - pixelUV * invWDerivative.y) * viewDepthInterpolated };
 
-						const float viewDepthInterpolated
-						{
-							1.f / (inv0PosW * weightV0 +
-							inv1PosW * weightV1 +
-							inv2PosW * weightV2)
-						};
+				const Vector3 normal
+				{
+					verticesOut[vertIdx0].normal * correctedWeightV0 +
+					verticesOut[vertIdx1].normal * correctedWeightV1 +
+					verticesOut[vertIdx2].normal * correctedWeightV2
+				};
 
-						Vector2 pixelUV
-						{
-							(pMesh->GetVerticesOut()[vertIdx0].uv * inv0PosW * weightV0 +
-							pMesh->GetVerticesOut()[vertIdx1].uv * inv1PosW * weightV1 +
-							pMesh->GetVerticesOut()[vertIdx2].uv * inv2PosW * weightV2) * viewDepthInterpolated
-						};
-						//Clamping uv to mitigate rounding errors from the calculations
-						pixelUV.x = std::min(1.f, std::max(pixelUV.x, 0.f));
-						pixelUV.y = std::min(1.f, std::max(pixelUV.y, 0.f));
-
-						//interpolate the various properties of the vertex
-						const Vector3 normal
-						{
-							(pMesh->GetVerticesOut()[vertIdx0].normal * inv0PosW * weightV0 +
-							pMesh->GetVerticesOut()[vertIdx1].normal * inv1PosW * weightV1 +
-							pMesh->GetVerticesOut()[vertIdx2].normal * inv2PosW * weightV2) * viewDepthInterpolated
-						};
+				const Vector3 tangent
+				{
+					verticesOut[vertIdx0].tangent * correctedWeightV0 +
+					verticesOut[vertIdx1].tangent * correctedWeightV1 +
+					verticesOut[vertIdx2].tangent * correctedWeightV2
+				};
 
-						const Vector3 tangent
-						{
-							(pMesh->GetVerticesOut()[vertIdx0].tangent * inv0PosW * weightV0 +
-							pMesh->GetVerticesOut()[vertIdx1].tangent * inv1PosW * weightV1 +
-							pMesh->GetVerticesOut()[vertIdx2].tangent * inv2PosW * weightV2) * viewDepthInterpolated
-						};
+				const Vector3 viewDirection
+				{
+					verticesOut[vertIdx0].viewDirection * correctedWeightV0 +
+					verticesOut[vertIdx1].viewDirection * correctedWeightV1 +
+					verticesOut[vertIdx2].viewDirection * correctedWeightV2
+				};
+
+				//A batch only holds fragments of one light tile, the fragments of the next tile start a new batch
+				const int tileIdx{ px / m_LightTileSize + py / m_LightTileSize * m_NumLightTilesX };
+				if (numBatchFragments > 0 && tileIdx != batchTileIdx)
+				{
+					ShadeBatch(shading, batch, batchPixelIndices, numBatchFragments, batchTileIdx, tint);
+					numBatchFragments = 0;
+				}
+				batchTileIdx = tileIdx;
+
+				//Add the fragment to the batch, the effect normalizes the vectors for the whole batch at once
+				const uint32_t lane{ numBatchFragments };
+				//Clamping uv to mitigate rounding errors from the calculations
+				batch.u[lane] = std::min(1.f, std::max(pixelUV.x, 0.f));
+				batch.v[lane] = std::min(1.f, std::max(pixelUV.y, 0.f));
+				batch.ddxU[lane] = uvDdx.x;
+				batch.ddxV[lane] = uvDdx.y;
+				batch.ddyU[lane] = uvDdy.x;
+				batch.ddyV[lane] = uvDdy.y;
+				batch.normalX[lane] = normal.x;
+				batch.normalY[lane] = normal.y;
+				batch.normalZ[lane] = normal.z;
+				batch.tangentX[lane] = tangent.x;
+				batch.tangentY[lane] = tangent.y;
+				batch.tangentZ[lane] = tangent.z;
+				batch.viewDirectionX[lane] = viewDirection.x;
+				batch.viewDirectionY[lane] = viewDirection.y;
+				batch.viewDirectionZ[lane] = viewDirection.z;
+				batch.currentColor[lane] = m_pBackBufferPixels[pixelIdx];
+				batchPixelIndices[lane] = pixelIdx;
+
+				if (++numBatchFragments == FragmentBatch::Size)
+				{
+					ShadeBatch(shading, batch, batchPixelIndices, numBatchFragments, batchTileIdx, tint);
+					numBatchFragments = 0;
+				}
+			}
+		}
 
-						const Vector3 viewDirection
-						{
-							(pMesh->GetVerticesOut()[vertIdx0].viewDirection * inv0PosW * weightV0 +
-							pMesh->GetVerticesOut()[vertIdx1].viewDirection * inv1PosW * weightV1 +
-							pMesh->GetVerticesOut()[vertIdx2].viewDirection * inv2PosW * weightV2) * viewDepthInterpolated
-						};
-
-						VertexOut interpolatedVertex{};
-						interpolatedVertex.uv = pixelUV;
-						interpolatedVertex.normal = normal.Normalized();
-						interpolatedVertex.tangent = tangent.Normalized();
-						interpolatedVertex.viewDirection = viewDirection.Normalized();
-
-						//Pixelshading stage is done in the effect stored in the mesh
-						finalColor = pMesh->ShadePixel(interpolatedVertex, m_ShadingMode, m_pBackBufferPixels[px + (py * m_Width)], m_ShouldRenderNormals);
-					}
-					break;
-					case RenderMode::DepthBuffer:
-					{
-						//Calculate the depthColor
-						const float depthRemapped{ DepthRemap(depthInterpolated, 0.997f, 1.f) };
-						const ColorRGB depthViewColor{ depthRemapped, depthRemapped, depthRemapped };
-						const bool useDepthColor{ pMesh->UseDepthBuffer() };
-
-						//Retrieve the background color
-						uint8_t red{}, green{}, blue{};
-						SDL_GetRGB(m_pBackBufferPixels[px + (py * m_Width)], m_pBackBuffer->format, &red, &green, &blue);
-						const ColorRGB currentColor{ 
-							static_cast<float>(red) * m_ColorModifier, 
-							static_cast<float>(green) * m_ColorModifier,
-							static_cast<float>(blue) * m_ColorModifier,
-						};
-
-						//Check if the depthcolor should be used instead of the background color
-						finalColor = useDepthColor * depthViewColor  + !useDepthColor * currentColor;
-					}
-					}
+		//Shade the fragments that did not fill a whole batch
+		if (numBatchFragments > 0) ShadeBatch(shading, batch, batchPixelIndices, numBatchFragments, batchTileIdx, tint);
+	}
 
-					//Update Color in Buffer
-					finalColor.MaxToOne();
+	void ProcessorCPU::ShadeBatch(const SubmeshShading& shading, FragmentBatch& batch, const int* pixelIndices, uint32_t numFragments, int tileIdx, const ColorRGB& tint)
+	{
+		//Pixelshading stage is done in the effect stored in the mesh, once for the whole batch
+		batch.mask = (1u << numFragments) - 1;
+		batch.pLights = m_pLights->data();
+		batch.pLightIndices = m_TileLightIndices.data() + tileIdx * m_TileLightStride;
+		batch.numLights = m_TileLightCounts[tileIdx];
+		batch.cameraOrigin = m_CameraOrigin;
+		batch.pShadowMap = m_HasShadowMap ? &m_ShadowMap : nullptr;
+		shading.shadeBatch(shading.pEffect, batch, tint);
+
+		//Update Color in Buffer
+		for (uint32_t lane{}; lane < numFragments; ++lane)
+		{
+			ColorRGB finalColor{ batch.red[lane], batch.green[lane], batch.blue[lane] };
+			finalColor.MaxToOne();
 
-					m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-						static_cast<uint8_t>(finalColor.r * 255),
-						static_cast<uint8_t>(finalColor.g * 255),
-						static_cast<uint8_t>(finalColor.b * 255));
-				}
-			}
+			m_pBackBufferPixels[pixelIndices[lane]] = SDL_MapRGB(m_pBackBuffer->format,
+				static_cast<uint8_t>(finalColor.r * 255),
+				static_cast<uint8_t>(finalColor.g * 255),
+				static_cast<uint8_t>(finalColor.b * 255));
 		}
 	}
+
+	void ProcessorCPU::WriteDepthView()
+	{
+		//Pixels covered by the prepass show their depth, the rest keeps the background
+		concurrency::parallel_for(0, m_Height, [this](int py)
+		{
+			for (int px{}; px < m_Width; ++px)
+			{
+				const int pixelIdx{ px + py * m_Width };
+				const float depth{ m_pDepthBufferPixels[pixelIdx] };
+				if (depth >= 1.f) continue;
+
+				const uint8_t depthColor{ static_cast<uint8_t>(DepthRemap(depth, 0.997f, 1.f) * 255) };
+				m_pBackBufferPixels[pixelIdx] = SDL_MapRGB(m_pBackBuffer->format, depthColor, depthColor, depthColor);
+			}
+		});
+	}
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include "Processor.h"
+#include "FrameArena.h"
+#include "Effect.h"
 
 namespace dae
 {
@@ -17,7 +19,7 @@ namespace dae
 		ProcessorCPU& operator=(const ProcessorCPU& processor) = delete;
 		ProcessorCPU& operator=(ProcessorCPU&& processor) noexcept = delete;
 
-		virtual void Render(std::vector<Mesh*>& meshes, const Camera* camera) override;
+		virtual void Render(std::vector<Mesh*>& meshes, const std::vector<Mesh*>& shadowCasters, const std::vector<Light>& lights, const Camera* camera) override;
 		virtual void ToggleBackgroundColor(bool useUniformBg) override;
 		void ToggleNormalMap();
 		void ToggleBoundingBoxes();
@@ -32,21 +34,99 @@ namespace dae
 		uint32_t* m_pBackBufferPixels{};
 		float* m_pDepthBufferPixels{};
 
+		//Transient data, everything allocated from the arena is released at the end of the frame
+		FrameArena m_FrameArena;
+
+		//Output of the vertex stage for a single instance, allocated from the frame arena
+		struct ProjectedMesh
+		{
+			std::span<VertexOut> verticesOut{};
+			std::span<Vector2> screenVertices{};
+			std::span<uint32_t> visibleMeshlets{};
+			const MeshLod* pLod{ nullptr };
+			ColorRGB tint{};
+		};
+
+		//Instance of a mesh that goes through the vertex stage
+		struct InstanceRef
+		{
+			uint32_t meshIdx{};
+			uint32_t instanceIdx{};
+		};
+
 		//Projection Stage
 		void ProjectMesh(std::vector<Mesh*>& meshes, const Camera* camera);
-		void VertexTransformationFunction(Mesh* pMesh, const Camera* camera) const;
+		uint32_t SelectLod(const Mesh* pMesh, uint32_t instanceIdx, const Camera* camera) const;
+		ProjectedMesh VertexTransformationFunction(Mesh* pMesh, uint32_t instanceIdx, uint32_t lodIdx, const Camera* camera, const Frustum& frustum);
+		void TransformVertex(const Vertex& vertexIn, VertexOut& vertexOut, Vector2& screenVertex,
+			const Matrix& worldViewProjectionMatrix, const Matrix& worldMatrix, const Vector3& cameraOrigin) const;
+		//The position matrices have the position decoding of the mesh in front, the directions only need the world matrix
+		void TransformVertex(const QuantizedVertex& vertexIn, VertexOut& vertexOut, Vector2& screenVertex,
+			const Matrix& positionWorldViewProjectionMatrix, const Matrix& positionWorldMatrix, const Matrix& worldMatrix, const Vector3& cameraOrigin) const;
 
 		//Rasterization Stage
-		void RasterizeTriangle(Mesh* pMesh, const std::vector<Vector2>& screenVertices, uint32_t vertIdx, bool swapVertices = false);
+		//Effect of a submesh with the shading kernel that was picked for the options of the frame
+		struct SubmeshShading
+		{
+			Effect* pEffect{ nullptr };
+			Effect::ShadeBatchFunction shadeBatch{ nullptr };
+		};
+
+		//Every combination of the render options has its own instantiation of RasterizeTriangle, so the pixel loop does not branch on them.
+		//Triangles are rasterized with the effect of the submesh they belong to
+		using RasterizeTriangleFunction = void (ProcessorCPU::*)(const SubmeshShading& shading, const VertexOut* verticesOut, const Vector2* screenVertices,
+			const ColorRGB& tint, uint32_t vertIdx0, uint32_t vertIdx1, uint32_t vertIdx2);
+		RasterizeTriangleFunction SelectRasterizeTriangle(const Effect* pEffect) const;
+		void RasterizeInstances(std::vector<Mesh*>& meshes, std::span<const InstanceRef> instances, std::span<const ProjectedMesh> projectedMeshes,
+			RenderPass pass);
+		void RasterizeMesh(Mesh* pMesh, const ProjectedMesh& projectedMesh, RenderPass pass);
+		void RasterizeMeshlet(const SubmeshShading& shading, const ProjectedMesh& projectedMesh, uint32_t meshletIdx, RasterizeTriangleFunction rasterizeTriangle);
+		template<bool renderBoundingBoxes, bool useDepthBuffer, CullMode cullMode>
+		void RasterizeTriangle(const SubmeshShading& shading, const VertexOut* verticesOut, const Vector2* screenVertices, const ColorRGB& tint,
+			uint32_t vertIdx0, uint32_t vertIdx1, uint32_t vertIdx2);
+		//Depth prepass, only writes the depth buffer. Jobs own bands of rows instead of triangles,
+		//the depth test of a pixel and its write are not atomic
+		void RasterizeSubmeshDepth(Mesh* pMesh, const ProjectedMesh& projectedMesh, uint32_t submeshIdx);
+		void RasterizeTriangleDepth(const VertexOut* verticesOut, const Vector2* screenVertices, CullMode cullMode,
+			uint32_t vertIdx0, uint32_t vertIdx1, uint32_t vertIdx2, int bandMinY, int bandMaxY);
 		bool IsValidPixelForCullMode(CullMode mode, float areaV0V1, float areaV1V2, float areaV2V0) const;
 
+		//Light culling, every screen tile keeps the lights that can reach the depth range of its pixels
+		void CullLights(const Camera* camera);
+		//Depth of the casters as seen from the first shadow casting directional light
+		void RenderShadowMap(const std::vector<Mesh*>& shadowCasters, const std::vector<Light>& lights);
+
+		//Pixel Shading Stage
+		void ShadeBatch(const SubmeshShading& shading, FragmentBatch& batch, const int* pixelIndices, uint32_t numFragments, int tileIdx, const ColorRGB& tint);
+		void WriteDepthView();
+
 		//Variables
 		const ColorRGB m_SoftwareColor{ 0.39f, 0.39f, 0.39f };
 		const float m_ColorModifier{ 1.f / 255.f };
+		const uint32_t m_VertexChunkSize{ 1024 };
+		const float m_LodPixelError{ 1.f };
+		static constexpr size_t m_FrameArenaCapacity{ 64 * 1024 * 1024 };
 		bool m_ShouldRenderNormals{ true };
 		bool m_ShouldRenderBoundingBoxes{ false };
 		RenderMode m_RenderMode{ RenderMode::FinalColor };
 		ShadingMode m_ShadingMode{ ShadingMode::Combined };
+
+		//Lights of the current frame
+		const std::vector<Light>* m_pLights{ nullptr };
+		Vector3 m_CameraOrigin{};
+		static constexpr int m_LightTileSize{ 16 };
+		int m_NumLightTilesX{};
+		int m_NumLightTilesY{};
+		//Allocated from the frame arena, the lights of tile i are the first m_TileLightCounts[i] indices at i * m_TileLightStride
+		std::span<uint32_t> m_TileLightIndices{};
+		std::span<uint32_t> m_TileLightCounts{};
+		uint32_t m_TileLightStride{};
+
+		//Shadows
+		static constexpr int m_ShadowMapSize{ 1024 };
+		float* m_pShadowMapPixels{};
+		ShadowMap m_ShadowMap{};
+		bool m_HasShadowMap{ false };
 	};
 }
 
@@ -1,5 +1,7 @@
 #include "pch.h"
 #include "ProcessorGPU.h"
+#include "Utils.h"
+#include "Camera.h"
 
 //Multithreading includes
 #include <thread>
@@ -40,7 +42,7 @@ namespace dae
 		if (m_pSwapChain) m_pSwapChain->Release();
 	}
 
-	void ProcessorGPU::Render(std::vector<Mesh*>& meshes, const Camera* camera)
+	void ProcessorGPU::Render(std::vector<Mesh*>& meshes, const std::vector<Mesh*>& shadowCasters, const std::vector<Light>& lights, const Camera* camera)
 	{
 		if (!m_IsInitialized) return;
 
@@ -49,10 +51,20 @@ namespace dae
 		m_pDeviceContext->ClearDepthStencilView(m_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.f, 0);
 
 		//2. Set Pipeline + Invoke Drawcalls (= render)
+		//Each submesh draws all of its instances that intersect the frustum in a single call.
+		//The transparent submeshes of all meshes are drawn last, they do not write depth and blend on top of everything behind them
+		const Frustum frustum{ GeometryUtils::ExtractFrustum(camera->GetViewMatrix() * camera->GetProjectionMatrix()) };
 		for (Mesh* pMesh : meshes)
 		{
 			if (!pMesh->ShouldRender()) continue;
-			pMesh->Render(m_pDeviceContext);
+			pMesh->SetLights(lights);
+			pMesh->UploadVisibleInstances(m_pDeviceContext, frustum);
+			pMesh->Render(m_pDeviceContext, RenderPass::Opaque);
+		}
+		for (Mesh* pMesh : meshes)
+		{
+			if (!pMesh->ShouldRender()) continue;
+			pMesh->Render(m_pDeviceContext, RenderPass::Transparent);
 		}
 
 		//3. Present Backbuffer (swap)
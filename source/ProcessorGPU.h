@@ -15,7 +15,7 @@ namespace dae
 		ProcessorGPU& operator=(const ProcessorGPU& processor) = delete;
 		ProcessorGPU& operator=(ProcessorGPU&& processor) noexcept = delete;
 
-		virtual void Render(std::vector<Mesh*>& meshes, const Camera* camera) override;
+		virtual void Render(std::vector<Mesh*>& meshes, const std::vector<Mesh*>& shadowCasters, const std::vector<Light>& lights, const Camera* camera) override;
 		virtual void ToggleBackgroundColor(bool useUniformBg) override;
 
 	private:
@@ -7,6 +7,11 @@
 #include "Mesh.h"
 #include "EffectOpaque.h"
 #include "EffectTransparent.h"
+#include "TextureStreamer.h"
+#include "ResourceManager.h"
+#include "MeshGeometry.h"
+#include "ObjParser.h"
+#include <ppl.h>
 
 namespace dae {
 
@@ -31,7 +36,10 @@ namespace dae {
 		if (result == S_OK)
 		{
 			m_IsInitialized = true;
+			m_pTextureStreamer = new TextureStreamer(m_TextureBudgetBytes);
+			m_pResourceManager = new ResourceManager(m_pDevice, m_pTextureStreamer);
 			InitMeshes(m_pDevice);
+			InitLights();
 		}
 		else
 		{
@@ -49,6 +57,14 @@ namespace dae {
 
 	Renderer::~Renderer()
 	{
+		//Meshes that are still loading are finished first, they are deleted with the others
+		for (MeshTask& meshTask : m_MeshTasks)
+		{
+			Mesh* pMesh{ GetLoadedMesh(meshTask.task) };
+			if (pMesh) m_Meshes.push_back(pMesh);
+		}
+		m_MeshTasks.clear();
+
 		//Release and delete resources
 		for (Mesh* pMesh : m_Meshes)
 		{
@@ -56,6 +72,14 @@ namespace dae {
 		}
 		m_Meshes.clear();
 
+		//Only holds weak references, the resources were freed with the last mesh that used them
+		delete m_pResourceManager;
+		m_pResourceManager = nullptr;
+
+		//The textures of the meshes unregister from the streamer, so it is deleted after them
+		delete m_pTextureStreamer;
+		m_pTextureStreamer = nullptr;
+
 		delete m_pProcessorGPU;
 		m_pProcessorGPU = nullptr;
 
@@ -74,9 +98,12 @@ namespace dae {
 	void Renderer::Update(const Timer* pTimer)
 	{
 		m_Camera.Update(pTimer);
+		const bool hasNewMeshes{ AddLoadedMeshes() };
 		
-		for (Mesh* pMesh : m_Meshes)
+		for (uint32_t meshIdx{}; meshIdx < m_Meshes.size(); ++meshIdx)
 		{
+			Mesh* pMesh{ m_Meshes[meshIdx] };
+
 			//only rotate when enabled
 			if (m_ShouldRotate)
 			{
@@ -85,14 +112,31 @@ namespace dae {
 
 			//Update matrices
 			pMesh->SetMatrices(m_Camera.GetViewMatrix() * m_Camera.GetProjectionMatrix(), m_Camera.GetInvViewMatrix());
+
+			//Meshes whose bounds changed only refit the nodes above them
+			if (pMesh->AreWorldBoundsDirty())
+			{
+				m_SceneBVH.Refit(meshIdx);
+				pMesh->ClearWorldBoundsDirty();
+			}
 		}
+
+		//New meshes change the tree, it is built again once their matrices are set
+		if (hasNewMeshes) m_SceneBVH.Build(m_Meshes);
 	}
 
 
 	void Renderer::Render()
 	{
 		if (!m_IsInitialized) return;
-		m_pRenderProcessor->Render(m_Meshes, &m_Camera);
+
+		//Only pass the meshes that intersect the view frustum to the processor, all meshes can cast shadows into the view
+		const Frustum frustum{ GeometryUtils::ExtractFrustum(m_Camera.GetViewMatrix() * m_Camera.GetProjectionMatrix()) };
+		m_SceneBVH.QueryFrustum(frustum, m_VisibleMeshes);
+		m_pRenderProcessor->Render(m_VisibleMeshes, m_Meshes, m_Lights, &m_Camera);
+
+		//Load what the frame sampled and evict what does not fit the budget
+		m_pTextureStreamer->Update();
 	}
 
 	void Renderer::ToggleProcessor()
@@ -122,28 +166,32 @@ namespace dae {
 
 	void Renderer::ToggleFireFx()
 	{
-		m_Meshes[1]->ToggleRender();
+		//The fire can still be loading, it takes the option when it is added
+		m_ShouldRenderFireFx = !m_ShouldRenderFireFx;
+		if (m_pFireFxMesh) m_pFireFxMesh->SetShouldRender(m_ShouldRenderFireFx);
+
+		std::wcout << "\033[33m" << "**(Shared) FireFX " << (m_ShouldRenderFireFx ? "ON" : "OFF") << "\033[0m" << "\n";
 	}
 
 	void Renderer::CycleSamplerState()
 	{
-		//Only cycle the shading mode when the current processor is the gpu
-		if (m_ProcessorType != ProcessorType::GPU) return;
+		//Both processors sample with the sampler state of the effect
+		m_SamplerState = static_cast<SamplerState>((static_cast<int>(m_SamplerState) + 1) % static_cast<int>(SamplerState::COUNT));
 		for (Mesh* pMesh : m_Meshes)
 		{
-			pMesh->CycleSamplerState(m_pDevice);
+			pMesh->SetSamplerState(m_pDevice, m_SamplerState);
 		}
 
-		switch (m_Meshes[0]->GetSamplerState())
+		switch (m_SamplerState)
 		{
 		case SamplerState::Point:
-			std::wcout << "\033[32m" << "**(HARDWARE) Sampler Filter = POINT" << "\033[0m" << "\n";
+			std::wcout << "\033[33m" << "**(SHARED) Sampler Filter = POINT" << "\033[0m" << "\n";
 			break;
 		case SamplerState::Linear:
-			std::wcout << "\033[32m" << "**(HARDWARE) Sampler Filter = LINEAR" << "\033[0m" << "\n";
+			std::wcout << "\033[33m" << "**(SHARED) Sampler Filter = LINEAR" << "\033[0m" << "\n";
 			break;
 		case SamplerState::Anisotropic:
-			std::wcout << "\033[32m" << "**(HARDWARE) Sampler Filter = ANISOTROPIC" << "\033[0m" << "\n";
+			std::wcout << "\033[33m" << "**(SHARED) Sampler Filter = ANISOTROPIC" << "\033[0m" << "\n";
 			break;
 		default:
 			break;
@@ -152,12 +200,13 @@ namespace dae {
 
 	void Renderer::CycleCullMode()
 	{
+		m_CullMode = static_cast<CullMode>((static_cast<int>(m_CullMode) + 1) % static_cast<int>(CullMode::COUNT));
 		for (Mesh* pMesh : m_Meshes)
 		{
-			pMesh->CycleCullMode(m_pDevice);
+			pMesh->SetCullMode(m_pDevice, m_CullMode);
 		}
 
-		switch (m_Meshes[0]->GetCullMode())
+		switch (m_CullMode)
 		{
 		case CullMode::None:
 			std::wcout << "\033[33m" << "**(Shared) CullMode = NONE" << "\033[0m" << "\n";
@@ -210,37 +259,176 @@ namespace dae {
 
 	void Renderer::InitMeshes(ID3D11Device* pDevice)
 	{
-		//Initialize mesh variables
-		std::vector<Vertex> vertices{};
-		std::vector<uint32_t> indices{};
-
+		//Every model is parsed in its own task, its effects are created in a continuation once the materials it uses are known.
+		//The device is free threaded, so the buffers are created on the worker as well.
+		//The textures are streamed, their images are only decoded once they are sampled.
+		//Models and textures come from the resource manager, which loads each of them once however many meshes use them
 		const Vector3 translation{ 0.f, 0.f, 50.f };
 		const Vector3 rotation{ 0.f, 0.f, 0.f };
+		ResourceManager* pResourceManager{ m_pResourceManager };
+
+		//Vehicle resources, the model has no material library
+		ObjParser::Material vehicleMaterial{};
+		vehicleMaterial.diffuseMap = "Resources/vehicle_diffuse.png";
+		vehicleMaterial.normalMap = "Resources/vehicle_normal.png";
+		vehicleMaterial.specularMap = "Resources/vehicle_specular.png";
+		vehicleMaterial.glossinessMap = "Resources/vehicle_gloss.png";
+
+		//FireFX resources, the alpha of the diffuse map is the opacity
+		ObjParser::Material fireMaterial{};
+		fireMaterial.diffuseMap = "Resources/fireFX_diffuse.png";
+		fireMaterial.opacityMap = "Resources/fireFX_diffuse.png";
+
+		//Fleet of vehicles in rows behind the first one, each with its own tint.
+		//The fire belongs to the vehicle, so both meshes share their instances
+		std::vector<MeshInstance> fleet{};
+		for (int row{}; row < m_NumFleetRows; ++row)
+		{
+			for (int column{ -m_NumFleetColumns / 2 }; column <= m_NumFleetColumns / 2; ++column)
+			{
+				MeshInstance& instance{ fleet.emplace_back() };
+				instance.transform = Matrix::CreateTranslation(column * m_FleetSpacing, 0.f, row * m_FleetSpacing);
+				if (row != 0 || column != 0) instance.tint = ColorRGB{ 0.6f + 0.2f * (row % 3), 0.6f + 0.2f * ((column + m_NumFleetColumns) % 3), 0.8f };
+			}
+		}
+
+		const auto createMeshTask{ [=](const std::string& objPath, const ObjParser::Material& fallbackMaterial)
+		{
+			return concurrency::create_task([=]()
+			{
+				return pResourceManager->LoadMesh(objPath, m_VertexFormat);
+			}).then([=](std::shared_ptr<const MeshGeometry> pGeometry)
+			{
+				std::vector<Effect*> pEffects{ CreateMaterialEffects(pDevice, pResourceManager, *pGeometry, fallbackMaterial) };
+				Mesh* pMesh{ new Mesh(pDevice, std::move(pGeometry), std::move(pEffects), rotation, translation) };
+				pMesh->SetInstances(pDevice, fleet);
+				return pMesh;
+			});
+		} };
+
+		m_MeshTasks.push_back(MeshTask{ createMeshTask("Resources/vehicle.obj", vehicleMaterial), false });
+		m_MeshTasks.push_back(MeshTask{ createMeshTask("Resources/fireFX.obj", fireMaterial), true });
+	}
 
-		//Vehicle resources
-		Utils::ParseOBJ("Resources/vehicle.obj", vertices, indices);
+	std::vector<Effect*> Renderer::CreateMaterialEffects(ID3D11Device* pDevice, ResourceManager* pResourceManager, const MeshGeometry& geometry,
+		const ObjParser::Material& fallbackMaterial)
+	{
+		//A material that is defined in several libraries uses its first definition
+		const MeshMaterials& materials{ geometry.GetMaterials() };
+		std::vector<ObjParser::Material> libraryMaterials{};
+		for (const std::string& libraryPath : materials.libraryPaths)
+		{
+			if (!ObjParser::ParseMaterials(libraryPath, libraryMaterials))
+			{
+				std::wcout << L"Material library could not be read!\n";
+			}
+		}
 
-		std::wstring fxPath{ L"Resources/EffectOpaque.fx" };
-		std::string diffusePath{ "Resources/vehicle_diffuse.png" };
-		const std::string normalPath{ "Resources/vehicle_normal.png" };
-		const std::string specularPath{ "Resources/vehicle_specular.png" };
-		const std::string glossinessPath{ "Resources/vehicle_gloss.png" };
+		//The effects compile in parallel
+		std::vector<Effect*> pEffects(std::max(materials.names.size(), size_t{ 1 }));
+		concurrency::parallel_for(size_t{}, pEffects.size(), [&](size_t materialIdx)
+		{
+			const ObjParser::Material* pMaterial{ &fallbackMaterial };
+			if (materialIdx < materials.names.size())
+			{
+				const auto materialIt{ std::find_if(libraryMaterials.begin(), libraryMaterials.end(), [&](const ObjParser::Material& material)
+				{
+					return material.name == materials.names[materialIdx];
+				}) };
+				if (materialIt != libraryMaterials.end()) pMaterial = &*materialIt;
+			}
+			pEffects[materialIdx] = CreateMaterialEffect(pDevice, pResourceManager, *pMaterial);
+		});
+		return pEffects;
+	}
 
-		EffectOpaque* pVehicleEffect{ EffectOpaque::CreateEffect(pDevice, fxPath, diffusePath, normalPath, specularPath, glossinessPath) };
+	Effect* Renderer::CreateMaterialEffect(ID3D11Device* pDevice, ResourceManager* pResourceManager, const ObjParser::Material& material)
+	{
+		//Materials that are not fully opaque are blended and do not write depth, their opacity comes from the alpha of the diffuse map
+		if (material.opacity < 1.f || !material.opacityMap.empty())
+		{
+			return EffectTransparent::CreateEffect(pDevice, pResourceManager, L"Resources/EffectTransparent.fx", material.diffuseMap);
+		}
+		return EffectOpaque::CreateEffect(pDevice, pResourceManager, L"Resources/EffectOpaque.fx", material.diffuseMap,
+			material.normalMap, material.specularMap, material.glossinessMap);
+	}
 
-		m_Meshes.push_back(new Mesh(pDevice, vertices, indices, pVehicleEffect, rotation, translation));
+	bool Renderer::AddLoadedMeshes()
+	{
+		//Only taken from the front, so the order of the meshes does not depend on which load finishes first.
+		//Failed loads are dropped with their task, so they are only reported once
+		size_t numDone{};
+		bool hasNewMeshes{ false };
+		while (numDone < m_MeshTasks.size() && m_MeshTasks[numDone].task.is_done())
+		{
+			const MeshTask& meshTask{ m_MeshTasks[numDone++] };
+			Mesh* pMesh{ GetLoadedMesh(meshTask.task) };
+			if (!pMesh) continue;
+
+			//The options may have changed while the mesh was loading
+			pMesh->SetSamplerState(m_pDevice, m_SamplerState);
+			pMesh->SetCullMode(m_pDevice, m_CullMode);
+			if (meshTask.isFireFx)
+			{
+				pMesh->SetShouldRender(m_ShouldRenderFireFx);
+				m_pFireFxMesh = pMesh;
+			}
 
-		//FireFX resources
-		Utils::ParseOBJ("Resources/fireFX.obj", vertices, indices);
+			m_Meshes.push_back(pMesh);
+			hasNewMeshes = true;
+		}
 
-		fxPath = L"Resources/EffectTransparent.fx";
-		diffusePath = "Resources/fireFX_diffuse.png";
+		m_MeshTasks.erase(m_MeshTasks.begin(), m_MeshTasks.begin() + numDone);
+		return hasNewMeshes;
+	}
 
-		EffectTransparent* pFireEffect{EffectTransparent::CreateEffect(pDevice, fxPath, diffusePath)};
-		m_Meshes.push_back(new Mesh(pDevice, vertices, indices, pFireEffect, rotation, translation));
+	Mesh* Renderer::GetLoadedMesh(const concurrency::task<Mesh*>& meshTask)
+	{
+		//get rethrows what the load threw, such as a failed allocation or buffer creation
+		try
+		{
+			return meshTask.get();
+		}
+		catch (const std::exception& exception)
+		{
+			std::wcout << L"Mesh loading failed: " << exception.what() << L"!\n";
+		}
+		catch (...)
+		{
+			std::wcout << L"Mesh loading failed!\n";
+		}
+		return nullptr;
 	}
 
 
+	void Renderer::InitLights()
+	{
+		//Sun, lights every pixel
+		Light sun{};
+		sun.type = LightType::Directional;
+		sun.direction = Vector3{ 0.577f, -0.577f, 0.577f };
+		sun.intensity = 7.f;
+		//Only the software rasterizer renders shadow maps
+		sun.castsShadows = true;
+		m_Lights.push_back(sun);
+
+		//Ring of colored point lights around the vehicle, each one only reaches part of it
+		const Vector3 center{ 0.f, 0.f, 50.f };
+		const float ringRadius{ 28.f };
+		for (uint32_t lightIdx{}; lightIdx < m_NumPointLights; ++lightIdx)
+		{
+			const float angle{ 2.f * PI * lightIdx / m_NumPointLights };
+
+			Light pointLight{};
+			pointLight.type = LightType::Point;
+			pointLight.position = center + Vector3{ cosf(angle) * ringRadius, -6.f + (lightIdx % 4) * 4.f, sinf(angle) * ringRadius };
+			pointLight.color = ColorRGB{ 0.5f + 0.5f * cosf(angle), 0.5f + 0.5f * cosf(angle + 2.094f), 0.5f + 0.5f * cosf(angle + 4.189f) };
+			pointLight.intensity = 150.f;
+			pointLight.range = 18.f;
+			m_Lights.push_back(pointLight);
+		}
+	}
+
 	void Renderer::PrintHeader() const
 	{
 		//Shared Keybindings
@@ -248,14 +436,11 @@ namespace dae {
 		std::wcout << "\t[F1]\tToggle Rasterizer Mode (HARDWARE/SOFTWARE)\n";
 		std::wcout << "\t[F2]\tToggle Vehicle Rotation (ON/OFF)\n";
 		std::wcout << "\t[F3]\tToggle FireFX (ON/OFF)\n";
+		std::wcout << "\t[F4]\tCycle Sampler State (POINT/LINEAR/ANISOTROPIC)\n";
 		std::wcout << "\t[F9]\tCycle CullMode (BACK/FRONT/NONE)\n";
 		std::wcout << "\t[F10]\tUniform ClearColor (ON/OFF)\n";
 		std::wcout << "\t[F11]\tToggle Print FPS (ON/OFF)" << "\033[0m" << "\n\n";
 
-		//Hardware Keybindings
-		std::wcout << "\033[32m" << "[Key Bindings - HARDWARE]\n";
-		std::wcout << "\t[F4]\tCycle Sampler State (POINT/LINEAR/ANISOTROPIC)" << "\033[0m" << "\n\n";
-
 		//Software Keybindings
 		std::wcout << "\033[35m" << "[Key Bindings - SOFTWARE]\n";
 		std::wcout << "\t[F5]\tToggle Shading Mode (COMBINED/OBSERVED_AREA/DIFFUSE/SPECULAR)\n";
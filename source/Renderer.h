@@ -1,5 +1,7 @@
 #pragma once
 #include "Camera.h"
+#include "SceneBVH.h"
+#include <ppltasks.h>
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -10,6 +12,14 @@ namespace dae
 	class ProcessorGPU;
 	class ProcessorCPU;
 	class Mesh;
+	class MeshGeometry;
+	class Effect;
+	class TextureStreamer;
+	class ResourceManager;
+	namespace ObjParser
+	{
+		struct Material;
+	}
 	class Renderer final
 	{
 	public:
@@ -56,11 +66,32 @@ namespace dae
 
 		bool m_IsInitialized{ false };
 		bool m_ShouldRotate{ true };
+
+		//Options of the meshes, kept here so meshes that finish loading later get them as well
+		SamplerState m_SamplerState{ SamplerState::Point };
+		CullMode m_CullMode{ CullMode::Back };
+		bool m_ShouldRenderFireFx{ true };
+		//Null while the fire is loading, or when it failed to load
+		Mesh* m_pFireFxMesh{ nullptr };
 		const float m_RotationSpeed{ TO_RADIANS * 45.f };
 
 		std::vector<Mesh*> m_Meshes{};
 		Camera m_Camera{};
 
+		//The vehicle is drawn as a grid of instances, the middle column of the first row is at the position of the mesh
+		static constexpr int m_NumFleetRows{ 3 };
+		static constexpr int m_NumFleetColumns{ 3 };
+		static constexpr float m_FleetSpacing{ 30.f };
+
+		//Lighting, shared by both processors
+		std::vector<Light> m_Lights{};
+		const uint32_t m_NumPointLights{ 48 };
+		void InitLights();
+
+		//Culling
+		SceneBVH m_SceneBVH{};
+		std::vector<Mesh*> m_VisibleMeshes{};
+
 		//Background color
 		bool m_IsBackgroundUniform{ false };
 
@@ -68,6 +99,32 @@ namespace dae
 		ID3D11Device* m_pDevice;
 		ID3D11DeviceContext* m_pDeviceContext;
 		void InitMeshes(ID3D11Device* pDevice);
+		//One effect per material of the geometry, from the material libraries of the model.
+		//Materials the libraries do not define, and models without materials, use the fallback
+		static std::vector<Effect*> CreateMaterialEffects(ID3D11Device* pDevice, ResourceManager* pResourceManager, const MeshGeometry& geometry,
+			const ObjParser::Material& fallbackMaterial);
+		static Effect* CreateMaterialEffect(ID3D11Device* pDevice, ResourceManager* pResourceManager, const ObjParser::Material& material);
+		//Moves the meshes that finished loading into the scene, returns whether there were any
+		bool AddLoadedMeshes();
+		//Waits for the load, a load that failed is reported and gives nullptr
+		static Mesh* GetLoadedMesh(const concurrency::task<Mesh*>& meshTask);
+
+		//Meshes that are still loading, in the order they are added to the scene
+		struct MeshTask
+		{
+			concurrency::task<Mesh*> task{};
+			bool isFireFx{ false };
+		};
+		std::vector<MeshTask> m_MeshTasks{};
+
+		//Textures are streamed in on first use, their resident mips have to fit in the budget
+		TextureStreamer* m_pTextureStreamer{ nullptr };
+		static constexpr size_t m_TextureBudgetBytes{ 256 * 1024 * 1024 };
+
+		//Shares the textures and geometry of the meshes, every unique asset is loaded once
+		ResourceManager* m_pResourceManager{ nullptr };
+		//Quantized vertices take less than half the memory and bandwidth of float vertices, see VertexQuantization
+		static constexpr VertexFormat m_VertexFormat{ VertexFormat::Quantized };
 
 		
 		//Processors
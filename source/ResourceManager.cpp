@@ -0,0 +1,179 @@
+#include "pch.h"
+#include "ResourceManager.h"
+#include "MeshGeometry.h"
+#include "ObjParser.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint64_t FnvOffsetBasis{ 14695981039346656037ull };
+		constexpr uint64_t FnvPrime{ 1099511628211ull };
+
+		std::string ToHex(uint64_t hash)
+		{
+			std::ostringstream hashText{};
+			hashText << std::hex << std::setw(16) << std::setfill('0') << hash;
+			return hashText.str();
+		}
+
+		//Appends the fallback of a texture to its key, textures with another fallback sample differently until they are resident
+		void AppendFallback(std::ostringstream& key, const Vector4& fallback)
+		{
+			key << '|' << fallback.x << ',' << fallback.y << ',' << fallback.z << ',' << fallback.w;
+		}
+	}
+
+	ResourceManager::ResourceManager(ID3D11Device* pDevice, TextureStreamer* pTextureStreamer)
+		: m_pDevice{ pDevice }
+		, m_pTextureStreamer{ pTextureStreamer }
+	{
+	}
+
+	template<typename T, typename LoadFunction>
+	std::shared_ptr<T> ResourceManager::GetOrLoad(EntryMap<T>& entries, const std::string& key, LoadFunction load)
+	{
+		std::shared_ptr<Entry<T>> pEntry{};
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+
+			//Entries of freed assets are removed once the map has doubled, so it stays proportional to the live assets.
+			//Handles to entries are only taken under the lock, an entry only the map holds is not loading
+			if (entries.entries.size() >= std::max(2 * entries.numSweptEntries, m_MinSweepEntries))
+			{
+				std::erase_if(entries.entries, [](const auto& keyEntry)
+				{
+					return keyEntry.second.use_count() == 1 && keyEntry.second->pResource.expired();
+				});
+				entries.numSweptEntries = entries.entries.size();
+			}
+
+			std::shared_ptr<Entry<T>>& pMapEntry{ entries.entries[key] };
+			if (!pMapEntry) pMapEntry = std::make_shared<Entry<T>>();
+			pEntry = pMapEntry;
+		}
+
+		std::lock_guard<std::mutex> lock{ pEntry->mutex };
+		std::shared_ptr<T> pResource{ pEntry->pResource.lock() };
+		if (!pResource)
+		{
+			pResource = load();
+			pEntry->pResource = pResource;
+		}
+		return pResource;
+	}
+
+	std::shared_ptr<Texture> ResourceManager::LoadTexture(const std::string& path, const Vector4& fallback)
+	{
+		std::ostringstream key{};
+		key << "file:" << GetFileKey(path);
+		AppendFallback(key, fallback);
+
+		return GetOrLoad(m_Textures, key.str(), [&]()
+		{
+			return std::shared_ptr<Texture>{ Texture::CreateStreamed(m_pDevice, m_pTextureStreamer, [path]()
+			{
+				return Texture::LoadFromFile(nullptr, path);
+			}, fallback) };
+		});
+	}
+
+	std::shared_ptr<Texture> ResourceManager::LoadPackedTexture(const std::array<Texture::PackedChannel, 4>& channels, bool encodeNormal, const Vector4& fallback)
+	{
+		//Channels without a path only contribute their default value
+		std::ostringstream key{};
+		key << "packed:" << encodeNormal;
+		for (const Texture::PackedChannel& channel : channels)
+		{
+			key << '|';
+			if (channel.path.empty()) key << static_cast<uint32_t>(channel.defaultValue);
+			else key << GetFileKey(channel.path) << '.' << channel.sourceChannel << '.' << static_cast<uint32_t>(channel.defaultValue);
+		}
+		AppendFallback(key, fallback);
+
+		return GetOrLoad(m_Textures, key.str(), [&]()
+		{
+			return std::shared_ptr<Texture>{ Texture::CreateStreamed(m_pDevice, m_pTextureStreamer, [channels, encodeNormal]()
+			{
+				return Texture::LoadPacked(nullptr, channels, encodeNormal);
+			}, fallback) };
+		});
+	}
+
+	std::shared_ptr<const MeshGeometry> ResourceManager::LoadMesh(const std::string& objPath, VertexFormat vertexFormat)
+	{
+		//A cache that is up to date knows the hash of the model, so the model is not read at all
+		const std::string cachePath{ MeshCache::GetCachePath(objPath, vertexFormat) };
+		uint64_t contentHash{};
+		if (!MeshCache::ReadSourceHash(cachePath, objPath, contentHash)) contentHash = GetContentHash(objPath);
+
+		const std::string key{ (vertexFormat == VertexFormat::Quantized ? "obj-quantized:" : "obj:") + ToHex(contentHash) };
+		return GetOrLoad(m_Meshes, key, [&]()
+		{
+			//1. Use the cache in place when it was built from this model
+			MeshGeometry::View view{};
+			std::unique_ptr<MappedFile> pCacheFile{ MeshCache::Open(cachePath, contentHash, vertexFormat, view) };
+			if (pCacheFile) return std::make_shared<const MeshGeometry>(m_pDevice, std::move(pCacheFile), view);
+
+			//2. Parse and process the model, and cache the result for the next run
+			std::vector<Vertex> vertices{};
+			std::vector<uint32_t> indices{};
+			std::vector<Submesh> submeshes{};
+			MeshMaterials materials{};
+			const bool isParsed{ ObjParser::Parse(objPath, vertices, indices, submeshes, materials) };
+
+			std::shared_ptr<const MeshGeometry> pGeometry{ std::make_shared<const MeshGeometry>(m_pDevice, vertices, indices,
+				submeshes, materials, vertexFormat) };
+			if (isParsed) MeshCache::Write(cachePath, objPath, contentHash, *pGeometry);
+			return pGeometry;
+		});
+	}
+
+	std::string ResourceManager::GetFileKey(const std::string& path)
+	{
+		//Missing files only use their path, loading them reports the error
+		std::error_code error{};
+		const std::filesystem::path absolutePath{ std::filesystem::weakly_canonical(path, error) };
+		std::ostringstream key{};
+		key << (error ? path : absolutePath.string());
+
+		const uintmax_t size{ std::filesystem::file_size(absolutePath, error) };
+		if (error) return key.str();
+		const std::filesystem::file_time_type writeTime{ std::filesystem::last_write_time(absolutePath, error) };
+		if (error) return key.str();
+
+		key << '|' << size << '|' << writeTime.time_since_epoch().count();
+		return key.str();
+	}
+
+	uint64_t ResourceManager::GetContentHash(const std::string& path)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			const auto it{ m_ContentHashes.find(path) };
+			if (it != m_ContentHashes.end()) return it->second;
+		}
+
+		//Missing files hash like empty ones, loading them reports the error
+		uint64_t hash{ FnvOffsetBasis };
+		std::ifstream file{ path, std::ios::binary };
+		char buffer[4096];
+		while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+		{
+			const std::streamsize numRead{ file.gcount() };
+			for (std::streamsize byteIdx{}; byteIdx < numRead; ++byteIdx)
+			{
+				hash ^= static_cast<uint8_t>(buffer[byteIdx]);
+				hash *= FnvPrime;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		return m_ContentHashes.emplace(path, hash).first->second;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Texture.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace dae
+{
+	class MeshGeometry;
+	class TextureStreamer;
+
+	//Loads every unique asset once and hands out shared handles to it. Textures are identified by their file, its size and
+	//write time, so creating an effect does not read any image. Meshes are identified by the hash of the contents of their file,
+	//which the mesh cache stores, so copies of the same model under another path share one resource as well.
+	//An asset is freed when its last handle is released and loaded again when it is requested after that.
+	//All functions can be called from several threads, different assets are loaded in parallel
+	class ResourceManager final
+	{
+	public:
+		ResourceManager(ID3D11Device* pDevice, TextureStreamer* pTextureStreamer);
+		~ResourceManager() = default;
+		ResourceManager(const ResourceManager&) = delete;
+		ResourceManager(ResourceManager&&) noexcept = delete;
+		ResourceManager& operator=(const ResourceManager&) = delete;
+		ResourceManager& operator=(ResourceManager&&) noexcept = delete;
+
+		//Textures are streamed, see Texture::CreateStreamed. The fallback is part of the identity of the texture
+		std::shared_ptr<Texture> LoadTexture(const std::string& path, const Vector4& fallback);
+		std::shared_ptr<Texture> LoadPackedTexture(const std::array<Texture::PackedChannel, 4>& channels, bool encodeNormal, const Vector4& fallback);
+
+		//Maps the cache of the OBJ file when it is up to date. Otherwise the file is parsed, its buffers and levels of detail
+		//are created and the cache is written, see MeshCache. The vertex format is part of the identity of the mesh
+		std::shared_ptr<const MeshGeometry> LoadMesh(const std::string& objPath, VertexFormat vertexFormat = VertexFormat::Float);
+
+	private:
+		//The mutex of an entry is held while its asset loads, so a second request for it waits instead of loading it again
+		template<typename T>
+		struct Entry
+		{
+			std::mutex mutex{};
+			std::weak_ptr<T> pResource{};
+		};
+
+		template<typename T>
+		struct EntryMap
+		{
+			std::unordered_map<std::string, std::shared_ptr<Entry<T>>> entries{};
+			//Number of entries after expired ones were last removed
+			size_t numSweptEntries{};
+		};
+		static constexpr size_t m_MinSweepEntries{ 64 };
+
+		template<typename T, typename LoadFunction>
+		std::shared_ptr<T> GetOrLoad(EntryMap<T>& entries, const std::string& key, LoadFunction load);
+
+		//FNV-1a hash of the file, files are hashed once and are not expected to change while running
+		uint64_t GetContentHash(const std::string& path);
+		//Absolute path, size and write time of the file, without reading it
+		static std::string GetFileKey(const std::string& path);
+
+		ID3D11Device* m_pDevice{ nullptr };
+		TextureStreamer* m_pTextureStreamer{ nullptr };
+
+		//Guards the maps, not the loads
+		std::mutex m_Mutex{};
+		std::unordered_map<std::string, uint64_t> m_ContentHashes{};
+		EntryMap<Texture> m_Textures{};
+		EntryMap<const MeshGeometry> m_Meshes{};
+	};
+}
@@ -3,19 +3,36 @@
 //-------
 
 float gPi = 3.14159265359f;
-float gLightIntensity = 7.f;
 float gShininess = 25.f;
-float3 gLightDirection = float3(0.577f, -0.577f, 0.577f);
 float4 gAmbientLight = float4(0.025f, 0.025f, 0.025f, 1.f );
 
-float4x4 gWorldViewProj : WorldViewProjection;
-float4x4 gWorld : WorldMatrix;
+//Has to match m_MaxShaderLights in EffectOpaque.h
+#define MAX_LIGHTS 256
+#define LIGHT_DIRECTIONAL 0
+#define LIGHT_SPOT 2
+
+//Filled by EffectOpaque::SetLights
+struct Light
+{
+	float4 PositionType;	//xyz position, w type
+	float4 DirectionRange;	//xyz direction the light travels in, w range
+	float4 ColorIntensity;	//rgb color, w intensity
+	float4 SpotAngles;		//x cos inner angle, y cos outer angle
+};
+Light gLights[MAX_LIGHTS];
+int gNumLights = 0;
+
+float4x4 gViewProj : ViewProjection;
 float4x4 gViewInverse : ViewInverse;
 
-Texture2D gDiffuseMap : DiffuseMap;
-Texture2D gNormalMap : NormalMap;
-Texture2D gSpecularMap : SpecularMap;
-Texture2D gGlossinessMap : GlossinessMap;
+//Set for meshes with quantized vertices, see VertexQuantization.h. Positions are unorm inside the bounds of the mesh,
+//normals and tangents are octahedral snorm in xy
+bool gIsQuantized = false;
+float3 gPositionOffset = float3(0.f, 0.f, 0.f);
+float3 gPositionScale = float3(1.f, 1.f, 1.f);
+
+Texture2D gDiffuseGlossMap : DiffuseGlossMap;		//rgb diffuse, a glossiness
+Texture2D gNormalSpecularMap : NormalSpecularMap;	//rg hemi-octahedral tangent space normal, b specular
 
 SamplerState gSampleState : SampleState
 {
@@ -54,6 +71,12 @@ struct VS_INPUT
 	float3 Normal : NORMAL;
 	float3 Tangent : TANGENT;
 
+	//Per instance data
+	float4 World0 : WORLD0;
+	float4 World1 : WORLD1;
+	float4 World2 : WORLD2;
+	float4 World3 : WORLD3;
+	float3 Tint : TINT;
 };
 
 struct VS_OUTPUT
@@ -63,19 +86,40 @@ struct VS_OUTPUT
 	float4 WorldPosition : COLOR;
 	float3 Normal : NORMAL;
 	float3 Tangent : TANGENT;
+	float3 Tint : TINT;
 };
 
 //---------------
 //	Vertex Shader
 //---------------
+float3 DecodeOctahedral(float2 encoded)
+{
+	float3 direction = float3(encoded, 1.f - abs(encoded.x) - abs(encoded.y));
+	float fold = saturate(-direction.z);
+	direction.xy += direction.xy >= 0.f ? -fold : fold;
+	return normalize(direction);
+}
+
 VS_OUTPUT VS(VS_INPUT input)
 {
 	VS_OUTPUT output = (VS_OUTPUT)0;
-	output.Position = mul(float4(input.Position, 1.f), gWorldViewProj);
-	output.WorldPosition = mul(float4(input.Position, 1.f), gWorld);
-	output.Normal = mul(normalize(input.Normal), (float3x3)gWorld);
-	output.Tangent = mul(normalize(input.Tangent), (float3x3)gWorld);
+	float4x4 world = float4x4(input.World0, input.World1, input.World2, input.World3);
+	float3 position = input.Position;
+	float3 normal = input.Normal;
+	float3 tangent = input.Tangent;
+	if (gIsQuantized)
+	{
+		position = gPositionOffset + position * gPositionScale;
+		normal = DecodeOctahedral(normal.xy);
+		tangent = DecodeOctahedral(tangent.xy);
+	}
+
+	output.WorldPosition = mul(float4(position, 1.f), world);
+	output.Position = mul(output.WorldPosition, gViewProj);
+	output.Normal = mul(normalize(normal), (float3x3)world);
+	output.Tangent = mul(normalize(tangent), (float3x3)world);
 	output.UV = input.UV;
+	output.Tint = input.Tint;
 	return output;
 }
 
@@ -83,9 +127,33 @@ VS_OUTPUT VS(VS_INPUT input)
 //	Pixel Shader
 //-------------
 
-float4 CalculateDiffuse(float kd, float4 color)
+float4 CalculateDiffuse(float kd, float4 color, float intensity)
+{
+	return ((color * kd) / gPi) * intensity;
+}
+
+//Direction the light travels in at the position and the fraction of its intensity that reaches it
+void GetLightDirection(Light light, float3 position, out float3 lightDirection, out float attenuation)
 {
-	return ((color * kd) / gPi) * gLightIntensity;
+	lightDirection = light.DirectionRange.xyz;
+	attenuation = 1.f;
+	if (light.PositionType.w == LIGHT_DIRECTIONAL) return;
+
+	float3 toPosition = position - light.PositionType.xyz;
+	float sqrDistance = max(dot(toPosition, toPosition), 0.01f);
+	lightDirection = toPosition * rsqrt(sqrDistance);
+
+	//Inverse square falloff, windowed so it reaches zero at the range
+	float rangeRatio = sqrDistance / (light.DirectionRange.w * light.DirectionRange.w);
+	float window = saturate(1.f - rangeRatio * rangeRatio);
+	attenuation = window * window / sqrDistance;
+
+	if (light.PositionType.w == LIGHT_SPOT)
+	{
+		float cosAngle = dot(lightDirection, light.DirectionRange.xyz);
+		float cone = saturate((cosAngle - light.SpotAngles.y) / max(light.SpotAngles.x - light.SpotAngles.y, 0.0001f));
+		attenuation *= cone * cone;
+	}
 }
 
 float4 CalculateSpecular(float4 specularColor, float ks, float exp, float3 lightDir, float3 viewDir, float3 normal)
@@ -98,20 +166,37 @@ float4 CalculateSpecular(float4 specularColor, float ks, float exp, float3 light
 
 float4 PS(VS_OUTPUT input) : SV_TARGET
 {
-	float3 binormal = cross(input.Normal, input.Tangent);
-	float4x4 tangentSpaceAxis = float4x4(float4(input.Tangent, 0.f), float4(normalize(binormal), 0.f), float4(input.Normal, 0.f), float4(0.f, 0.f, 0.f, 1.f));
-	float3 sampledNormal = gNormalMap.Sample(gSampleState, input.UV).rgb;
-	sampledNormal = (2.f * sampledNormal) - float3(1.f, 1.f, 1.f);
-	sampledNormal = normalize(mul(float4(sampledNormal, 0.f), tangentSpaceAxis));	
+	float3 binormal = normalize(cross(input.Normal, input.Tangent));
+	float3x3 tangentSpaceAxis = float3x3(input.Tangent, binormal, input.Normal);
+	float4 diffuseGloss = gDiffuseGlossMap.Sample(gSampleState, input.UV);
+	float4 normalSpecular = gNormalSpecularMap.Sample(gSampleState, input.UV);
 
-	float observedArea = saturate(dot(sampledNormal, -gLightDirection));
-	float4 lambert = CalculateDiffuse(1.f, gDiffuseMap.Sample(gSampleState, input.UV));
+	//Hemi-octahedral decode, the result is normalized once after the transform to world space
+	float2 encoded = (2.f * normalSpecular.rg) - float2(1.f, 1.f);
+	float2 octahedron = float2(encoded.x + encoded.y, encoded.x - encoded.y) * 0.5f;
+	float3 sampledNormal = float3(octahedron, 1.f - abs(octahedron.x) - abs(octahedron.y));
+	sampledNormal = normalize(mul(sampledNormal, tangentSpaceAxis));
 
 	float3 viewDirection = normalize(input.WorldPosition.xyz - gViewInverse[3].xyz);
-	float phongExp = gShininess * gGlossinessMap.Sample(gSampleState, input.UV).r;
-	float4 phong = CalculateSpecular(gSpecularMap.Sample(gSampleState, input.UV), 1.f, phongExp, gLightDirection, -viewDirection, sampledNormal);
+	float phongExp = gShininess * diffuseGloss.a;
+
+	float4 color = gAmbientLight;
+	for (int lightIdx = 0; lightIdx < gNumLights; ++lightIdx)
+	{
+		Light light = gLights[lightIdx];
+		float3 lightDirection;
+		float attenuation;
+		GetLightDirection(light, input.WorldPosition.xyz, lightDirection, attenuation);
+
+		float observedArea = saturate(dot(sampledNormal, -lightDirection));
+		float4 lambert = CalculateDiffuse(1.f, float4(diffuseGloss.rgb * input.Tint * light.ColorIntensity.rgb, 1.f), light.ColorIntensity.w);
+
+		//The specular term is scaled by the light color but not by its intensity
+		float4 phong = CalculateSpecular(normalSpecular.bbbb, 1.f, phongExp, lightDirection, -viewDirection, sampledNormal);
+		color += (lambert * observedArea + phong * float4(light.ColorIntensity.rgb, 1.f)) * attenuation;
+	}
 
-	return lambert * observedArea + phong + gAmbientLight;
+	return color;
 }
 
 //---------------
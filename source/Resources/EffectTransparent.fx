@@ -2,7 +2,12 @@
 //Global Variables
 //-------
 
-float4x4 gWorldViewProj : WorldViewProjection;
+float4x4 gViewProj : ViewProjection;
+
+//Set for meshes with quantized vertices, see VertexQuantization.h. Positions are unorm inside the bounds of the mesh
+bool gIsQuantized = false;
+float3 gPositionOffset = float3(0.f, 0.f, 0.f);
+float3 gPositionScale = float3(1.f, 1.f, 1.f);
 
 Texture2D gDiffuseMap : DiffuseMap;
 
@@ -49,12 +54,19 @@ struct VS_INPUT
 	float3 Normal : NORMAL;
 	float3 Tangent : TANGENT;
 
+	//Per instance data
+	float4 World0 : WORLD0;
+	float4 World1 : WORLD1;
+	float4 World2 : WORLD2;
+	float4 World3 : WORLD3;
+	float3 Tint : TINT;
 };
 
 struct VS_OUTPUT
 {
 	float4 Position : SV_POSITION;
 	float2 UV : TEXCOORD;
+	float3 Tint : TINT;
 };
 
 //---------------
@@ -63,8 +75,11 @@ struct VS_OUTPUT
 VS_OUTPUT VS(VS_INPUT input)
 {
 	VS_OUTPUT output = (VS_OUTPUT)0;
-	output.Position = mul(float4(input.Position, 1.f), gWorldViewProj);
+	float4x4 world = float4x4(input.World0, input.World1, input.World2, input.World3);
+	float3 position = gIsQuantized ? gPositionOffset + input.Position * gPositionScale : input.Position;
+	output.Position = mul(mul(float4(position, 1.f), world), gViewProj);
 	output.UV = input.UV;
+	output.Tint = input.Tint;
 	return output;
 }
 
@@ -75,7 +90,7 @@ VS_OUTPUT VS(VS_INPUT input)
 
 float4 PS(VS_OUTPUT input) : SV_TARGET
 {
-	return gDiffuseMap.Sample(gSampleState, input.UV);
+	return gDiffuseMap.Sample(gSampleState, input.UV) * float4(input.Tint, 1.f);
 }
 
 //---------------
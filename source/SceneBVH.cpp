@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "SceneBVH.h"
+#include "Mesh.h"
+#include "Utils.h"
+
+namespace dae
+{
+	void SceneBVH::Build(const std::vector<Mesh*>& meshes)
+	{
+		m_Meshes = meshes;
+		m_Nodes.clear();
+		m_LeafOfMesh.assign(meshes.size(), m_InvalidIdx);
+
+		if (meshes.empty()) return;
+
+		//A binary tree with one mesh per leaf has 2n - 1 nodes
+		m_Nodes.reserve(meshes.size() * 2 - 1);
+		m_BuildOrder.resize(meshes.size());
+		for (uint32_t meshIdx{}; meshIdx < meshes.size(); ++meshIdx)
+		{
+			m_BuildOrder[meshIdx] = meshIdx;
+		}
+
+		BuildRecursive(0, static_cast<uint32_t>(meshes.size()), m_InvalidIdx);
+
+		m_NodeStack.reserve(m_Nodes.size());
+		m_VisibleIndices.reserve(meshes.size());
+	}
+
+	void SceneBVH::Refit(uint32_t meshIdx)
+	{
+		if (meshIdx >= m_LeafOfMesh.size()) return;
+
+		uint32_t nodeIdx{ m_LeafOfMesh[meshIdx] };
+		m_Nodes[nodeIdx].bounds = m_Meshes[meshIdx]->GetWorldBounds();
+
+		//Walk up to the root, every parent is the union of its two children
+		nodeIdx = m_Nodes[nodeIdx].parentIdx;
+		while (nodeIdx != m_InvalidIdx)
+		{
+			Node& node{ m_Nodes[nodeIdx] };
+			BoundingBox bounds{ m_Nodes[node.leftIdx].bounds };
+			bounds.Grow(m_Nodes[node.rightIdx].bounds);
+			node.bounds = bounds;
+
+			nodeIdx = node.parentIdx;
+		}
+	}
+
+	void SceneBVH::QueryFrustum(const Frustum& frustum, std::vector<Mesh*>& visibleMeshes)
+	{
+		visibleMeshes.clear();
+		if (m_Nodes.empty()) return;
+
+		m_VisibleIndices.clear();
+		m_NodeStack.clear();
+		m_NodeStack.push_back(0);
+
+		while (!m_NodeStack.empty())
+		{
+			const uint32_t nodeIdx{ m_NodeStack.back() };
+			m_NodeStack.pop_back();
+
+			//A subtree is skipped as soon as its bounds are outside of the frustum
+			const Node& node{ m_Nodes[nodeIdx] };
+			if (!GeometryUtils::IsBoxInFrustum(frustum, node.bounds)) continue;
+
+			if (node.meshIdx != m_InvalidIdx)
+			{
+				m_VisibleIndices.push_back(node.meshIdx);
+				continue;
+			}
+
+			m_NodeStack.push_back(node.leftIdx);
+			m_NodeStack.push_back(node.rightIdx);
+		}
+
+		//Keep the original order, transparent meshes have to be rendered after the opaque ones
+		std::sort(m_VisibleIndices.begin(), m_VisibleIndices.end());
+		for (const uint32_t meshIdx : m_VisibleIndices)
+		{
+			visibleMeshes.push_back(m_Meshes[meshIdx]);
+		}
+	}
+
+	uint32_t SceneBVH::BuildRecursive(uint32_t firstIdx, uint32_t lastIdx, uint32_t parentIdx)
+	{
+		const uint32_t nodeIdx{ static_cast<uint32_t>(m_Nodes.size()) };
+		m_Nodes.emplace_back();
+		m_Nodes[nodeIdx].parentIdx = parentIdx;
+
+		//Bounds of the meshes and of their centers, the centers decide the split
+		BoundingBox bounds{};
+		BoundingBox centerBounds{};
+		for (uint32_t orderIdx{ firstIdx }; orderIdx < lastIdx; ++orderIdx)
+		{
+			const BoundingBox& meshBounds{ m_Meshes[m_BuildOrder[orderIdx]]->GetWorldBounds() };
+			bounds.Grow(meshBounds);
+			centerBounds.Grow(meshBounds.GetCenter());
+		}
+		m_Nodes[nodeIdx].bounds = bounds;
+
+		if (lastIdx - firstIdx == 1)
+		{
+			const uint32_t meshIdx{ m_BuildOrder[firstIdx] };
+			m_Nodes[nodeIdx].meshIdx = meshIdx;
+			m_LeafOfMesh[meshIdx] = nodeIdx;
+			return nodeIdx;
+		}
+
+		//Median split along the largest axis of the centers
+		const Vector3 extent{ centerBounds.GetExtent() };
+		int axis{ 0 };
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		const uint32_t middleIdx{ (firstIdx + lastIdx) / 2 };
+		std::nth_element(m_BuildOrder.begin() + firstIdx, m_BuildOrder.begin() + middleIdx, m_BuildOrder.begin() + lastIdx,
+			[this, axis](uint32_t a, uint32_t b)
+			{
+				return m_Meshes[a]->GetWorldBounds().GetCenter()[axis] < m_Meshes[b]->GetWorldBounds().GetCenter()[axis];
+			});
+
+		//Children are appended to the node array, so only store indices
+		const uint32_t leftIdx{ BuildRecursive(firstIdx, middleIdx, nodeIdx) };
+		const uint32_t rightIdx{ BuildRecursive(middleIdx, lastIdx, nodeIdx) };
+		m_Nodes[nodeIdx].leftIdx = leftIdx;
+		m_Nodes[nodeIdx].rightIdx = rightIdx;
+		return nodeIdx;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "DataTypes.h"
+
+namespace dae
+{
+	class Mesh;
+
+	//Bounding volume hierarchy over the world bounds of the meshes in the scene.
+	//Moving meshes only refit the nodes above their leaf, the tree is not rebuilt.
+	class SceneBVH final
+	{
+	public:
+		SceneBVH() = default;
+		~SceneBVH() = default;
+
+		SceneBVH(const SceneBVH&) = delete;
+		SceneBVH(SceneBVH&&) noexcept = delete;
+		SceneBVH& operator=(const SceneBVH&) = delete;
+		SceneBVH& operator=(SceneBVH&&) noexcept = delete;
+
+		void Build(const std::vector<Mesh*>& meshes);
+		void Refit(uint32_t meshIdx);
+
+		//Fills visibleMeshes with the meshes that intersect the frustum, in the order they were passed to Build
+		void QueryFrustum(const Frustum& frustum, std::vector<Mesh*>& visibleMeshes);
+
+	private:
+		static constexpr uint32_t m_InvalidIdx{ UINT32_MAX };
+
+		struct Node
+		{
+			BoundingBox bounds{};
+			uint32_t parentIdx{ m_InvalidIdx };
+			uint32_t leftIdx{ m_InvalidIdx };
+			uint32_t rightIdx{ m_InvalidIdx };
+			uint32_t meshIdx{ m_InvalidIdx };
+		};
+
+		uint32_t BuildRecursive(uint32_t firstIdx, uint32_t lastIdx, uint32_t parentIdx);
+
+		std::vector<Mesh*> m_Meshes{};
+		std::vector<Node> m_Nodes{};
+		std::vector<uint32_t> m_LeafOfMesh{};
+
+		//Scratch buffers, kept between queries so a query does not allocate
+		std::vector<uint32_t> m_BuildOrder{};
+		std::vector<uint32_t> m_NodeStack{};
+		std::vector<uint32_t> m_VisibleIndices{};
+	};
+}
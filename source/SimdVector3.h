@@ -0,0 +1,58 @@
+#pragma once
+#include "FastMath.h"
+
+namespace dae
+{
+	//Four Vector3 in structure of arrays form, one SSE register per component.
+	//Used by the effects to shade four fragments at once
+	struct SimdVector3
+	{
+		__m128 x{};
+		__m128 y{};
+		__m128 z{};
+
+		static SimdVector3 Load(const float* pX, const float* pY, const float* pZ)
+		{
+			return SimdVector3{ _mm_load_ps(pX), _mm_load_ps(pY), _mm_load_ps(pZ) };
+		}
+
+		static SimdVector3 Set(const Vector3& v)
+		{
+			return SimdVector3{ _mm_set1_ps(v.x), _mm_set1_ps(v.y), _mm_set1_ps(v.z) };
+		}
+
+		static __m128 Dot(const SimdVector3& v1, const SimdVector3& v2)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(v1.x, v2.x), _mm_mul_ps(v1.y, v2.y)), _mm_mul_ps(v1.z, v2.z));
+		}
+
+		static SimdVector3 Cross(const SimdVector3& v1, const SimdVector3& v2)
+		{
+			return SimdVector3{
+				_mm_sub_ps(_mm_mul_ps(v1.y, v2.z), _mm_mul_ps(v1.z, v2.y)),
+				_mm_sub_ps(_mm_mul_ps(v1.z, v2.x), _mm_mul_ps(v1.x, v2.z)),
+				_mm_sub_ps(_mm_mul_ps(v1.x, v2.y), _mm_mul_ps(v1.y, v2.x))
+			};
+		}
+
+		SimdVector3 Normalized() const
+		{
+			return *this * FastMath::Rsqrt(Dot(*this, *this));
+		}
+
+		SimdVector3 operator*(__m128 scale) const
+		{
+			return SimdVector3{ _mm_mul_ps(x, scale), _mm_mul_ps(y, scale), _mm_mul_ps(z, scale) };
+		}
+
+		SimdVector3 operator+(const SimdVector3& v) const
+		{
+			return SimdVector3{ _mm_add_ps(x, v.x), _mm_add_ps(y, v.y), _mm_add_ps(z, v.z) };
+		}
+
+		SimdVector3 operator-(const SimdVector3& v) const
+		{
+			return SimdVector3{ _mm_sub_ps(x, v.x), _mm_sub_ps(y, v.y), _mm_sub_ps(z, v.z) };
+		}
+	};
+}
@@ -1,19 +1,262 @@
 #include "pch.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
+#include <atomic>
+#include <fstream>
+#include <emmintrin.h>
 
 
 namespace dae
 {
-	Texture::Texture(ID3D11Device* pDevice, SDL_Surface* pSurface)
-		: m_pSurface{pSurface}
-		, m_pSurfacePixels{ static_cast<uint32_t*>(pSurface->pixels) }
+#ifdef TEXTURE_FETCH_STATISTICS
+	namespace
 	{
-		//Create Resource
-		DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		std::atomic<uint64_t> g_NumSamples{};
+		std::atomic<uint64_t> g_NumCacheLineFetches{};
+
+		//Cache lines touched by the current sample of this thread. A line is counted once while it is one of the last few lines
+		constexpr uint32_t RecentLineCount{ 8 };
+		thread_local uintptr_t t_RecentLines[RecentLineCount]{};
+		thread_local uint32_t t_NextRecentLineIdx{};
+
+		void BeginSample()
+		{
+			g_NumSamples.fetch_add(1, std::memory_order_relaxed);
+			std::fill(std::begin(t_RecentLines), std::end(t_RecentLines), uintptr_t{});
+		}
+
+		void CountFetch(const void* pTexel)
+		{
+			const uintptr_t line{ reinterpret_cast<uintptr_t>(pTexel) / 64 };
+			if (std::find(std::begin(t_RecentLines), std::end(t_RecentLines), line) != std::end(t_RecentLines)) return;
+
+			t_RecentLines[t_NextRecentLineIdx] = line;
+			t_NextRecentLineIdx = (t_NextRecentLineIdx + 1) % RecentLineCount;
+			g_NumCacheLineFetches.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+#endif
+
+	namespace
+	{
+		std::atomic<uint32_t> g_NextTextureId{ 1 };
+
+		//DDS file layout, see the DirectDraw Surface documentation
+		constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+		{
+			return static_cast<uint32_t>(static_cast<uint8_t>(a)) | (static_cast<uint32_t>(static_cast<uint8_t>(b)) << 8)
+				| (static_cast<uint32_t>(static_cast<uint8_t>(c)) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(d)) << 24);
+		}
+
+		struct DDSPixelFormat
+		{
+			uint32_t size;
+			uint32_t flags;
+			uint32_t fourCC;
+			uint32_t rgbBitCount;
+			uint32_t bitMasks[4];
+		};
+
+		struct DDSHeader
+		{
+			uint32_t size;
+			uint32_t flags;
+			uint32_t height;
+			uint32_t width;
+			uint32_t pitchOrLinearSize;
+			uint32_t depth;
+			uint32_t mipMapCount;
+			uint32_t reserved1[11];
+			DDSPixelFormat pixelFormat;
+			uint32_t caps[4];
+			uint32_t reserved2;
+		};
+
+		struct DDSHeaderDX10
+		{
+			uint32_t dxgiFormat;
+			uint32_t resourceDimension;
+			uint32_t miscFlag;
+			uint32_t arraySize;
+			uint32_t miscFlags2;
+		};
+
+		//A block decoded to 4x4 RGBA8 texels, row by row
+		struct DecodedBlock
+		{
+			uint32_t textureId{};
+			const uint8_t* pBlock{ nullptr };
+			uint8_t texels[64]{};
+		};
+
+		//Direct mapped on the block address. The taps of a bilinear sample and the neighbouring pixels of a batch
+		//mostly read the same few blocks, so a handful of entries per thread avoids most decodes
+		constexpr uint32_t DecodedBlockCacheSize{ 32 };
+		thread_local DecodedBlock t_DecodedBlocks[DecodedBlockCacheSize]{};
+
+		void DecodeColor565(uint32_t color, uint8_t* pRGB)
+		{
+			const uint32_t red{ (color >> 11) & 0x1F };
+			const uint32_t green{ (color >> 5) & 0x3F };
+			const uint32_t blue{ color & 0x1F };
+			pRGB[0] = static_cast<uint8_t>((red << 3) | (red >> 2));
+			pRGB[1] = static_cast<uint8_t>((green << 2) | (green >> 4));
+			pRGB[2] = static_cast<uint8_t>((blue << 3) | (blue >> 2));
+		}
+
+		//Two 565 end points and a 2 bit index per texel. Only BC1 has the three color mode with transparent black,
+		//the color block of BC3 always interpolates four colors
+		void DecodeColorBlock(const uint8_t* pBlock, bool allowTransparency, uint8_t* pTexels)
+		{
+			const uint32_t color0{ pBlock[0] | (static_cast<uint32_t>(pBlock[1]) << 8) };
+			const uint32_t color1{ pBlock[2] | (static_cast<uint32_t>(pBlock[3]) << 8) };
+			const bool fourColors{ color0 > color1 || !allowTransparency };
+
+			uint8_t palette[4][4]{};
+			DecodeColor565(color0, palette[0]);
+			DecodeColor565(color1, palette[1]);
+			for (uint32_t channel{}; channel < 3; ++channel)
+			{
+				const uint32_t value0{ palette[0][channel] };
+				const uint32_t value1{ palette[1][channel] };
+				if (fourColors)
+				{
+					palette[2][channel] = static_cast<uint8_t>((2 * value0 + value1 + 1) / 3);
+					palette[3][channel] = static_cast<uint8_t>((value0 + 2 * value1 + 1) / 3);
+				}
+				else
+				{
+					palette[2][channel] = static_cast<uint8_t>((value0 + value1) / 2);
+				}
+			}
+			palette[0][3] = palette[1][3] = palette[2][3] = 255;
+			palette[3][3] = fourColors ? 255 : 0;
+
+			const uint32_t indices{ pBlock[4] | (static_cast<uint32_t>(pBlock[5]) << 8)
+				| (static_cast<uint32_t>(pBlock[6]) << 16) | (static_cast<uint32_t>(pBlock[7]) << 24) };
+			for (uint32_t texelIdx{}; texelIdx < 16; ++texelIdx)
+			{
+				std::copy_n(palette[(indices >> (texelIdx * 2)) & 0x3], 4, pTexels + texelIdx * 4);
+			}
+		}
+
+		//Two 8 bit end points and a 3 bit index per texel, the alpha of BC3 and both channels of BC5.
+		//Only the given channel of the texels is written
+		void DecodeChannelBlock(const uint8_t* pBlock, uint32_t channel, uint8_t* pTexels)
+		{
+			const uint32_t value0{ pBlock[0] };
+			const uint32_t value1{ pBlock[1] };
+
+			uint8_t palette[8]{ pBlock[0], pBlock[1] };
+			if (value0 > value1)
+			{
+				for (uint32_t step{ 1 }; step < 7; ++step)
+				{
+					palette[step + 1] = static_cast<uint8_t>(((7 - step) * value0 + step * value1 + 3) / 7);
+				}
+			}
+			else
+			{
+				for (uint32_t step{ 1 }; step < 5; ++step)
+				{
+					palette[step + 1] = static_cast<uint8_t>(((5 - step) * value0 + step * value1 + 2) / 5);
+				}
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+
+			uint64_t indices{};
+			for (uint32_t byteIdx{}; byteIdx < 6; ++byteIdx)
+			{
+				indices |= static_cast<uint64_t>(pBlock[2 + byteIdx]) << (byteIdx * 8);
+			}
+			for (uint32_t texelIdx{}; texelIdx < 16; ++texelIdx)
+			{
+				pTexels[texelIdx * 4 + channel] = palette[(indices >> (texelIdx * 3)) & 0x7];
+			}
+		}
+	}
+
+	Texture::MipLevel::MipLevel(uint32_t _width, uint32_t _height, const TexelLayout& _layout)
+		: width{ _width }
+		, height{ _height }
+		, columns{ (_width + _layout.blockSize - 1) / _layout.blockSize }
+		, rows{ (_height + _layout.blockSize - 1) / _layout.blockSize }
+		, tilesPerRow{ (columns + _layout.tileWidth - 1) / _layout.tileWidth }
+		, layout{ _layout }
+		, tiles(static_cast<size_t>(tilesPerRow) * ((rows + _layout.tileHeight - 1) / _layout.tileHeight))
+	{
+	}
+
+	uint8_t* Texture::MipLevel::Texel(uint32_t x, uint32_t y)
+	{
+		const uint32_t localIdx{ (y % layout.tileHeight) * layout.tileWidth + x % layout.tileWidth };
+		return tiles[(y / layout.tileHeight) * tilesPerRow + x / layout.tileWidth].bytes + localIdx * layout.bytesPerTexel;
+	}
+
+	const uint8_t* Texture::MipLevel::Texel(uint32_t x, uint32_t y) const
+	{
+		const uint32_t localIdx{ (y % layout.tileHeight) * layout.tileWidth + x % layout.tileWidth };
+		return tiles[(y / layout.tileHeight) * tilesPerRow + x / layout.tileWidth].bytes + localIdx * layout.bytesPerTexel;
+	}
+
+	Texture::Texture(ID3D11Device* pDevice, SDL_Surface* pSurface, TextureUsage usage)
+		: m_pDevice{ pDevice }
+		, m_Usage{ usage }
+		, m_Id{ g_NextTextureId.fetch_add(1, std::memory_order_relaxed) }
+	{
+		//The software rasterizer samples the mip chain, the surface is not needed afterwards
+		BuildMipChain(pSurface);
+		SDL_FreeSurface(pSurface);
+
+		CreateResource(pDevice);
+	}
+
+	Texture::Texture(ID3D11Device* pDevice, std::vector<MipLevel>&& mipLevels, BlockFormat blockFormat, TextureUsage usage)
+		: m_pDevice{ pDevice }
+		, m_Usage{ usage }
+		, m_BlockFormat{ blockFormat }
+		, m_MipLevels{ std::move(mipLevels) }
+		, m_Id{ g_NextTextureId.fetch_add(1, std::memory_order_relaxed) }
+	{
+		CreateResource(pDevice);
+	}
+
+	Texture::Texture(ID3D11Device* pDevice, TextureStreamer* pStreamer, Loader loader, const Vector4& fallback)
+		: m_pDevice{ pDevice }
+		, m_Id{ g_NextTextureId.fetch_add(1, std::memory_order_relaxed) }
+		, m_pStreamer{ pStreamer }
+		, m_Loader{ std::move(loader) }
+		, m_Fallback{ fallback }
+	{
+		m_pStreamer->Register(this);
+		CreateResource(pDevice);
+	}
+
+	void Texture::CreateResource(ID3D11Device* pDevice)
+	{
+		if (m_pSRV) m_pSRV->Release();
+		if (m_pResource) m_pResource->Release();
+		m_pSRV = nullptr;
+		m_pResource = nullptr;
+
+		//Textures that are only loaded to be streamed from have no device
+		const uint32_t numMipLevels{ static_cast<uint32_t>(m_MipLevels.size()) };
+		if (!pDevice) return;
+
+		//Streamed textures without resident mips show their fallback on the GPU as well
+		if (m_FirstResidentMip >= numMipLevels)
+		{
+			if (m_pStreamer) CreateFallbackResource(pDevice);
+			return;
+		}
+
+		//Create Resource, the first resident mip is the base level of the GPU texture
+		DXGI_FORMAT format = GetFormat();
 		D3D11_TEXTURE2D_DESC desc{};
-		desc.Width = pSurface->w;
-		desc.Height = pSurface->h;
-		desc.MipLevels = 1;
+		desc.Width = m_MipLevels[m_FirstResidentMip].width;
+		desc.Height = m_MipLevels[m_FirstResidentMip].height;
+		desc.MipLevels = numMipLevels - m_FirstResidentMip;
 		desc.ArraySize = 1;
 		desc.Format = format;
 		desc.SampleDesc.Count = 1;
@@ -22,12 +265,20 @@ namespace dae
 		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 		desc.MiscFlags = 0;
 
-		D3D11_SUBRESOURCE_DATA initData;
-		initData.pSysMem = pSurface->pixels;
-		initData.SysMemPitch = static_cast<UINT>(pSurface->pitch);
-		initData.SysMemSlicePitch = static_cast<UINT>(pSurface->h * pSurface->pitch);
+		//Upload the same mip chain, so both rasterizers filter the same data.
+		//The hardware expects rows of texels or blocks, the tiled copy is only kept for the software rasterizer
+		std::vector<std::vector<uint8_t>> rowMajorTexels(desc.MipLevels);
+		std::vector<D3D11_SUBRESOURCE_DATA> initData(desc.MipLevels);
+		for (uint32_t subresourceIdx{}; subresourceIdx < desc.MipLevels; ++subresourceIdx)
+		{
+			const MipLevel& mipLevel{ m_MipLevels[m_FirstResidentMip + subresourceIdx] };
+			rowMajorTexels[subresourceIdx] = GetRowMajorTexels(mipLevel);
+			initData[subresourceIdx].pSysMem = rowMajorTexels[subresourceIdx].data();
+			initData[subresourceIdx].SysMemPitch = static_cast<UINT>(mipLevel.columns * mipLevel.layout.bytesPerTexel);
+			initData[subresourceIdx].SysMemSlicePitch = static_cast<UINT>(rowMajorTexels[subresourceIdx].size());
+		}
 
-		HRESULT hr = pDevice->CreateTexture2D(&desc, &initData, &m_pResource);
+		HRESULT hr = pDevice->CreateTexture2D(&desc, initData.data(), &m_pResource);
 
 		if (FAILED(hr))
 		{
@@ -39,7 +290,7 @@ namespace dae
 		D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc{};
 		SRVDesc.Format = format;
 		SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		SRVDesc.Texture2D.MipLevels = 1;
+		SRVDesc.Texture2D.MipLevels = desc.MipLevels;
 
 		hr = pDevice->CreateShaderResourceView(m_pResource, &SRVDesc, &m_pSRV);
 		if (FAILED(hr))
@@ -49,12 +300,56 @@ namespace dae
 		}
 	}
 
+	void Texture::CreateFallbackResource(ID3D11Device* pDevice)
+	{
+		//A single texel, the samplers return its value for every uv like the software rasterizer does
+		const auto toByte = [](float value)
+		{
+			return static_cast<uint8_t>(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+		};
+		const uint8_t texel[4]{ toByte(m_Fallback.x), toByte(m_Fallback.y), toByte(m_Fallback.z), toByte(m_Fallback.w) };
+
+		D3D11_TEXTURE2D_DESC desc{};
+		desc.Width = 1;
+		desc.Height = 1;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.SampleDesc.Quality = 0;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.MiscFlags = 0;
+
+		D3D11_SUBRESOURCE_DATA initData{};
+		initData.pSysMem = texel;
+		initData.SysMemPitch = sizeof(texel);
+		initData.SysMemSlicePitch = sizeof(texel);
+
+		HRESULT hr = pDevice->CreateTexture2D(&desc, &initData, &m_pResource);
+		if (FAILED(hr))
+		{
+			std::wcout << L"Fallback Texture 2D Resource creation failed!\n";
+			return;
+		}
+
+		hr = pDevice->CreateShaderResourceView(m_pResource, nullptr, &m_pSRV);
+		if (FAILED(hr))
+		{
+			std::wcout << L"Fallback Shader Resource View creation failed!\n";
+			return;
+		}
+	}
+
 	Texture::~Texture()
 	{
 		//Release resources
 		if (m_pSRV) m_pSRV->Release();
 		if (m_pResource) m_pResource->Release();
-		if (m_pSurface) SDL_FreeSurface(m_pSurface);
+		if (m_pStreamer) m_pStreamer->Unregister(this);
+
+		//A load that is still running has to finish before its result can be freed
+		if (m_IsLoading) delete m_LoadTask.get();
 	}
 
 	ID3D11ShaderResourceView* Texture::GetSRV() const
@@ -62,8 +357,24 @@ namespace dae
 		return m_pSRV;
 	}
 
-	Texture* Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
+	TextureUsage Texture::GetUsage() const
+	{
+		return m_Usage;
+	}
+
+	bool Texture::IsDDSFile(const std::string& path)
+	{
+		if (path.size() < 4) return false;
+
+		std::string extension{ path.substr(path.size() - 4) };
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+		return extension == ".dds";
+	}
+
+	Texture* Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path, TextureUsage usage)
 	{
+		if (IsDDSFile(path)) return LoadDDS(pDevice, path, usage);
+
 		SDL_Surface* pSurface{ IMG_Load(path.c_str()) };
 
 		//If the surface is invalid (nullptr), report and return nullptr
@@ -72,62 +383,734 @@ namespace dae
 			std::wcout << L"Texture surface creation failed!\n";
 			return nullptr;
 		}
-		return new Texture(pDevice, pSurface);
+		return new Texture(pDevice, pSurface, usage);
+	}
+
+	Texture* Texture::LoadPacked(ID3D11Device* pDevice, const std::array<PackedChannel, 4>& channels, bool encodeNormal)
+	{
+		SDL_Surface* pPacked{ PackSurface(channels, encodeNormal) };
+		if (!pPacked) return nullptr;
+
+		return new Texture(pDevice, pPacked, TextureUsage::Color);
 	}
 
-	ColorRGB Texture::Sample(const Vector2& uv) const
+	Texture* Texture::CreateStreamed(ID3D11Device* pDevice, TextureStreamer* pStreamer, Loader loader, const Vector4& fallback)
 	{
-		uint32_t u{ static_cast<uint32_t>(uv.x * m_pSurface->w) };
-		uint32_t v{ static_cast<uint32_t>(uv.y * m_pSurface->h) };
-		
-		//Sample the correct texel for the given uv
+		return new Texture(pDevice, pStreamer, std::move(loader), fallback);
+	}
 
-		uint8_t r{}, g{}, b{};
-		uint32_t pixel{ m_pSurfacePixels[u + v * m_pSurface->w] };
-		SDL_GetRGB(pixel, m_pSurface->format, &r, &g, &b);
-		
-		return ColorRGB{
-			static_cast<float>(r) * m_ColorModifier,
-			static_cast<float>(g) * m_ColorModifier,
-			static_cast<float>(b) * m_ColorModifier
+	SDL_Surface* Texture::PackSurface(const std::array<PackedChannel, 4>& channels, bool encodeNormal)
+	{
+		//Every image is only loaded once, even when it fills several channels
+		std::vector<std::pair<std::string, SDL_Surface*>> sources{};
+		auto freeSources = [&sources]()
+		{
+			for (const auto& source : sources) SDL_FreeSurface(source.second);
 		};
+
+		std::array<const uint8_t*, 4> channelSources{};
+		std::array<int, 4> channelPitches{};
+		int width{ -1 };
+		int height{ -1 };
+		for (size_t channelIdx{}; channelIdx < channels.size(); ++channelIdx)
+		{
+			const PackedChannel& channel{ channels[channelIdx] };
+			if (channel.path.empty()) continue;
+
+			auto sourceIt{ std::find_if(sources.begin(), sources.end(), [&channel](const auto& source) { return source.first == channel.path; }) };
+			if (sourceIt == sources.end())
+			{
+				SDL_Surface* pLoaded{ IMG_Load(channel.path.c_str()) };
+				SDL_Surface* pConverted{ pLoaded ? SDL_ConvertSurfaceFormat(pLoaded, SDL_PIXELFORMAT_RGBA32, 0) : nullptr };
+				if (pLoaded) SDL_FreeSurface(pLoaded);
+
+				if (!pConverted)
+				{
+					std::wcout << L"Texture surface creation failed!\n";
+					freeSources();
+					return nullptr;
+				}
+
+				if (width >= 0 && (pConverted->w != width || pConverted->h != height))
+				{
+					std::wcout << L"Packed texture sources have different sizes!\n";
+					SDL_FreeSurface(pConverted);
+					freeSources();
+					return nullptr;
+				}
+				width = pConverted->w;
+				height = pConverted->h;
+
+				sources.emplace_back(channel.path, pConverted);
+				sourceIt = sources.end() - 1;
+			}
+
+			channelSources[channelIdx] = static_cast<const uint8_t*>(sourceIt->second->pixels) + std::min(channel.sourceChannel, 3u);
+			channelPitches[channelIdx] = sourceIt->second->pitch;
+		}
+
+		if (sources.empty())
+		{
+			std::wcout << L"Packed texture has no sources!\n";
+			return nullptr;
+		}
+
+		SDL_Surface* pPacked{ SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32) };
+		if (!pPacked)
+		{
+			std::wcout << L"Packed texture surface creation failed!\n";
+			freeSources();
+			return nullptr;
+		}
+
+		for (int y{}; y < height; ++y)
+		{
+			uint8_t* pRow{ static_cast<uint8_t*>(pPacked->pixels) + y * pPacked->pitch };
+			for (int x{}; x < width; ++x)
+			{
+				for (size_t channelIdx{}; channelIdx < channels.size(); ++channelIdx)
+				{
+					const uint8_t* pSource{ channelSources[channelIdx] };
+					pRow[x * 4 + channelIdx] = pSource ? pSource[y * channelPitches[channelIdx] + x * 4] : channels[channelIdx].defaultValue;
+				}
+
+				if (encodeNormal && channelSources[0])
+				{
+					//All three channels of the normal map are read, so z does not have to be rebuilt from xy
+					const uint8_t* pNormal{ channelSources[0] - std::min(channels[0].sourceChannel, 3u) + y * channelPitches[0] + x * 4 };
+					const Vector3 normal{ pNormal[0] * (2.f / 255.f) - 1.f, pNormal[1] * (2.f / 255.f) - 1.f, pNormal[2] * (2.f / 255.f) - 1.f };
+					const Vector2 encoded{ EncodeNormal(normal) };
+					pRow[x * 4 + 0] = static_cast<uint8_t>(encoded.x * 255.f + 0.5f);
+					pRow[x * 4 + 1] = static_cast<uint8_t>(encoded.y * 255.f + 0.5f);
+				}
+			}
+		}
+		freeSources();
+
+		return pPacked;
+	}
+
+	Texture* Texture::LoadDDS(ID3D11Device* pDevice, const std::string& path, TextureUsage usage)
+	{
+		std::ifstream file{ path, std::ios::binary };
+		uint32_t magic{};
+		DDSHeader header{};
+		if (!file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != MakeFourCC('D', 'D', 'S', ' ')
+			|| !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.size != sizeof(DDSHeader))
+		{
+			std::wcout << L"DDS file is not valid!\n";
+			return nullptr;
+		}
+
+		//Older files name the format with a four character code, newer ones add a header with the DXGI format
+		BlockFormat blockFormat{ BlockFormat::None };
+		const uint32_t fourCC{ header.pixelFormat.fourCC };
+		if (fourCC == MakeFourCC('D', 'X', 'T', '1')) blockFormat = BlockFormat::BC1;
+		else if (fourCC == MakeFourCC('D', 'X', 'T', '5') || fourCC == MakeFourCC('D', 'X', 'T', '4')) blockFormat = BlockFormat::BC3;
+		else if (fourCC == MakeFourCC('A', 'T', 'I', '2') || fourCC == MakeFourCC('B', 'C', '5', 'U')) blockFormat = BlockFormat::BC5;
+		else if (fourCC == MakeFourCC('D', 'X', '1', '0'))
+		{
+			DDSHeaderDX10 headerDX10{};
+			if (file.read(reinterpret_cast<char*>(&headerDX10), sizeof(headerDX10)))
+			{
+				switch (headerDX10.dxgiFormat)
+				{
+				case DXGI_FORMAT_BC1_UNORM:
+					blockFormat = BlockFormat::BC1;
+					break;
+				case DXGI_FORMAT_BC3_UNORM:
+					blockFormat = BlockFormat::BC3;
+					break;
+				case DXGI_FORMAT_BC5_UNORM:
+					blockFormat = BlockFormat::BC5;
+					break;
+				}
+			}
+		}
+
+		if (blockFormat == BlockFormat::None)
+		{
+			std::wcout << L"DDS format is not supported, only BC1, BC3 and BC5 are!\n";
+			return nullptr;
+		}
+
+		//Direct3D only accepts block compressed textures whose base level is made of whole blocks
+		if (header.width == 0 || header.height == 0 || header.width % 4 != 0 || header.height % 4 != 0)
+		{
+			std::wcout << L"DDS size has to be a multiple of 4!\n";
+			return nullptr;
+		}
+
+		//The blocks of a level are stored in rows, they are copied into the tiles of the level
+		const TexelLayout layout{ GetTexelLayout(blockFormat) };
+		const uint32_t numMipLevels{ std::max(header.mipMapCount, 1u) };
+		std::vector<MipLevel> mipLevels{};
+		std::vector<uint8_t> rowMajorBlocks{};
+		uint32_t width{ header.width };
+		uint32_t height{ header.height };
+		for (uint32_t mipIdx{}; mipIdx < numMipLevels; ++mipIdx)
+		{
+			MipLevel mipLevel{ width, height, layout };
+			rowMajorBlocks.resize(static_cast<size_t>(mipLevel.columns) * mipLevel.rows * layout.bytesPerTexel);
+			if (!file.read(reinterpret_cast<char*>(rowMajorBlocks.data()), static_cast<std::streamsize>(rowMajorBlocks.size())))
+			{
+				std::wcout << L"DDS file is truncated!\n";
+				return nullptr;
+			}
+
+			for (uint32_t blockY{}; blockY < mipLevel.rows; ++blockY)
+			{
+				for (uint32_t blockX{}; blockX < mipLevel.columns; ++blockX)
+				{
+					const size_t blockIdx{ static_cast<size_t>(blockY) * mipLevel.columns + blockX };
+					std::copy_n(rowMajorBlocks.data() + blockIdx * layout.bytesPerTexel, layout.bytesPerTexel, mipLevel.Texel(blockX, blockY));
+				}
+			}
+			mipLevels.push_back(std::move(mipLevel));
+
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+		}
+
+		return new Texture(pDevice, std::move(mipLevels), blockFormat, usage);
 	}
 
-	Vector4 Texture::SampleTransparency(const Vector2& uv) const
+	void Texture::RequestResolution(uint32_t resolution) const
 	{
-		uint32_t u{ static_cast<uint32_t>(uv.x * m_pSurface->w) };
-		uint32_t v{ static_cast<uint32_t>(uv.y * m_pSurface->h) };
+		if (!m_pStreamer) return;
 
-		//Sample the correct texel for the given uv
+		//Most requests do not raise the maximum, those do not write to the shared cache line
+		uint32_t requested{ m_RequestedResolution.load(std::memory_order_relaxed) };
+		while (resolution > requested && !m_RequestedResolution.compare_exchange_weak(requested, resolution, std::memory_order_relaxed)) {}
 
-		uint8_t r{}, g{}, b{}, a{};
-		uint32_t pixel{ m_pSurfacePixels[u + v * m_pSurface->w] };
-		SDL_GetRGBA(pixel, m_pSurface->format, &r, &g, &b, &a);
+		const uint32_t frame{ m_pStreamer->GetFrame() };
+		if (m_LastUsedFrame.load(std::memory_order_relaxed) != frame) m_LastUsedFrame.store(frame, std::memory_order_relaxed);
+	}
 
-		return Vector4{
-			static_cast<float>(r) * m_ColorModifier,
-			static_cast<float>(g) * m_ColorModifier,
-			static_cast<float>(b) * m_ColorModifier,
-			static_cast<float>(a) * m_ColorModifier
-		};
+	bool Texture::IsStreamed() const
+	{
+		return m_pStreamer != nullptr;
 	}
 
+	uint32_t Texture::GetLastUsedFrame() const
+	{
+		return m_LastUsedFrame.load(std::memory_order_relaxed);
+	}
 
-	Vector3 Texture::SampleNormal(const Vector2& uv) const
+	size_t Texture::GetResidentBytes() const
 	{
-		uint32_t u{ static_cast<uint32_t>(uv.x * m_pSurface->w) };
-		uint32_t v{ static_cast<uint32_t>(uv.y * m_pSurface->h) };
-		
-		//Sample the correct texel for the given uv
+		size_t residentBytes{};
+		for (const MipLevel& mipLevel : m_MipLevels) residentBytes += mipLevel.tiles.size() * sizeof(CacheLine);
+		return residentBytes;
+	}
 
-		uint8_t r{}, g{}, b{};
-		uint32_t pixel{ m_pSurfacePixels[u + v * m_pSurface->w] };
-		SDL_GetRGB(pixel, m_pSurface->format, &r, &g, &b);
+	uint32_t Texture::GetRequestedMip() const
+	{
+		const uint32_t numMipLevels{ static_cast<uint32_t>(m_MipLevels.size()) };
+		const uint32_t resolution{ m_RequestedResolution.load(std::memory_order_relaxed) };
+		if (resolution == 0) return numMipLevels;
 
-		return Vector3{
-			static_cast<float>(r) * m_ColorModifier,
-			static_cast<float>(g) * m_ColorModifier,
-			static_cast<float>(b) * m_ColorModifier
-		};
+		//Coarsest level that still has the requested resolution
+		uint32_t mipIdx{};
+		while (mipIdx + 1 < numMipLevels && std::max(m_MipLevels[mipIdx + 1].width, m_MipLevels[mipIdx + 1].height) >= resolution) ++mipIdx;
+		return mipIdx;
+	}
+
+	void Texture::StreamIn()
+	{
+		if (!m_pStreamer) return;
+
+		//Decoding runs on a worker, the frames meanwhile keep sampling the mips that are resident
+		if (m_IsLoading)
+		{
+			if (!m_LoadTask.is_done()) return;
+
+			m_IsLoading = false;
+			AdoptMipChain(m_LoadTask.get());
+			return;
+		}
+
+		if (!m_Loader || m_RequestedResolution.load(std::memory_order_relaxed) == 0) return;
+		if (!m_MipLevels.empty() && GetRequestedMip() >= m_FirstResidentMip) return;
+
+		m_LoadTask = concurrency::create_task(m_Loader);
+		m_IsLoading = true;
+	}
+
+	void Texture::AdoptMipChain(Texture* pLoaded)
+	{
+		if (!pLoaded || pLoaded->m_MipLevels.empty())
+		{
+			//A texture that fails to load keeps its fallback, it is not loaded again every frame
+			std::wcout << L"Streamed texture failed to load!\n";
+			m_Loader = nullptr;
+			delete pLoaded;
+			return;
+		}
+
+		m_Usage = pLoaded->m_Usage;
+		m_BlockFormat = pLoaded->m_BlockFormat;
+		m_MipLevels = std::move(pLoaded->m_MipLevels);
+		delete pLoaded;
+
+		//Image files can only be decoded whole, every level is kept. The streamer trims the levels finer than the request
+		//only when the budget is exceeded, a texture that gets closer to the camera would otherwise load again right away
+		m_FirstResidentMip = 0;
+		m_Id = g_NextTextureId.fetch_add(1, std::memory_order_relaxed);
+		CreateResource(m_pDevice);
+	}
+
+	void Texture::ClearRequests()
+	{
+		m_RequestedResolution.store(0, std::memory_order_relaxed);
+	}
+
+	size_t Texture::Evict(uint32_t firstKeptMip)
+	{
+		const uint32_t previousFirstResidentMip{ m_FirstResidentMip };
+		const size_t releasedBytes{ ReleaseMips(firstKeptMip) };
+		if (m_FirstResidentMip == previousFirstResidentMip) return 0;
+
+		//Freed tiles can be reused by other levels, so blocks decoded before the eviction must not match anymore
+		m_Id = g_NextTextureId.fetch_add(1, std::memory_order_relaxed);
+		CreateResource(m_pDevice);
+		return releasedBytes;
+	}
+
+	size_t Texture::ReleaseMips(uint32_t firstKeptMip)
+	{
+		//Block compressed GPU textures need a base level of whole blocks, partly evicted ones keep the coarsest level that has one
+		const uint32_t numMipLevels{ static_cast<uint32_t>(m_MipLevels.size()) };
+		firstKeptMip = std::min(firstKeptMip, numMipLevels);
+		if (m_BlockFormat != BlockFormat::None)
+		{
+			while (firstKeptMip > 0 && firstKeptMip < numMipLevels
+				&& (m_MipLevels[firstKeptMip].width % 4 != 0 || m_MipLevels[firstKeptMip].height % 4 != 0))
+			{
+				--firstKeptMip;
+			}
+		}
+
+		size_t releasedBytes{};
+		for (uint32_t mipIdx{ m_FirstResidentMip }; mipIdx < firstKeptMip; ++mipIdx)
+		{
+			std::vector<CacheLine>& tiles{ m_MipLevels[mipIdx].tiles };
+			releasedBytes += tiles.size() * sizeof(CacheLine);
+			std::vector<CacheLine>{}.swap(tiles);
+		}
+		m_FirstResidentMip = std::max(m_FirstResidentMip, firstKeptMip);
+		return releasedBytes;
+	}
+
+	Texture::FetchStatistics Texture::GetFetchStatistics()
+	{
+#ifdef TEXTURE_FETCH_STATISTICS
+		return FetchStatistics{ g_NumSamples.load(), g_NumCacheLineFetches.load() };
+#else
+		return FetchStatistics{};
+#endif
+	}
+
+	void Texture::ResetFetchStatistics()
+	{
+#ifdef TEXTURE_FETCH_STATISTICS
+		g_NumSamples.store(0);
+		g_NumCacheLineFetches.store(0);
+#endif
+	}
+
+	ColorRGB Texture::Sample(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const
+	{
+		const Vector4 color{ SampleFiltered(uv, uvDerivatives, samplerState) };
+		return ColorRGB{ color.x, color.y, color.z };
+	}
+
+	Vector4 Texture::SampleTransparency(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const
+	{
+		return SampleFiltered(uv, uvDerivatives, samplerState);
+	}
+
+	Vector3 Texture::SampleNormal(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const
+	{
+		//Filter the encoded normal first, then decode it
+		const Vector4 color{ SampleFiltered(uv, uvDerivatives, samplerState) };
+		return DecodeNormal(color.x, color.y);
+	}
+
+	Vector4 Texture::SampleRGBA(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const
+	{
+		return SampleFiltered(uv, uvDerivatives, samplerState);
+	}
+
+	Vector2 Texture::EncodeNormal(const Vector3& normal)
+	{
+		//Normals that point below the surface are clamped to the horizon
+		const float z{ std::max(normal.z, 0.f) };
+		const float invLength{ 1.f / std::max(std::abs(normal.x) + std::abs(normal.y) + z, FLT_EPSILON) };
+		const float x{ normal.x * invLength };
+		const float y{ normal.y * invLength };
+		return Vector2{ (x + y + 1.f) * 0.5f, (x - y + 1.f) * 0.5f };
+	}
+
+	Vector3 Texture::DecodeNormal(float x, float y)
+	{
+		x = x * 2.f - 1.f;
+		y = y * 2.f - 1.f;
+		const float octahedronX{ (x + y) * 0.5f };
+		const float octahedronY{ (x - y) * 0.5f };
+		return Vector3{ octahedronX, octahedronY, 1.f - std::abs(octahedronX) - std::abs(octahedronY) }.Normalized();
+	}
+
+	Texture::TexelLayout Texture::GetTexelLayout(TextureUsage usage)
+	{
+		//Every tile is 64 bytes
+		switch (usage)
+		{
+		case TextureUsage::Normal:
+			return TexelLayout{ 2, 8, 4 };
+		case TextureUsage::Mask:
+			return TexelLayout{ 1, 8, 8 };
+		case TextureUsage::Color:
+		default:
+			return TexelLayout{ 4, 4, 4 };
+		}
+	}
+
+	Texture::TexelLayout Texture::GetTexelLayout(BlockFormat blockFormat)
+	{
+		//Every tile is 64 bytes of blocks
+		switch (blockFormat)
+		{
+		case BlockFormat::BC1:
+			return TexelLayout{ 8, 4, 2, 4 };
+		case BlockFormat::BC3:
+		case BlockFormat::BC5:
+			return TexelLayout{ 16, 2, 2, 4 };
+		case BlockFormat::None:
+		default:
+			return TexelLayout{};
+		}
+	}
+
+	DXGI_FORMAT Texture::GetFormat() const
+	{
+		switch (m_BlockFormat)
+		{
+		case BlockFormat::BC1:
+			return DXGI_FORMAT_BC1_UNORM;
+		case BlockFormat::BC3:
+			return DXGI_FORMAT_BC3_UNORM;
+		case BlockFormat::BC5:
+			return DXGI_FORMAT_BC5_UNORM;
+		}
+
+		switch (m_Usage)
+		{
+		case TextureUsage::Normal:
+			return DXGI_FORMAT_R8G8_UNORM;
+		case TextureUsage::Mask:
+			return DXGI_FORMAT_R8_UNORM;
+		case TextureUsage::Color:
+		default:
+			return DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+
+	void Texture::BuildMipChain(SDL_Surface* pSurface)
+	{
+		const TexelLayout layout{ GetTexelLayout(m_Usage) };
+
+		//Convert to RGBA8 first so the file format does not matter
+		SDL_Surface* pConverted{ SDL_ConvertSurfaceFormat(pSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+		if (!pConverted)
+		{
+			std::wcout << L"Texture surface conversion failed!\n";
+			m_MipLevels.emplace_back(1, 1, layout);
+			std::fill_n(m_MipLevels.back().Texel(0, 0), layout.bytesPerTexel, uint8_t{ 0xFF });
+			return;
+		}
+
+		//Only keep the channels the usage needs
+		MipLevel baseLevel{ static_cast<uint32_t>(pConverted->w), static_cast<uint32_t>(pConverted->h), layout };
+		for (uint32_t y{}; y < baseLevel.height; ++y)
+		{
+			const uint8_t* pRow{ static_cast<const uint8_t*>(pConverted->pixels) + y * pConverted->pitch };
+			for (uint32_t x{}; x < baseLevel.width; ++x)
+			{
+				const uint8_t* pSource{ pRow + x * 4 };
+				uint8_t* pTexel{ baseLevel.Texel(x, y) };
+
+				switch (m_Usage)
+				{
+				case TextureUsage::Normal:
+				{
+					const Vector3 normal{ pSource[0] * (2.f / 255.f) - 1.f, pSource[1] * (2.f / 255.f) - 1.f, pSource[2] * (2.f / 255.f) - 1.f };
+					const Vector2 encoded{ EncodeNormal(normal) };
+					pTexel[0] = static_cast<uint8_t>(encoded.x * 255.f + 0.5f);
+					pTexel[1] = static_cast<uint8_t>(encoded.y * 255.f + 0.5f);
+					break;
+				}
+				case TextureUsage::Mask:
+					//Average of the color channels, specular maps are close to gray
+					pTexel[0] = static_cast<uint8_t>((pSource[0] + pSource[1] + pSource[2] + 1) / 3);
+					break;
+				case TextureUsage::Color:
+				default:
+					std::copy_n(pSource, 4, pTexel);
+					break;
+				}
+			}
+		}
+		SDL_FreeSurface(pConverted);
+		m_MipLevels.push_back(std::move(baseLevel));
+
+		//Every next level averages 2x2 texels of the previous one, down to a single texel
+		while (m_MipLevels.back().width > 1 || m_MipLevels.back().height > 1)
+		{
+			const MipLevel& source{ m_MipLevels.back() };
+
+			MipLevel mipLevel{ std::max(source.width / 2, 1u), std::max(source.height / 2, 1u), layout };
+
+			for (uint32_t y{}; y < mipLevel.height; ++y)
+			{
+				//Odd sizes repeat the last row or column
+				const uint32_t y0{ std::min(y * 2, source.height - 1) };
+				const uint32_t y1{ std::min(y * 2 + 1, source.height - 1) };
+
+				for (uint32_t x{}; x < mipLevel.width; ++x)
+				{
+					const uint32_t x0{ std::min(x * 2, source.width - 1) };
+					const uint32_t x1{ std::min(x * 2 + 1, source.width - 1) };
+
+					const uint8_t* texels[4]
+					{
+						source.Texel(x0, y0),
+						source.Texel(x1, y0),
+						source.Texel(x0, y1),
+						source.Texel(x1, y1)
+					};
+
+					uint8_t* pTexel{ mipLevel.Texel(x, y) };
+					for (uint32_t channel{}; channel < layout.bytesPerTexel; ++channel)
+					{
+						uint32_t sum{ 2 };
+						for (const uint8_t* pSourceTexel : texels) sum += pSourceTexel[channel];
+						pTexel[channel] = static_cast<uint8_t>(sum / 4);
+					}
+				}
+			}
+
+			m_MipLevels.push_back(std::move(mipLevel));
+		}
+	}
+
+	std::vector<uint8_t> Texture::GetRowMajorTexels(const MipLevel& mipLevel) const
+	{
+		const uint32_t bytesPerTexel{ mipLevel.layout.bytesPerTexel };
+		std::vector<uint8_t> texels(static_cast<size_t>(mipLevel.columns) * mipLevel.rows * bytesPerTexel);
+		for (uint32_t y{}; y < mipLevel.rows; ++y)
+		{
+			for (uint32_t x{}; x < mipLevel.columns; ++x)
+			{
+				std::copy_n(mipLevel.Texel(x, y), bytesPerTexel, texels.begin() + (x + y * mipLevel.columns) * bytesPerTexel);
+			}
+		}
+		return texels;
+	}
+
+	Vector4 Texture::SampleFiltered(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const
+	{
+#ifdef TEXTURE_FETCH_STATISTICS
+		BeginSample();
+#endif
+
+		//Streamed textures request the resolution the footprint of the sample needs, in texels per unit of uv.
+		//The anisotropic filter resolves the footprint along its longest axis with several taps
+		if (m_pStreamer)
+		{
+			const float majorLength{ sqrtf(std::max(uvDerivatives.ddx.SqrMagnitude(), uvDerivatives.ddy.SqrMagnitude())) };
+			const float minorLength{ sqrtf(std::min(uvDerivatives.ddx.SqrMagnitude(), uvDerivatives.ddy.SqrMagnitude())) };
+			const float footprint{ samplerState == SamplerState::Anisotropic ? std::max(minorLength, majorLength / m_MaxAnisotropy) : majorLength };
+			RequestResolution(static_cast<uint32_t>(std::min(1.f / std::max(footprint, FLT_MIN), 65536.f)));
+
+			if (m_FirstResidentMip >= m_MipLevels.size()) return m_Fallback;
+		}
+
+		//Derivatives in texels of the base level
+		const float width{ static_cast<float>(m_MipLevels[0].width) };
+		const float height{ static_cast<float>(m_MipLevels[0].height) };
+		const Vector2 texelDdx{ uvDerivatives.ddx.x * width, uvDerivatives.ddx.y * height };
+		const Vector2 texelDdy{ uvDerivatives.ddy.x * width, uvDerivatives.ddy.y * height };
+		const float lengthSquaredX{ texelDdx.SqrMagnitude() };
+		const float lengthSquaredY{ texelDdy.SqrMagnitude() };
+
+		const float maxLod{ static_cast<float>(m_MipLevels.size() - 1) };
+
+		switch (samplerState)
+		{
+		case SamplerState::Point:
+		{
+			//Nearest mip level, nearest texel
+			const float lod{ 0.5f * log2f(std::max(std::max(lengthSquaredX, lengthSquaredY), FLT_MIN)) };
+			const float mipIdx{ std::clamp(floorf(lod + 0.5f), static_cast<float>(m_FirstResidentMip), maxLod) };
+			return SamplePoint(static_cast<uint32_t>(mipIdx), uv);
+		}
+		case SamplerState::Linear:
+		{
+			const float lod{ 0.5f * log2f(std::max(std::max(lengthSquaredX, lengthSquaredY), FLT_MIN)) };
+			return SampleTrilinear(lod, uv);
+		}
+		case SamplerState::Anisotropic:
+		{
+			//Several trilinear taps along the longest axis of the pixel footprint,
+			//the mip level only has to cover the footprint of a single tap
+			const float majorLength{ sqrtf(std::max(lengthSquaredX, lengthSquaredY)) };
+			const float minorLength{ sqrtf(std::min(lengthSquaredX, lengthSquaredY)) };
+			const float anisotropy{ majorLength / std::max(minorLength, FLT_MIN) };
+			const uint32_t numTaps{ static_cast<uint32_t>(std::clamp(ceilf(anisotropy), 1.f, static_cast<float>(m_MaxAnisotropy))) };
+
+			const float lod{ log2f(std::max(majorLength / static_cast<float>(numTaps), FLT_MIN)) };
+			if (numTaps == 1) return SampleTrilinear(lod, uv);
+
+			const Vector2& majorAxis{ lengthSquaredX > lengthSquaredY ? uvDerivatives.ddx : uvDerivatives.ddy };
+			Vector4 color{};
+			for (uint32_t tapIdx{}; tapIdx < numTaps; ++tapIdx)
+			{
+				const float offset{ (static_cast<float>(tapIdx) + 0.5f) / static_cast<float>(numTaps) - 0.5f };
+				color += SampleTrilinear(lod, uv + majorAxis * offset);
+			}
+			return color * (1.f / static_cast<float>(numTaps));
+		}
+		default:
+			return SamplePoint(m_FirstResidentMip, uv);
+		}
+	}
+
+	Vector4 Texture::SamplePoint(uint32_t mipIdx, const Vector2& uv) const
+	{
+		const MipLevel& mipLevel{ m_MipLevels[mipIdx] };
+		const int x{ static_cast<int>(floorf(uv.x * static_cast<float>(mipLevel.width))) };
+		const int y{ static_cast<int>(floorf(uv.y * static_cast<float>(mipLevel.height))) };
+		return FetchTexel(mipLevel, x, y);
+	}
+
+	Vector4 Texture::SampleBilinear(uint32_t mipIdx, const Vector2& uv) const
+	{
+		//Texel centers are at half texel offsets
+		const MipLevel& mipLevel{ m_MipLevels[mipIdx] };
+		const float x{ uv.x * static_cast<float>(mipLevel.width) - 0.5f };
+		const float y{ uv.y * static_cast<float>(mipLevel.height) - 0.5f };
+		const float floorX{ floorf(x) };
+		const float floorY{ floorf(y) };
+		const float fracX{ x - floorX };
+		const float fracY{ y - floorY };
+		const int x0{ static_cast<int>(floorX) };
+		const int y0{ static_cast<int>(floorY) };
+
+		const Vector4 top{ FetchTexel(mipLevel, x0, y0) * (1.f - fracX) + FetchTexel(mipLevel, x0 + 1, y0) * fracX };
+		const Vector4 bottom{ FetchTexel(mipLevel, x0, y0 + 1) * (1.f - fracX) + FetchTexel(mipLevel, x0 + 1, y0 + 1) * fracX };
+		return top * (1.f - fracY) + bottom * fracY;
+	}
+
+	Vector4 Texture::SampleTrilinear(float lod, const Vector2& uv) const
+	{
+		//Magnified, finer than the resident mips, or past the smallest level: no blend between levels
+		const float maxLod{ static_cast<float>(m_MipLevels.size() - 1) };
+		if (lod <= static_cast<float>(m_FirstResidentMip)) return SampleBilinear(m_FirstResidentMip, uv);
+		if (lod >= maxLod) return SampleBilinear(static_cast<uint32_t>(maxLod), uv);
+
+		const float floorLod{ floorf(lod) };
+		const float fracLod{ lod - floorLod };
+		const uint32_t mipIdx{ static_cast<uint32_t>(floorLod) };
+
+		return SampleBilinear(mipIdx, uv) * (1.f - fracLod) + SampleBilinear(mipIdx + 1, uv) * fracLod;
+	}
+
+	Vector4 Texture::FetchTexel(const MipLevel& mipLevel, int x, int y) const
+	{
+		//Wrap addressing, same as the hardware sampler
+		const int width{ static_cast<int>(mipLevel.width) };
+		const int height{ static_cast<int>(mipLevel.height) };
+		x %= width;
+		y %= height;
+		if (x < 0) x += width;
+		if (y < 0) y += height;
+
+		//Compressed textures return the texel from the decoded block, its channels are read the same way
+		const uint8_t* pTexel{ nullptr };
+		if (m_BlockFormat == BlockFormat::None)
+		{
+			pTexel = mipLevel.Texel(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+#ifdef TEXTURE_FETCH_STATISTICS
+			CountFetch(pTexel);
+#endif
+		}
+		else
+		{
+			pTexel = FetchBlockTexel(mipLevel, static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+		}
+
+		switch (m_Usage)
+		{
+		case TextureUsage::Normal:
+			return Vector4{ pTexel[0] * m_ColorModifier, pTexel[1] * m_ColorModifier, 0.f, 1.f };
+		case TextureUsage::Mask:
+		{
+			const float value{ pTexel[0] * m_ColorModifier };
+			return Vector4{ value, value, value, 1.f };
+		}
+		case TextureUsage::Color:
+		default:
+		{
+			//Widen the four bytes to four floats in one go
+			int packed{};
+			std::copy_n(pTexel, 4, reinterpret_cast<uint8_t*>(&packed));
+			const __m128i zero{ _mm_setzero_si128() };
+			const __m128i bytes{ _mm_cvtsi32_si128(packed) };
+			const __m128i integers{ _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero) };
+			const __m128 color{ _mm_mul_ps(_mm_cvtepi32_ps(integers), _mm_set1_ps(m_ColorModifier)) };
+
+			Vector4 result{};
+			_mm_storeu_ps(&result.x, color);
+			return result;
+		}
+		}
+	}
+
+	const uint8_t* Texture::FetchBlockTexel(const MipLevel& mipLevel, uint32_t x, uint32_t y) const
+	{
+		const uint32_t blockSize{ mipLevel.layout.blockSize };
+		const uint8_t* pBlock{ mipLevel.Texel(x / blockSize, y / blockSize) };
+#ifdef TEXTURE_FETCH_STATISTICS
+		CountFetch(pBlock);
+#endif
+
+		DecodedBlock& decoded{ t_DecodedBlocks[(reinterpret_cast<uintptr_t>(pBlock) / mipLevel.layout.bytesPerTexel) % DecodedBlockCacheSize] };
+		if (decoded.pBlock != pBlock || decoded.textureId != m_Id)
+		{
+			switch (m_BlockFormat)
+			{
+			case BlockFormat::BC1:
+				DecodeColorBlock(pBlock, true, decoded.texels);
+				break;
+			case BlockFormat::BC3:
+				DecodeColorBlock(pBlock + 8, false, decoded.texels);
+				DecodeChannelBlock(pBlock, 3, decoded.texels);
+				break;
+			case BlockFormat::BC5:
+				for (uint32_t texelIdx{}; texelIdx < 16; ++texelIdx)
+				{
+					decoded.texels[texelIdx * 4 + 2] = 0;
+					decoded.texels[texelIdx * 4 + 3] = 255;
+				}
+				DecodeChannelBlock(pBlock, 0, decoded.texels);
+				DecodeChannelBlock(pBlock + 8, 1, decoded.texels);
+				break;
+			}
+			decoded.pBlock = pBlock;
+			decoded.textureId = m_Id;
+		}
+
+		return decoded.texels + ((y % blockSize) * blockSize + x % blockSize) * 4;
 	}
-}
\ No newline at end of file
+}
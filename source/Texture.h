@@ -1,11 +1,41 @@
 #pragma once
+#include "DataTypes.h"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <ppltasks.h>
+
+//Counts the cache lines every sample touches, to compare texel layouts. Only enabled in debug builds
+#if defined(DEBUG) || defined(_DEBUG)
+#define TEXTURE_FETCH_STATISTICS
+#endif
 
 namespace dae
 {
+	class TextureStreamer;
+
 	class Texture
 	{
 	public:
-		Texture(ID3D11Device* pDevice, SDL_Surface* pSurface);
+		//Loads the full texture without a GPU resource, streamed textures take their mip chain from it
+		using Loader = std::function<Texture*()>;
+
+		struct FetchStatistics
+		{
+			uint64_t numSamples{};
+			uint64_t numCacheLineFetches{};
+		};
+
+		//One channel of a packed texture: which channel of which image it is copied from.
+		//Channels without a path are filled with the default value
+		struct PackedChannel
+		{
+			std::string path{};
+			uint32_t sourceChannel{};
+			uint8_t defaultValue{ 255 };
+		};
+
+		Texture(ID3D11Device* pDevice, SDL_Surface* pSurface, TextureUsage usage);
 		~Texture();
 		Texture(const Texture&) = delete;
 		Texture(Texture&&) = delete;
@@ -13,21 +43,159 @@ namespace dae
 		Texture& operator=(Texture&&) = delete;
 
 		ID3D11ShaderResourceView* GetSRV() const;
+		TextureUsage GetUsage() const;
+
+		//The uv derivatives select the mip level, the sampler state selects the filter
+		ColorRGB Sample(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const;
+		Vector4 SampleTransparency(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const;
+
+		//Returns the unit tangent space normal, decoded from the two stored channels
+		Vector3 SampleNormal(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const;
 
-		ColorRGB Sample(const Vector2& uv) const;
-		Vector4 SampleTransparency(const Vector2& uv) const;
-		Vector3 SampleNormal(const Vector2& uv) const;
+		//Returns the four channels as they are stored, for packed textures that hold several maps
+		Vector4 SampleRGBA(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const;
 
-		static Texture* LoadFromFile(ID3D11Device* pDevice, const std::string& path);
+		//Tangent space normals are stored hemi-octahedral: the normal is projected on the octahedron |x| + |y| + z = 1
+		//and the upper half is rotated 45 degrees to fill the whole square, both coordinates are stored in [0, 1].
+		//The encoding is linear inside each quadrant, so filtered texels still decode to a direction in between
+		static Vector2 EncodeNormal(const Vector3& normal);
+		static Vector3 DecodeNormal(float x, float y);
+
+		static bool IsDDSFile(const std::string& path);
+
+		//DDS files with BC1, BC3 or BC5 data stay compressed, both in memory and on the GPU.
+		//Their mip chain is taken from the file, it is not generated
+		static Texture* LoadFromFile(ID3D11Device* pDevice, const std::string& path, TextureUsage usage = TextureUsage::Color);
+
+		//Interleaves channels of several images in a single RGBA8 texture, so one fetch returns all of them.
+		//All images must have the same size. When encodeNormal is set, the image of the r channel is a tangent space
+		//normal map and rg hold its full normal, see EncodeNormal
+		static Texture* LoadPacked(ID3D11Device* pDevice, const std::array<PackedChannel, 4>& channels, bool encodeNormal = false);
+
+		//Nothing is loaded until the texture is first sampled or bound, until then samples return the fallback.
+		//Which mips stay resident is decided by the streamer, see TextureStreamer
+		static Texture* CreateStreamed(ID3D11Device* pDevice, TextureStreamer* pStreamer, Loader loader, const Vector4& fallback);
+
+		//Totals of all textures since the last reset, always zero when TEXTURE_FETCH_STATISTICS is not defined
+		static FetchStatistics GetFetchStatistics();
+		static void ResetFetchStatistics();
+
+		//Streaming, the requests are made while rendering, the rest is done by the streamer between frames.
+		//The hardware rasterizer cannot report which mips it samples, so it requests the full resolution of what it binds
+		void RequestResolution(uint32_t resolution) const;
+		bool IsStreamed() const;
+		uint32_t GetLastUsedFrame() const;
+		size_t GetResidentBytes() const;
+		//Starts loading when the requests since the last ClearRequests need mips that are not resident,
+		//a load runs as a task and its mips become resident in the first call after it finished
+		void StreamIn();
+		void ClearRequests();
+		//Frees the mips finer than firstKeptMip and returns the number of bytes released
+		size_t Evict(uint32_t firstKeptMip);
+		//Finest mip the requests since the last StreamIn need, the number of mips when nothing was requested
+		uint32_t GetRequestedMip() const;
 
 	private:
+		//Block compression of the texels, the blocks are decoded when they are sampled
+		enum class BlockFormat
+		{
+			None,
+			BC1,	//RGB with 1 bit alpha, 8 bytes per block
+			BC3,	//RGBA, 16 bytes per block
+			BC5		//RG, 16 bytes per block
+		};
+
+		//Texels are stored in tiles of exactly one cache line, so a small footprint on the texture
+		//stays in one or two cache lines whatever the orientation of the texture on the screen
+		struct alignas(64) CacheLine
+		{
+			uint8_t bytes[64]{};
+		};
+
+		//Size of a texel and of the tile that fills one cache line, depends on the usage of the texture.
+		//For block compressed textures a texel of the layout is a whole block of blockSize x blockSize texels
+		struct TexelLayout
+		{
+			uint32_t bytesPerTexel{ 4 };
+			uint32_t tileWidth{ 4 };
+			uint32_t tileHeight{ 4 };
+			uint32_t blockSize{ 1 };
+		};
+
+		struct MipLevel
+		{
+			uint32_t width{};
+			uint32_t height{};
+			//Size in texels of the layout, the same as width and height unless the level is block compressed
+			uint32_t columns{};
+			uint32_t rows{};
+			uint32_t tilesPerRow{};
+			TexelLayout layout{};
+			std::vector<CacheLine> tiles{};
+
+			MipLevel() = default;
+			MipLevel(uint32_t _width, uint32_t _height, const TexelLayout& _layout);
+
+			uint8_t* Texel(uint32_t x, uint32_t y);
+			const uint8_t* Texel(uint32_t x, uint32_t y) const;
+		};
+
+		//Takes a mip chain that is already in the layout of the block format
+		Texture(ID3D11Device* pDevice, std::vector<MipLevel>&& mipLevels, BlockFormat blockFormat, TextureUsage usage);
+		Texture(ID3D11Device* pDevice, TextureStreamer* pStreamer, Loader loader, const Vector4& fallback);
+
+		static SDL_Surface* PackSurface(const std::array<PackedChannel, 4>& channels, bool encodeNormal);
+
+		static Texture* LoadDDS(ID3D11Device* pDevice, const std::string& path, TextureUsage usage);
+
+		static TexelLayout GetTexelLayout(TextureUsage usage);
+		static TexelLayout GetTexelLayout(BlockFormat blockFormat);
+		DXGI_FORMAT GetFormat() const;
+
+		//Creates the GPU resource from the resident mips, a previous resource is released
+		void CreateResource(ID3D11Device* pDevice);
+		//1x1 texture of the fallback, bound until the first mips of a streamed texture are resident
+		void CreateFallbackResource(ID3D11Device* pDevice);
+		//Frees the tiles of the mips finer than firstKeptMip, without touching the GPU resource
+		size_t ReleaseMips(uint32_t firstKeptMip);
+		//Takes the mip chain of a texture that finished loading and deletes it
+		void AdoptMipChain(Texture* pLoaded);
+		void BuildMipChain(SDL_Surface* pSurface);
+		std::vector<uint8_t> GetRowMajorTexels(const MipLevel& mipLevel) const;
+
+		Vector4 SampleFiltered(const Vector2& uv, const UVDerivatives& uvDerivatives, SamplerState samplerState) const;
+		Vector4 SamplePoint(uint32_t mipIdx, const Vector2& uv) const;
+		Vector4 SampleBilinear(uint32_t mipIdx, const Vector2& uv) const;
+		Vector4 SampleTrilinear(float lod, const Vector2& uv) const;
+		Vector4 FetchTexel(const MipLevel& mipLevel, int x, int y) const;
+		//Points at the RGBA8 texel in the decoded block, blocks are decoded into a small cache of the calling thread
+		const uint8_t* FetchBlockTexel(const MipLevel& mipLevel, uint32_t x, uint32_t y) const;
+
 		//DirectX
+		ID3D11Device* m_pDevice{ nullptr };
 		ID3D11Texture2D* m_pResource{ nullptr };
 		ID3D11ShaderResourceView* m_pSRV{ nullptr };
 
-		//SDL
-		SDL_Surface* m_pSurface{ nullptr };
-		uint32_t* m_pSurfacePixels{ nullptr };
+		//Mip chain, level 0 is the full resolution surface
+		TextureUsage m_Usage{ TextureUsage::Color };
+		BlockFormat m_BlockFormat{ BlockFormat::None };
+		std::vector<MipLevel> m_MipLevels{};
+
+		//Unique for every texture and residency change, decoded blocks are cached by texture id and block address
+		uint32_t m_Id{};
+
+		//Streaming, the mips before the first resident one have no tiles
+		TextureStreamer* m_pStreamer{ nullptr };
+		Loader m_Loader{};
+		concurrency::task<Texture*> m_LoadTask{};
+		bool m_IsLoading{ false };
+		Vector4 m_Fallback{};
+		uint32_t m_FirstResidentMip{};
+		mutable std::atomic<uint32_t> m_RequestedResolution{};
+		mutable std::atomic<uint32_t> m_LastUsedFrame{};
+
+		//Matches the MaxAnisotropy of the hardware sampler
+		static constexpr uint32_t m_MaxAnisotropy{ 16 };
 
 		//Color Calculation
 		const float m_ColorModifier{ 1.f / 255.f };
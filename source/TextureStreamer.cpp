@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "TextureStreamer.h"
+#include "Texture.h"
+
+namespace dae
+{
+	TextureStreamer::TextureStreamer(size_t budgetBytes)
+		: m_BudgetBytes{ budgetBytes }
+	{
+	}
+
+	void TextureStreamer::Register(Texture* pTexture)
+	{
+		const std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_pTextures.push_back(pTexture);
+		m_pEvictionOrder.reserve(m_pTextures.size());
+	}
+
+	void TextureStreamer::Unregister(Texture* pTexture)
+	{
+		const std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_pTextures.erase(std::remove(m_pTextures.begin(), m_pTextures.end(), pTexture), m_pTextures.end());
+	}
+
+	void TextureStreamer::Update()
+	{
+		const std::lock_guard<std::mutex> lock{ m_Mutex };
+
+		//Start loading the mips that were sampled or bound during the frame, and take the ones that finished loading
+		for (Texture* pTexture : m_pTextures)
+		{
+			pTexture->StreamIn();
+		}
+
+		size_t residentBytes{};
+		for (const Texture* pTexture : m_pTextures) residentBytes += pTexture->GetResidentBytes();
+		if (residentBytes > m_BudgetBytes)
+		{
+			//Least recently used first. Textures of this frame only give up the mips finer than they requested,
+			//evicting what they still sample would load it again every frame. The sort is in place, a stable sort would allocate
+			m_pEvictionOrder.assign(m_pTextures.begin(), m_pTextures.end());
+			std::sort(m_pEvictionOrder.begin(), m_pEvictionOrder.end(), [](const Texture* pLeft, const Texture* pRight)
+			{
+				return pLeft->GetLastUsedFrame() < pRight->GetLastUsedFrame();
+			});
+
+			for (Texture* pTexture : m_pEvictionOrder)
+			{
+				if (residentBytes <= m_BudgetBytes) break;
+
+				const bool isUsed{ pTexture->GetLastUsedFrame() == m_Frame };
+				residentBytes -= pTexture->Evict(isUsed ? pTexture->GetRequestedMip() : UINT32_MAX);
+			}
+		}
+
+		for (Texture* pTexture : m_pTextures)
+		{
+			pTexture->ClearRequests();
+		}
+		++m_Frame;
+	}
+
+	uint32_t TextureStreamer::GetFrame() const
+	{
+		return m_Frame;
+	}
+
+	size_t TextureStreamer::GetResidentBytes() const
+	{
+		const std::lock_guard<std::mutex> lock{ m_Mutex };
+		size_t residentBytes{};
+		for (const Texture* pTexture : m_pTextures) residentBytes += pTexture->GetResidentBytes();
+		return residentBytes;
+	}
+
+	void TextureStreamer::SetBudget(size_t budgetBytes)
+	{
+		m_BudgetBytes = budgetBytes;
+	}
+}
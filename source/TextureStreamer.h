@@ -0,0 +1,44 @@
+#pragma once
+#include <mutex>
+
+namespace dae
+{
+	class Texture;
+
+	//Keeps the mips of streamed textures resident within a memory budget.
+	//Textures request mips while a frame is rendered, Update loads them afterwards and evicts the least recently used mips
+	class TextureStreamer final
+	{
+	public:
+		explicit TextureStreamer(size_t budgetBytes);
+		~TextureStreamer() = default;
+		TextureStreamer(const TextureStreamer&) = delete;
+		TextureStreamer(TextureStreamer&&) noexcept = delete;
+		TextureStreamer& operator=(const TextureStreamer&) = delete;
+		TextureStreamer& operator=(TextureStreamer&&) noexcept = delete;
+
+		//Streamed textures register themselves when they are created and unregister when they are deleted,
+		//this can happen on the threads that load assets
+		void Register(Texture* pTexture);
+		void Unregister(Texture* pTexture);
+
+		//Called once after every frame on the thread that renders, no texture may be sampled meanwhile.
+		//Also adopts the textures that finished loading, loads themselves run as tasks
+		void Update();
+
+		uint32_t GetFrame() const;
+		size_t GetResidentBytes() const;
+		void SetBudget(size_t budgetBytes);
+
+	private:
+		//Guards the texture list
+		mutable std::mutex m_Mutex{};
+		std::vector<Texture*> m_pTextures{};
+		//Reused by every Update that is over budget, its capacity grows with the texture list so the render loop does not allocate
+		std::vector<Texture*> m_pEvictionOrder{};
+		size_t m_BudgetBytes{};
+
+		//Textures that were never used have frame zero
+		uint32_t m_Frame{ 1 };
+	};
+}
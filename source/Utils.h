@@ -6,163 +6,6 @@
 
 namespace dae
 {
-	namespace Utils
-	{
-		//Just parses vertices and indices
-#pragma warning(push)
-#pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding = true)
-		{
-			std::ifstream file(filename);
-			if (!file)
-				return false;
-
-			std::vector<Vector3> positions{};
-			std::vector<Vector3> normals{};
-			std::vector<Vector2> UVs{};
-
-			vertices.clear();
-			indices.clear();
-
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
-			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-
-					positions.emplace_back(x, y, z);
-				}
-				else if (sCommand == "vt")
-				{
-					// Vertex TexCoord
-					float u, v;
-					file >> u >> v;
-					UVs.emplace_back(u, 1 - v);
-				}
-				else if (sCommand == "vn")
-				{
-					// Vertex Normal
-					float x, y, z;
-					file >> x >> y >> z;
-
-					normals.emplace_back(x, y, z);
-				}
-				else if (sCommand == "f")
-				{
-					//if a face is read:
-					//construct the 3 vertices, add them to the vertex array
-					//add three indices to the index array
-					//add the material index as attibute to the attribute array
-					//
-					// Faces or triangles
-					Vertex vertex{};
-					size_t iPosition, iTexCoord, iNormal;
-
-					uint32_t tempIndices[3];
-					for (size_t iFace = 0; iFace < 3; iFace++)
-					{
-						// OBJ format uses 1-based arrays
-						file >> iPosition;
-						vertex.position = positions[iPosition - 1];
-
-						if ('/' == file.peek())//is next in buffer ==  '/' ?
-						{
-							file.ignore();//read and ignore one element ('/')
-
-							if ('/' != file.peek())
-							{
-								// Optional texture coordinate
-								file >> iTexCoord;
-								vertex.uv = UVs[iTexCoord - 1];
-							}
-
-							if ('/' == file.peek())
-							{
-								file.ignore();
-
-								// Optional vertex normal
-								file >> iNormal;
-								vertex.normal = normals[iNormal - 1];
-							}
-						}
-
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
-						//indices.push_back(uint32_t(vertices.size()) - 1);
-					}
-
-					indices.push_back(tempIndices[0]);
-					if (flipAxisAndWinding)
-					{
-						indices.push_back(tempIndices[2]);
-						indices.push_back(tempIndices[1]);
-					}
-					else
-					{
-						indices.push_back(tempIndices[1]);
-						indices.push_back(tempIndices[2]);
-					}
-				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
-			}
-
-			//Cheap Tangent Calculations
-			for (uint32_t i = 0; i < indices.size(); i += 3)
-			{
-				uint32_t index0 = indices[i];
-				uint32_t index1 = indices[size_t(i) + 1];
-				uint32_t index2 = indices[size_t(i) + 2];
-
-				const Vector3& p0 = vertices[index0].position;
-				const Vector3& p1 = vertices[index1].position;
-				const Vector3& p2 = vertices[index2].position;
-				const Vector2& uv0 = vertices[index0].uv;
-				const Vector2& uv1 = vertices[index1].uv;
-				const Vector2& uv2 = vertices[index2].uv;
-
-				const Vector3 edge0 = p1 - p0;
-				const Vector3 edge1 = p2 - p0;
-				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
-				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
-
-				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
-				vertices[index0].tangent += tangent;
-				vertices[index1].tangent += tangent;
-				vertices[index2].tangent += tangent;
-			}
-
-			//Create the Tangents (reject)
-			for (auto& v : vertices)
-			{
-				v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
-
-				if (flipAxisAndWinding)
-				{
-					v.position.z *= -1.f;
-					v.normal.z *= -1.f;
-					v.tangent.z *= -1.f;
-				}
-
-			}
-
-			return true;
-		}
-#pragma warning(pop)
-	}
-
 	namespace GeometryUtils
 	{
 		inline bool IsPointInTriangle(const Vector2& v0, const Vector2& v1, const Vector2& v2, const Vector2& pixel,
@@ -190,6 +33,98 @@ namespace dae
 			return vertex.x >= min && vertex.x <= max && vertex.y >= min && vertex.y <= max && vertex.z >= 0.f && vertex.z <= max;
 		}
 
+		inline Frustum ExtractFrustum(const Matrix& viewProjectionMatrix)
+		{
+			//Row vectors are multiplied with the matrix, so the clip planes are combinations of its columns
+			const Matrix& m{ viewProjectionMatrix };
+			const Vector4 column0{ m[0].x, m[1].x, m[2].x, m[3].x };
+			const Vector4 column1{ m[0].y, m[1].y, m[2].y, m[3].y };
+			const Vector4 column2{ m[0].z, m[1].z, m[2].z, m[3].z };
+			const Vector4 column3{ m[0].w, m[1].w, m[2].w, m[3].w };
+
+			//DirectX clip space: -w <= x,y <= w and 0 <= z <= w
+			const Vector4 planes[6]
+			{
+				column3 + column0,
+				column3 - column0,
+				column3 + column1,
+				column3 - column1,
+				column2,
+				column3 - column2
+			};
+
+			Frustum frustum{};
+			for (int planeIdx{}; planeIdx < 6; ++planeIdx)
+			{
+				const Vector3 normal{ planes[planeIdx].GetXYZ() };
+				const float invLength{ 1.f / normal.Magnitude() };
+				frustum.planes[planeIdx] = Plane{ normal * invLength, planes[planeIdx].w * invLength };
+			}
+			return frustum;
+		}
+
+		inline bool IsBoxInFrustum(const Frustum& frustum, const BoundingBox& box)
+		{
+			const Vector3 center{ box.GetCenter() };
+			const Vector3 extent{ box.GetExtent() };
+
+			//Only the corner furthest along the plane normal has to be tested
+			for (const Plane& plane : frustum.planes)
+			{
+				const float projectedExtent{ abs(plane.normal.x) * extent.x + abs(plane.normal.y) * extent.y + abs(plane.normal.z) * extent.z };
+				if (Vector3::Dot(plane.normal, center) + plane.distance < -projectedExtent) return false;
+			}
+			return true;
+		}
+
+		//Largest scale along the axes of the matrix, bounding spheres and errors grow with it
+		inline float GetMaxScale(const Matrix& matrix)
+		{
+			return std::max(matrix.GetAxisX().Magnitude(), std::max(matrix.GetAxisY().Magnitude(), matrix.GetAxisZ().Magnitude()));
+		}
+
+		//True when the matrix only rotates, mirrors and scales uniformly, so it keeps the angles between directions
+		inline bool IsUniformScale(const Matrix& matrix, float tolerance = 1e-3f)
+		{
+			const Vector3 axisX{ matrix.GetAxisX() };
+			const Vector3 axisY{ matrix.GetAxisY() };
+			const Vector3 axisZ{ matrix.GetAxisZ() };
+			const float sqrScale{ axisX.SqrMagnitude() };
+			const float maxError{ sqrScale * tolerance };
+
+			return sqrScale > 0.f
+				&& abs(axisY.SqrMagnitude() - sqrScale) <= maxError && abs(axisZ.SqrMagnitude() - sqrScale) <= maxError
+				&& abs(Vector3::Dot(axisX, axisY)) <= maxError && abs(Vector3::Dot(axisY, axisZ)) <= maxError && abs(Vector3::Dot(axisZ, axisX)) <= maxError;
+		}
+
+		inline BoundingBox TransformBoundingBox(const BoundingBox& box, const Matrix& matrix)
+		{
+			//Transform the center, and project the extent on the absolute axes of the matrix
+			const Vector3 center{ matrix.TransformPoint(box.GetCenter()) };
+			const Vector3 extent{ box.GetExtent() };
+			const Vector3 axisX{ matrix.GetAxisX() };
+			const Vector3 axisY{ matrix.GetAxisY() };
+			const Vector3 axisZ{ matrix.GetAxisZ() };
+
+			const Vector3 worldExtent
+			{
+				abs(axisX.x) * extent.x + abs(axisY.x) * extent.y + abs(axisZ.x) * extent.z,
+				abs(axisX.y) * extent.x + abs(axisY.y) * extent.y + abs(axisZ.y) * extent.z,
+				abs(axisX.z) * extent.x + abs(axisY.z) * extent.y + abs(axisZ.z) * extent.z
+			};
+			return BoundingBox{ center - worldExtent, center + worldExtent };
+		}
+
+		inline bool IsSphereInFrustum(const Frustum& frustum, const Vector3& center, float radius)
+		{
+			//The sphere is outside as soon as it is completely behind one of the planes
+			for (const Plane& plane : frustum.planes)
+			{
+				if (Vector3::Dot(plane.normal, center) + plane.distance < -radius) return false;
+			}
+			return true;
+		}
+
 	}
 
 	namespace BRDF
@@ -216,7 +151,7 @@ namespace dae
 			const Vector3 reflect{ Vector3::Reflect(l, n) };
 			//Used std::max to prevent the result of the dotproduct going under 0
 			const float cosa = std::max(Vector3::Dot(reflect, v), 0.f);
-			const float specularReflection{ ks * powf(cosa, exp) };
+			const float specularReflection{ ks * FastMath::Pow(cosa, exp) };
 			return specularColor * specularReflection;
 		}
 	}
@@ -42,8 +42,9 @@ namespace dae {
 
 	Vector3 Vector3::Normalized() const
 	{
-		const float m = Magnitude();
-		return { x / m, y / m, z / m };
+		//Called for every interpolated normal, tangent and view direction of a pixel
+		const float invM = FastMath::Rsqrt(SqrMagnitude());
+		return { x * invM, y * invM, z * invM };
 	}
 
 	float Vector3::Dot(const Vector3& v1, const Vector3& v2)
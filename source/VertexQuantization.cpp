@@ -0,0 +1,113 @@
+#include "pch.h"
+#include "VertexQuantization.h"
+
+namespace dae
+{
+	namespace VertexQuantization
+	{
+		namespace
+		{
+			constexpr float PositionRange{ 65535.f };
+			constexpr float DirectionRange{ 32767.f };
+
+			uint16_t QuantizeUnorm(float value, float offset, float scale)
+			{
+				//Flat meshes have no extent along an axis
+				const float unorm{ scale > 0.f ? (value - offset) / scale : 0.f };
+				return static_cast<uint16_t>(std::clamp(unorm, 0.f, 1.f) * PositionRange + 0.5f);
+			}
+
+			int16_t QuantizeSnorm(float value)
+			{
+				return static_cast<int16_t>(std::round(std::clamp(value, -1.f, 1.f) * DirectionRange));
+			}
+
+			//Projects the direction on the octahedron |x| + |y| + |z| = 1 and folds the lower half over the upper one
+			void EncodeDirection(const Vector3& direction, int16_t encoded[2])
+			{
+				const float sum{ abs(direction.x) + abs(direction.y) + abs(direction.z) };
+				if (sum <= 0.f)
+				{
+					encoded[0] = 0;
+					encoded[1] = 0;
+					return;
+				}
+
+				float x{ direction.x / sum };
+				float y{ direction.y / sum };
+				if (direction.z < 0.f)
+				{
+					const float foldedX{ (1.f - abs(y)) * (x >= 0.f ? 1.f : -1.f) };
+					const float foldedY{ (1.f - abs(x)) * (y >= 0.f ? 1.f : -1.f) };
+					x = foldedX;
+					y = foldedY;
+				}
+
+				encoded[0] = QuantizeSnorm(x);
+				encoded[1] = QuantizeSnorm(y);
+			}
+		}
+
+		PositionDecoding GetPositionDecoding(const BoundingBox& bounds)
+		{
+			//An empty mesh keeps the identity decoding
+			if (bounds.min.x > bounds.max.x) return PositionDecoding{};
+			return PositionDecoding{ bounds.min, bounds.max - bounds.min };
+		}
+
+		QuantizedVertex Quantize(const Vertex& vertex, const PositionDecoding& decoding)
+		{
+			QuantizedVertex quantized{};
+			quantized.position[0] = QuantizeUnorm(vertex.position.x, decoding.offset.x, decoding.scale.x);
+			quantized.position[1] = QuantizeUnorm(vertex.position.y, decoding.offset.y, decoding.scale.y);
+			quantized.position[2] = QuantizeUnorm(vertex.position.z, decoding.offset.z, decoding.scale.z);
+			EncodeDirection(vertex.normal, quantized.normal);
+			EncodeDirection(vertex.tangent, quantized.tangent);
+			quantized.uv[0] = FloatToHalf(vertex.uv.x);
+			quantized.uv[1] = FloatToHalf(vertex.uv.y);
+			return quantized;
+		}
+
+		Vertex Dequantize(const QuantizedVertex& vertex, const PositionDecoding& decoding)
+		{
+			Vertex out{};
+			const Vector3 position{ LoadPosition(vertex) / PositionRange };
+			out.position = decoding.offset + Vector3{ position.x * decoding.scale.x, position.y * decoding.scale.y, position.z * decoding.scale.z };
+			out.uv = DecodeUV(vertex);
+			out.normal = DecodeDirection(vertex.normal);
+			out.tangent = DecodeDirection(vertex.tangent);
+			return out;
+		}
+
+		Matrix GetPositionDecodeMatrix(const PositionDecoding& decoding)
+		{
+			return Matrix::CreateScale(decoding.scale / PositionRange) * Matrix::CreateTranslation(decoding.offset);
+		}
+
+		uint16_t FloatToHalf(float value)
+		{
+			const uint32_t bits{ std::bit_cast<uint32_t>(value) };
+			const uint16_t sign{ static_cast<uint16_t>((bits >> 16) & 0x8000u) };
+			const int exponent{ static_cast<int>((bits >> 23) & 0xFFu) - 127 + 15 };
+			uint32_t mantissa{ bits & 0x7FFFFFu };
+
+			//NaN, too large for a half, too small for a half
+			if ((bits & 0x7FFFFFFFu) > 0x7F800000u) return sign | 0x7E00u;
+			if (exponent >= 31) return sign | 0x7C00u;
+			if (exponent <= 0)
+			{
+				if (exponent < -10) return sign;
+
+				//Denormal, the implicit one becomes part of the mantissa
+				mantissa |= 0x800000u;
+				const uint32_t shift{ static_cast<uint32_t>(14 - exponent) };
+				const uint32_t denormal{ (mantissa >> shift) + ((mantissa >> (shift - 1)) & 1u) };
+				return static_cast<uint16_t>(sign | denormal);
+			}
+
+			//Rounds to nearest, a carry out of the mantissa correctly increments the exponent
+			const uint32_t half{ (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13) };
+			return static_cast<uint16_t>(sign | (half + ((mantissa >> 12) & 1u)));
+		}
+	}
+}
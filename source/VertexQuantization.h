@@ -0,0 +1,63 @@
+#pragma once
+#include "DataTypes.h"
+#include <bit>
+
+namespace dae
+{
+	//Encoding of QuantizedVertex: positions are 16 bit unorm inside the bounds of the mesh, normals and tangents
+	//are projected on an octahedron and stored as two 16 bit snorm values, uvs are half floats.
+	//The formats match DXGI formats, so the hardware rasterizer decodes them in the input assembler and the vertex shader
+	namespace VertexQuantization
+	{
+		//Object space position = offset + unorm * scale, with unorm the stored value divided by 65535
+		struct PositionDecoding
+		{
+			Vector3 offset{};
+			Vector3 scale{ 1.f, 1.f, 1.f };
+		};
+
+		PositionDecoding GetPositionDecoding(const BoundingBox& bounds);
+		QuantizedVertex Quantize(const Vertex& vertex, const PositionDecoding& decoding);
+		Vertex Dequantize(const QuantizedVertex& vertex, const PositionDecoding& decoding);
+
+		//Maps the stored positions, as they are, to object space. Multiplied in front of the world matrix,
+		//the transform of a vertex decodes its position for free
+		Matrix GetPositionDecodeMatrix(const PositionDecoding& decoding);
+
+		uint16_t FloatToHalf(float value);
+
+		inline float HalfToFloat(uint16_t half)
+		{
+			const uint32_t sign{ static_cast<uint32_t>(half & 0x8000u) << 16 };
+			const uint32_t exponent{ (half >> 10) & 0x1Fu };
+			const uint32_t mantissa{ half & 0x3FFu };
+
+			//Zero and denormals, infinity and NaN, normal values
+			if (exponent == 0) return std::bit_cast<float>(sign) + (sign ? -1.f : 1.f) * static_cast<float>(mantissa) * (1.f / 16777216.f);
+			if (exponent == 31) return std::bit_cast<float>(sign | 0x7F800000u | (mantissa << 13));
+			return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+		}
+
+		inline Vector3 LoadPosition(const QuantizedVertex& vertex)
+		{
+			return Vector3{ static_cast<float>(vertex.position[0]), static_cast<float>(vertex.position[1]), static_cast<float>(vertex.position[2]) };
+		}
+
+		inline Vector2 DecodeUV(const QuantizedVertex& vertex)
+		{
+			return Vector2{ HalfToFloat(vertex.uv[0]), HalfToFloat(vertex.uv[1]) };
+		}
+
+		//Unfolds the lower half of the octahedron and projects back on the sphere
+		inline Vector3 DecodeDirection(const int16_t encoded[2])
+		{
+			Vector3 direction{ std::max(encoded[0] / 32767.f, -1.f), std::max(encoded[1] / 32767.f, -1.f), 0.f };
+			direction.z = 1.f - abs(direction.x) - abs(direction.y);
+
+			const float fold{ std::max(-direction.z, 0.f) };
+			direction.x += direction.x >= 0.f ? -fold : fold;
+			direction.y += direction.y >= 0.f ? -fold : fold;
+			return direction.Normalized();
+		}
+	}
+}
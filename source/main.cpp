@@ -6,6 +6,7 @@
 
 #undef main
 #include "Renderer.h"
+#include "Texture.h"
 #include <Windows.h>
 using namespace dae;
 
@@ -127,6 +128,17 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+
+#ifdef TEXTURE_FETCH_STATISTICS
+			//Average cache lines the software rasterizer touched per texture sample during the last second
+			const Texture::FetchStatistics fetchStatistics{ Texture::GetFetchStatistics() };
+			if (fetchStatistics.numSamples > 0)
+			{
+				std::cout << "Texture cache lines/sample: "
+					<< static_cast<double>(fetchStatistics.numCacheLineFetches) / static_cast<double>(fetchStatistics.numSamples) << std::endl;
+			}
+			Texture::ResetFetchStatistics();
+#endif
 		}		
 	}
 	pTimer->Stop();